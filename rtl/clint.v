@@ -130,5 +130,26 @@ begin
     end
 end
 
+`ifndef SYNTHESIS
+// The checkpoint of rvsim is loaded while the pipeline is stalled, the timer
+// does not count before the pipeline is filled.
+function [31:0] set_time;
+    input [63:0] time_data;
+    input [63:0] timecmp_data;
+    input [31:0] msip_data;
+begin
+    /* verilator lint_off BLKSEQ */
+    /* verilator lint_off BLKANDNBLK */
+    mtime = time_data;
+    mtimecmp = timecmp_data;
+    sw_irq = msip_data[0];
+    ex_irq = msip_data[16];
+    /* verilator lint_on BLKANDNBLK */
+    /* verilator lint_on BLKSEQ */
+    set_time = msip_data;
+end
+endfunction
+`endif // SYNTHESIS
+
 endmodule
 
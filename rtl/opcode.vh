@@ -31,6 +31,7 @@
 localparam  [31: 0] RESETVEC   = 32'h0000_0000;
 
 localparam  [31: 0] NOP        = 32'h0000_0013;     // addi x0, x0, 0
+localparam  [31: 0] WFI        = 32'h1050_0073;     // wait for interrupt
 
 // OPCODE, INST[6:0]
 localparam  [ 6: 0] OP_AUIPC   = 7'b0010111,        // U-type
@@ -131,7 +132,28 @@ localparam  [11: 0] CSR_MVENDORID   = 12'hF11,    // Vender ID
                     CSR_RDTIME      = 12'hc01,    // timer counter
                     CSR_RDTIMEH     = 12'hc81,    // upper 32-bits of timer counter
                     CSR_RDINSTRET   = 12'hc02,    // Instructions-retired counter
-                    CSR_RDINSTRETH  = 12'hc82;    // upper 32-bits of instruction-retired counter
+                    CSR_RDINSTRETH  = 12'hc82,    // upper 32-bits of instruction-retired counter
+
+                    CSR_MCOUNTINHIBIT = 12'h320,  // Machine counter-inhibit register
+                    CSR_MHPMEVENT3  = 12'h323,    // Machine performance-monitoring event selector
+                    CSR_MHPMCOUNTER3 = 12'hb03,   // Machine performance-monitoring counter
+                    CSR_MHPMCOUNTER3H = 12'hb83,  // upper 32-bits of performance-monitoring counter
+                    CSR_HPMCOUNTER3 = 12'hc03,    // User-mode alias of mhpmcounter, read only
+                    CSR_HPMCOUNTER3H = 12'hc83;   // upper 32-bits of user-mode alias
+
+// Hardware performance monitor, mhpmcounter3 ... mhpmcounter(HPM_NUM+2) are
+// implemented, the others are hardwired to zero. The events are the same as
+// tools/opcode.h.
+localparam  [ 4: 0] HPM_NUM         = 5'd4;
+localparam  [ 3: 0] HPM_NONE        = 4'd0,
+                    HPM_CYCLE       = 4'd1,     // cycles
+                    HPM_INSTRET     = 4'd2,     // instructions retired
+                    HPM_BRANCH_TAKEN= 4'd3,     // taken conditional branches
+                    HPM_LOAD        = 4'd4,     // loads
+                    HPM_STORE       = 4'd5,     // stores
+                    HPM_MULDIV      = 4'd6,     // multiply and divide instructions
+                    HPM_STALL       = 4'd7,     // cycles without retiring an instruction
+                    HPM_TRAP        = 4'd8;     // exceptions and interrupts, mret excluded
 
 // system call defined in the file /usr/include/asm-generic/unistd.h
 localparam  [31: 0] SYS_OPEN        = 32'h0031,
@@ -139,11 +161,15 @@ localparam  [31: 0] SYS_OPEN        = 32'h0031,
                     SYS_CLOSE       = 32'h0039,
                     SYS_READ        = 32'h003f,
                     SYS_WRITE       = 32'h0040,
+                    SYS_WRITEV      = 32'h0042,
                     SYS_FSTAT       = 32'h0050,
                     SYS_EXIT        = 32'h005d,
+                    SYS_GETTIMEOFDAY= 32'h00a9,
                     SYS_SBRK        = 32'h00d6,
                     SYS_DUMP        = 32'h0088,
-                    SYS_DUMP_BIN    = 32'h0099;
+                    SYS_DUMP_BIN    = 32'h0099,
+                    SYS_TIMES       = 32'h0100,
+                    SYS_BATCH       = 32'h0101;
 
 // Exception code
 localparam  [31: 0] TRAP_INST_ALIGN = 32'h0,        // Instruction address misaligned
@@ -238,7 +264,9 @@ localparam  [31: 0] MTIME_BASE    = 32'h9000_0000,
                     MSIP_BASE     = 32'h9000_0010,
                     MMIO_PUTC     = 32'hA000_001C,
                     MMIO_GETC     = 32'hA000_0020,
+                    MMIO_PUTS     = 32'hA000_0024,
                     MMIO_EXIT     = 32'hA000_002C,
                     MMIO_TOHOST   = 32'hA000_0030,
-                    MMIO_FROMHOST = 32'hA000_0034;
+                    MMIO_FROMHOST = 32'hA000_0034,
+                    MMIO_DUMP     = 32'hA000_0038;
 
@@ -110,6 +110,9 @@ module riscv #(
     reg                     ex_system;
     reg                     ex_system_op;
     wire                    ex_systemcall;
+    reg                     ex_wfi;
+    reg                     wfi_sleep;
+    wire                    wfi_wakeup;
     wire                    ex_flush;
     reg             [31: 0] ex_csr_read;
     wire                    ex_trap;
@@ -150,6 +153,17 @@ module riscv #(
     reg             [63: 0] csr_cycle;
     reg             [63: 0] csr_instret;
 
+    reg             [63: 0] csr_mhpmcounter [3: HPM_NUM+2];
+    reg             [31: 0] csr_mhpmevent [3: HPM_NUM+2];
+    reg             [31: 0] csr_mcountinhibit;
+    wire                    hpm_csr;
+    wire                    hpm_csr_wr;
+    reg             [31: 0] hpm_read;
+    wire            [31: 0] hpm_wdata;
+    wire                    hpm_count;
+    wire                    hpm_retire;
+    reg             [15: 0] hpm_event;
+
     reg             [31: 0] csr_mscratch;
     reg             [31: 0] csr_mstatus;
     reg             [31: 0] csr_mstatush;
@@ -166,7 +180,7 @@ module riscv #(
 assign if_insn              = imem_rdata;
 
 assign inst                 = flush ? NOP : if_insn;
-assign if_stall             = stall_r || !imem_valid;
+assign if_stall             = stall_r || !imem_valid || wfi_sleep;
 assign dmem_waddr           = wb_waddr;
 assign dmem_raddr           = ex_memaddr;
 assign dmem_rready          = ex_mem2reg;
@@ -248,6 +262,7 @@ always @(posedge clk or negedge resetb) begin
         ex_branch           <= 1'b0;
         ex_system           <= 1'b0;
         ex_system_op        <= 1'b0;
+        ex_wfi              <= 1'b0;
         ex_pc               <= RESETVEC;
         ex_illegal          <= 1'b0;
         ex_mul              <= 1'b0;
@@ -282,6 +297,7 @@ always @(posedge clk or negedge resetb) begin
         ex_system           <= (inst[`OPCODE] == OP_SYSTEM) &&
                                (inst[`FUNC3] == 3'b000);
         ex_system_op        <= inst[`OPCODE] == OP_SYSTEM;
+        ex_wfi              <= inst == WFI;
         ex_pc               <= if_pc;
         ex_illegal          <= !((inst[`OPCODE] == OP_AUIPC )||
                                  (inst[`OPCODE] == OP_LUI   )||
@@ -322,6 +338,8 @@ end
 always @(posedge clk or negedge resetb) begin
     if (!resetb)
         ex_mem2reg          <= 1'b0;
+    else if (wfi_sleep)
+        ex_mem2reg          <= ex_mem2reg;
     else if (inst[`OPCODE] == OP_LOAD)
         ex_mem2reg          <= 1'b1;
     else if (ex_mem2reg && dmem_rvalid)
@@ -375,7 +393,24 @@ assign result_subs[32: 0]   = {alu_op1[31], alu_op1} - {alu_op2[31], alu_op2};
 assign result_subu[32: 0]   = {1'b0, alu_op1} - {1'b0, alu_op2};
 assign ex_memaddr           = alu_op1 + ex_imm;
 assign ex_flush             = wb_branch || wb_branch_nxt;
-assign ex_systemcall        = ex_system && !ex_flush;
+assign ex_systemcall        = ex_system && !ex_wfi && !ex_flush;
+
+// WFI stalls the pipeline until an enabled interrupt is pending, whether
+// or not mstatus.MIE is set. Only the timer interrupt can arrive while the
+// core is waiting, so WFI is a NOP when the timer interrupt is disabled.
+assign wfi_wakeup           = !csr_mie[MTIE] ||
+                              (timer_irq && csr_mie[MTIE]) ||
+                              (sw_irq && csr_mie[MSIE]) ||
+                              (interrupt && csr_mie[MEIE]);
+
+always @(posedge clk or negedge resetb) begin
+    if (!resetb)
+        wfi_sleep           <= 1'b0;
+    else if (wfi_sleep)
+        wfi_sleep           <= !wfi_wakeup;
+    else if (ex_wfi && !ex_stall && !ex_flush)
+        wfi_sleep           <= !wfi_wakeup;
+end
 
 assign result_jal           = ex_pc + ex_imm;
 assign result_jalr          = alu_op1 + ex_imm;
@@ -565,7 +600,7 @@ end
 always @(posedge clk or negedge resetb) begin
     if (!resetb)
         wb_memwr            <= 1'b0;
-    else if (ex_memwr && !ex_flush && !ex_st_align_excp)
+    else if (ex_memwr && !ex_flush && !ex_st_align_excp && !wfi_sleep)
         wb_memwr            <= 1'b1;
     else if (wb_memwr && dmem_wvalid)
         wb_memwr            <= 1'b0;
@@ -609,7 +644,7 @@ end
 ////////////////////////////////////////////////////////////
 assign imem_addr            = fetch_pc;
 assign imem_ready           = !stall_r && !wb_stall;
-assign wb_stall             = stall_r ||
+assign wb_stall             = stall_r || wfi_sleep ||
                               (wb_memwr && !dmem_wvalid) ||
                               (wb_mem2reg && !dmem_rresp);
 assign wb_flush             = wb_nop || wb_nop_more;
@@ -881,10 +916,14 @@ always @* begin
             CSR_RDINSTRET  : ex_csr_read = csr_instret[31:0];
             CSR_RDINSTRETH : ex_csr_read = csr_instret[63:32];
             default: begin
-                ex_ill_csr = 1'b1;
-                `ifndef SYNTHESIS
-                $display("Unsupport CSR register 0x%0x at PC 0x%08x", ex_imm[11:0], ex_pc);
-                `endif
+                if (hpm_csr) begin
+                    ex_csr_read = hpm_read;
+                end else begin
+                    ex_ill_csr = 1'b1;
+                    `ifndef SYNTHESIS
+                    $display("Unsupport CSR register 0x%0x at PC 0x%08x", ex_imm[11:0], ex_pc);
+                    `endif
+                end
             end
         endcase
     end
@@ -954,6 +993,85 @@ always @(posedge clk or negedge resetb) begin
     end
 end
 
+////////////////////////////////////////////////////////////
+// Hardware performance monitor
+////////////////////////////////////////////////////////////
+// The events are counted when the instruction leaves the execution
+// stage, the same as rvsim. The CSR write overrides the event counting
+// of the same cycle. mcountinhibit can not inhibit cycle and instret.
+    localparam      [31: 0] HPM_INHIBIT = ((32'h1 << HPM_NUM) - 32'h1) << 3;
+    localparam      integer HPM_LAST    = HPM_NUM + 2;
+    integer                 n;
+
+assign hpm_csr              = (ex_imm[11:0] == CSR_MCOUNTINHIBIT) ||
+                              ((ex_imm[11:5] == CSR_MHPMEVENT3[11:5] ||
+                                ex_imm[11:5] == CSR_MHPMCOUNTER3[11:5] ||
+                                ex_imm[11:5] == CSR_MHPMCOUNTER3H[11:5] ||
+                                ex_imm[11:5] == CSR_HPMCOUNTER3[11:5] ||
+                                ex_imm[11:5] == CSR_HPMCOUNTER3H[11:5]) &&
+                               ex_imm[4:0] >= 5'd3);
+assign hpm_csr_wr           = !ex_stall && ex_csr_wr && !ex_flush && hpm_csr;
+assign hpm_wdata            = !ex_alu_op[1] ? ex_csr_data : // CSRRW
+                              !ex_alu_op[0] ? (hpm_read | ex_csr_data) : // CSRRS
+                              (hpm_read & ~ex_csr_data); // CSRRC
+assign hpm_count            = !stall_r && (pipefill == 2'b10);
+assign hpm_retire           = hpm_count && !ex_stall && !ex_flush;
+
+always @* begin
+    hpm_read = 32'h0;
+    if (ex_imm[11:0] == CSR_MCOUNTINHIBIT) begin
+        hpm_read = csr_mcountinhibit;
+    end else if (ex_imm[4:0] >= 5'd3 && ex_imm[4:0] < HPM_NUM + 5'd3) begin
+        case (ex_imm[11:5])
+            CSR_MHPMEVENT3[11:5]   : hpm_read = csr_mhpmevent[ex_imm[4:0]];
+            CSR_MHPMCOUNTER3[11:5],
+            CSR_HPMCOUNTER3[11:5]  : hpm_read = csr_mhpmcounter[ex_imm[4:0]][31: 0];
+            default                : hpm_read = csr_mhpmcounter[ex_imm[4:0]][63:32];
+        endcase
+    end
+end
+
+always @* begin
+    hpm_event                   = 16'h0;
+    hpm_event[HPM_CYCLE]        = hpm_count;
+    hpm_event[HPM_INSTRET]      = hpm_retire;
+    hpm_event[HPM_BRANCH_TAKEN] = hpm_retire && ex_branch && branch_taken && !ex_ill_branch;
+    hpm_event[HPM_LOAD]         = hpm_retire && ex_mem2reg && !ex_ld_align_excp;
+    hpm_event[HPM_STORE]        = hpm_retire && ex_memwr && !ex_st_align_excp;
+    hpm_event[HPM_MULDIV]       = hpm_retire && ex_mul;
+    hpm_event[HPM_STALL]        = hpm_count && !hpm_retire;
+    hpm_event[HPM_TRAP]         = hpm_retire && ex_trap &&
+                                  !(ex_systemcall && ex_imm[1:0] == 2'b10); // mret
+end
+
+always @(posedge clk or negedge resetb) begin
+    if (!resetb) begin
+        csr_mcountinhibit               <= 32'h0;
+        for(n = 3; n <= HPM_LAST; n = n + 1) begin
+            csr_mhpmcounter[n]          <= 64'h0;
+            csr_mhpmevent[n]            <= 32'h0;
+        end
+    end else begin
+        if (hpm_csr_wr && ex_imm[11:0] == CSR_MCOUNTINHIBIT)
+            csr_mcountinhibit           <= hpm_wdata & HPM_INHIBIT;
+        for(n = 3; n <= HPM_LAST; n = n + 1) begin
+            if (hpm_csr_wr && ex_imm[4:0] == n[4:0] &&
+                ex_imm[11:5] == CSR_MHPMEVENT3[11:5])
+                csr_mhpmevent[n]        <= hpm_wdata;
+
+            if (hpm_csr_wr && ex_imm[4:0] == n[4:0] &&
+                ex_imm[11:5] == CSR_MHPMCOUNTER3[11:5])
+                csr_mhpmcounter[n]      <= {csr_mhpmcounter[n][63:32], hpm_wdata};
+            else if (hpm_csr_wr && ex_imm[4:0] == n[4:0] &&
+                     ex_imm[11:5] == CSR_MHPMCOUNTER3H[11:5])
+                csr_mhpmcounter[n]      <= {hpm_wdata, csr_mhpmcounter[n][31: 0]};
+            else if (!csr_mcountinhibit[n] && csr_mhpmevent[n][31:4] == 'd0 &&
+                     hpm_event[csr_mhpmevent[n][3:0]])
+                csr_mhpmcounter[n]      <= csr_mhpmcounter[n] + 1'b1;
+        end
+    end
+end
+
 ////////////////////////////////////////////////////////////
 // Register file
 ////////////////////////////////////////////////////////////
@@ -1108,6 +1226,59 @@ begin
 end
 endfunction
 
+// The checkpoint of rvsim is loaded while the pipeline is stalled, the
+// always blocks do not update these registers at the same time.
+function [31:0] set_pc;
+    input [31:0] pc;
+begin
+    /* verilator lint_off BLKSEQ */
+    /* verilator lint_off BLKANDNBLK */
+    fetch_pc = pc;
+    if_pc = pc;
+    /* verilator lint_on BLKANDNBLK */
+    /* verilator lint_on BLKSEQ */
+    set_pc = pc;
+end
+endfunction
+
+function [31:0] set_csr;
+    input [11:0] addr;
+    input [31:0] data;
+begin
+    /* verilator lint_off BLKSEQ */
+    /* verilator lint_off BLKANDNBLK */
+    case(addr)
+        CSR_MSTATUS   : csr_mstatus         = data;
+        CSR_MSTATUSH  : csr_mstatush        = data;
+        CSR_MIE       : csr_mie             = data;
+        CSR_MIP       : csr_mip             = data;
+        CSR_MTVEC     : csr_mtvec           = data;
+        CSR_MSCRATCH  : csr_mscratch        = data;
+        CSR_MEPC      : csr_mepc            = data;
+        CSR_MCAUSE    : csr_mcause          = data;
+        CSR_MTVAL     : csr_mtval           = data;
+        CSR_RDCYCLE   : csr_cycle[31: 0]    = data;
+        CSR_RDCYCLEH  : csr_cycle[63:32]    = data;
+        CSR_RDINSTRET : csr_instret[31: 0]  = data;
+        CSR_RDINSTRETH: csr_instret[63:32]  = data;
+        CSR_MCOUNTINHIBIT: csr_mcountinhibit = data & HPM_INHIBIT;
+        default       : begin
+            if (addr[4:0] >= 5'd3 && addr[4:0] < HPM_NUM + 5'd3) begin
+                if (addr[11:5] == CSR_MHPMEVENT3[11:5])
+                    csr_mhpmevent[addr[4:0]] = data;
+                else if (addr[11:5] == CSR_MHPMCOUNTER3[11:5])
+                    csr_mhpmcounter[addr[4:0]][31: 0] = data;
+                else if (addr[11:5] == CSR_MHPMCOUNTER3H[11:5])
+                    csr_mhpmcounter[addr[4:0]][63:32] = data;
+            end
+        end
+    endcase
+    /* verilator lint_on BLKANDNBLK */
+    /* verilator lint_on BLKSEQ */
+    set_csr = data;
+end
+endfunction
+
 /* verilator coverage_on */
 /* Verilator lint_on UNUSED */
 `endif // SYNTHESIS
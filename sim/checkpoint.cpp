@@ -0,0 +1,147 @@
+// Copyright © 2020 Kuoping Hsu
+// checkpoint.cpp: load the checkpoint of rvsim into the Verilator simulation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The checkpoint of rvsim --checkpoint, tools/checkpoint.h, is the memory and
+// the architectural state at an instruction boundary. The memory is loaded
+// before the simulation instead of the ELF file, and the testbench writes the
+// registers, the CSRs and the timer into the core by the functions below
+// while the pipeline is stalled after the reset.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../tools/opcode.h"
+#include "../tools/checkpoint.h"
+
+char *mem_data(void);
+
+static CKPT_HEADER h;
+static FILE *fp = NULL;
+static int valid = 0;
+
+// read the header, return the memory size in Kb
+int ckpt_open(const char *file)
+{
+    if ((fp = fopen(file, "rb")) == NULL) {
+        printf("Can not read checkpoint %s\n", file);
+        exit(1);
+    }
+    if (fread(&h, sizeof(h), 1, fp) != 1 ||
+        memcmp(h.magic, CKPT_MAGIC, 4) || h.version != CKPT_VERSION) {
+        printf("%s is not a checkpoint of rvsim\n", file);
+        exit(1);
+    }
+    return h.mem_size / 1024;
+}
+
+// read the chunks into the memory of mem_init()
+void ckpt_load(void)
+{
+    CKPT_CHUNK chunk;
+    char *mem = mem_data();
+
+    while (fread(&chunk, sizeof(chunk), 1, fp) == 1 && chunk.offset != CKPT_END) {
+        if ((uint64_t)chunk.offset + chunk.size > (uint64_t)h.mem_size * 2 ||
+            fread(mem + chunk.offset, 1, chunk.size, fp) != chunk.size) {
+            printf("The checkpoint is broken\n");
+            exit(1);
+        }
+    }
+    if (chunk.offset != CKPT_END) {
+        printf("The checkpoint is truncated\n");
+        exit(1);
+    }
+    fclose(fp);
+    fp = NULL;
+    valid = 1;
+}
+
+extern "C"
+int ckpt_valid(void)
+{
+    return valid;
+}
+
+extern "C"
+int ckpt_pc(void)
+{
+    return h.pc;
+}
+
+extern "C"
+int ckpt_reg(int n)
+{
+    return h.regs[n & 31];
+}
+
+extern "C"
+int ckpt_csr(int addr)
+{
+    switch(addr) {
+        case CSR_MSTATUS:   return h.mstatus;
+        case CSR_MSTATUSH:  return h.mstatush;
+        case CSR_MIE:       return h.mie;
+        case CSR_MIP:       return h.mip;
+        case CSR_MTVEC:     return h.mtvec;
+        case CSR_MSCRATCH:  return h.mscratch;
+        case CSR_MEPC:      return h.mepc;
+        case CSR_MCAUSE:    return h.mcause;
+        case CSR_MTVAL:     return h.mtval;
+        case CSR_RDCYCLE:   return (int)h.cycle;
+        case CSR_RDCYCLEH:  return (int)(h.cycle >> 32);
+        case CSR_RDINSTRET: return (int)h.instret;
+        case CSR_RDINSTRETH:return (int)(h.instret >> 32);
+        case CSR_MCOUNTINHIBIT: return h.mcountinhibit;
+        default:            break;
+    }
+
+    // mhpmevent3, mhpmcounter3 and mhpmcounter3h ...
+    if ((addr & 0x1f) >= 3 && (addr & 0x1f) < HPM_NUM + 3) {
+        int n = (addr & 0x1f) - 3;
+        if ((addr & ~0x1f) == (CSR_MHPMEVENT3 & ~0x1f))
+            return h.mhpmevent[n];
+        if ((addr & ~0x1f) == (CSR_MHPMCOUNTER3 & ~0x1f))
+            return (int)h.mhpmcounter[n];
+        if ((addr & ~0x1f) == (CSR_MHPMCOUNTER3H & ~0x1f))
+            return (int)(h.mhpmcounter[n] >> 32);
+    }
+    return 0;
+}
+
+extern "C"
+long long ckpt_mtime(void)
+{
+    return h.mtime;
+}
+
+extern "C"
+long long ckpt_mtimecmp(void)
+{
+    return h.mtimecmp;
+}
+
+extern "C"
+int ckpt_msip(void)
+{
+    return h.msip;
+}
@@ -0,0 +1,196 @@
+// Copyright © 2020 Kuoping Hsu
+// farm.cpp: run a list of programs by the workers of one sim
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The memory and the host devices of the DPI are global to the process, so
+// each program runs in a worker forked from the sim, with its own model,
+// memory and devices. The workers share the code of the model, and start
+// without loading the sim again. The list has a program for each line,
+//     prog.elf [dir]
+// and the worker runs in dir (default farm/<name of prog>), where the console
+// goes to sim.log, and the trace log and the dump are written. The result of
+// a program is read from its sim.log when the worker exits.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+#define FARM_DIR    "farm"
+
+typedef struct {
+    std::string elf;
+    std::string dir;
+    pid_t       pid;
+} FARM_JOB;
+
+static int mkdirs(const std::string &dir)
+{
+    for (size_t n = dir.find('/', 1); ; n = dir.find('/', n + 1)) {
+        if (mkdir(dir.substr(0, n).c_str(), 0755) != 0 && errno != EEXIST)
+            return 0;
+        if (n == std::string::npos)
+            return 1;
+    }
+}
+
+// Return 0 if fails, the programs not found are failed
+static int read_list(const char *file, std::vector<FARM_JOB> &jobs, int *failed)
+{
+    char line[PATH_MAX * 2];
+    char elf[PATH_MAX], dir[PATH_MAX], path[PATH_MAX];
+    FILE *fp;
+
+    if ((fp = fopen(file, "r")) == NULL)
+        return 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+        FARM_JOB job;
+        int n = sscanf(line, "%s %s", elf, dir);
+
+        if (n < 1 || elf[0] == '#')
+            continue;
+
+        // the worker changes the directory
+        if (!realpath(elf, path)) {
+            printf("%-40s FAIL, can not find the program\n", elf);
+            (*failed)++;
+            continue;
+        }
+        job.elf = path;
+        if (n >= 2) {
+            job.dir = dir;
+        } else {
+            std::string name = strrchr(path, '/') + 1;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".elf") == 0)
+                name.resize(name.size() - 4);
+            job.dir = std::string(FARM_DIR "/") + name;
+        }
+        job.pid = 0;
+        jobs.push_back(job);
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+// Return 1 if the program passes, and the cycles of the RTL
+static int result(const FARM_JOB &job, long long *cycles)
+{
+    std::string log = job.dir + "/sim.log";
+    char line[1024];
+    long long instret;
+    int pass = 0;
+    FILE *fp;
+
+    *cycles = 0;
+    if ((fp = fopen(log.c_str(), "r")) == NULL)
+        return 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (strstr(line, "Program terminate"))
+            pass = 1;
+        sscanf(line, "Excuting %lld instructions, %lld cycles", &instret, cycles);
+    }
+
+    fclose(fp);
+    return pass;
+}
+
+// The worker returns the program to run, in its directory with the console
+// to sim.log. The sim waits for the workers, reports and exits.
+const char *farm(const char *list, int workers)
+{
+    static std::vector<FARM_JOB> jobs;
+    size_t next = 0, done = 0;
+    int running = 0, failed = 0, missing;
+
+    if (!read_list(list, jobs, &failed)) {
+        printf("Can not read the list %s\n", list);
+        exit(1);
+    }
+    missing = failed;
+    if (workers <= 0)
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while (done < jobs.size()) {
+        // start the workers
+        while (running < workers && next < jobs.size()) {
+            FARM_JOB &job = jobs[next++];
+
+            fflush(stdout);
+            if ((job.pid = fork()) < 0) {
+                printf("Can not fork the worker\n");
+                exit(1);
+            }
+            if (job.pid == 0) {
+                int fd;
+                if (!mkdirs(job.dir) || chdir(job.dir.c_str()) != 0 ||
+                    (fd = open("sim.log", O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0) {
+                    exit(1);
+                }
+                signal(SIGINT, SIG_DFL);
+                dup2(fd, 1);
+                dup2(fd, 2);
+                close(fd);
+                // no console input for the workers
+                if ((fd = open("/dev/null", O_RDONLY)) >= 0) {
+                    dup2(fd, 0);
+                    close(fd);
+                }
+                return job.elf.c_str();
+            }
+            running++;
+        }
+
+        // wait for any of them
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) {
+            printf("Can not wait for the workers\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < next; i++) {
+            long long cycles;
+
+            if (jobs[i].pid != pid)
+                continue;
+
+            int pass = WIFEXITED(status) && result(jobs[i], &cycles);
+            printf("%-40s %s %12lld cycles\n", jobs[i].dir.c_str(),
+                   pass ? "PASS" : "FAIL", pass ? cycles : 0);
+            failed += !pass;
+            running--;
+            done++;
+        }
+    }
+
+    printf("\n%d passed, %d failed\n", (int)jobs.size() + missing - failed, failed);
+    exit(failed ? 1 : 0);
+}
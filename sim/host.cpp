@@ -0,0 +1,142 @@
+// Copyright © 2020 Kuoping Hsu
+// host.cpp: host devices of the Verilator simulation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The console, the syscalls and HTIF of the testbench are the code of rvsim,
+// tools/console.c, tools/syscall.c and tools/htif.c, on DMEM of
+// sim/memory.cpp. They are compiled in the namespace host, so they do not
+// clash with the copies of tools/librvsim.a in the lockstep build. The time
+// of the host calls is the cycle count of the RTL.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "../tools/opcode.h"
+
+#ifdef SAVABLE
+#include "verilated_save.h"
+#endif
+
+char *mem_data(void);
+extern "C" int mem_dpi_size(void);
+
+namespace host {
+
+CSR csr;
+int *dmem = NULL;
+int mem_base = 0;
+int mem_size = 0;
+int lockstep = 0;
+
+static int exited = 0;
+
+void console_flush(void);
+
+// the testbench prints the statistics and finishes the simulation
+void prog_exit(int exitcode)
+{
+    (void)exitcode;
+    console_flush();
+    exited = 1;
+}
+
+#include "../tools/console.c"
+#include "../tools/syscall.c"
+#include "../tools/htif.c"
+
+} // namespace host
+
+void host_init(int flush_char)
+{
+    host::mem_size = mem_dpi_size();
+    host::dmem = (int*)(mem_data() + host::mem_size);
+
+    if (flush_char)
+        host::console_policy((char*)"char");
+    host::console_init();
+}
+
+extern "C"
+void host_putc(char c, long long cycle)
+{
+    host::csr.cycle.c = cycle;
+    host::console_putc(c);
+}
+
+// return the bytes not flushed yet
+extern "C"
+int host_idle(long long cycle)
+{
+    host::csr.cycle.c = cycle;
+    host::console_idle();
+    return host::console_pending;
+}
+
+// write of MMIO_TOHOST, return the value of MMIO_FROMHOST
+extern "C"
+int host_tohost(int ptr, long long cycle)
+{
+    host::csr.cycle.c = cycle;
+    host::srv32_tohost(ptr);
+    return host::srv32_fromhost();
+}
+
+// ecall, return the value of a0, or -1 if a0 is not changed
+extern "C"
+int host_syscall(int func, int a0, int a1, int a2, int a3, int a4, int a5,
+                 long long cycle)
+{
+    host::csr.cycle.c = cycle;
+    return host::srv32_syscall(func, a0, a1, a2, a3, a4, a5);
+}
+
+// return 1 if the program exits by the host call
+extern "C"
+int host_exit(void)
+{
+    return host::exited;
+}
+
+#ifdef SAVABLE
+// the console is flushed, and the result of HTIF is the state of the host
+void host_save(VerilatedSerialize &os)
+{
+    uint32_t result = host::result;
+
+    host::console_flush();
+    os << result;
+}
+
+void host_restore(VerilatedDeserialize &os)
+{
+    uint32_t result;
+
+    os >> result;
+    host::result = result;
+}
+#endif // SAVABLE
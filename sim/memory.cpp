@@ -0,0 +1,180 @@
+// Copyright © 2020 Kuoping Hsu
+// memory.cpp: sparse memory of the testbench
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The memory models of testbench/memmodel.v access the memory here by DPI.
+// IMEM is at the offset 0 and DMEM at the offset of the memory size, the
+// same layout as memory.bin of the single RAM. The memory is one mapping
+// without the backing store reserved, the host backs the pages at the first
+// write, and the pages never written read as zero, so the memory size is set
+// at run time, and the host memory is the pages touched. The host devices of
+// sim/host.cpp access DMEM directly.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifdef SAVABLE
+#include "verilated_save.h"
+#endif
+
+#define CHUNK_SIZE  65536           // unit of the checkpoint
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+extern "C"
+int elfloader(char *file, char *mem,
+              int imem_base, int dmem_base,
+              int imem_size, int dmem_size);
+
+#ifndef LOCKSTEP
+#include "../tools/elfloader.c"
+#endif
+
+static char *mem = NULL;
+static uint32_t mem_bytes = 0;      // the size of IMEM, and of DMEM
+static uint64_t mem_total = 0;      // IMEM and DMEM
+
+void mem_init(int size)
+{
+    mem_bytes = size;
+    mem_total = (uint64_t)size * 2;
+
+    if ((mem = (char*)mmap(NULL, mem_total, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                           -1, 0)) == MAP_FAILED) {
+        printf("memory allocate failure\n");
+        exit(1);
+    }
+}
+
+// the memory of IMEM and DMEM
+char *mem_data(void)
+{
+    return mem;
+}
+
+// Load the ELF into the memory, return 0 if fails
+int mem_load(char *file)
+{
+    return elfloader(file, mem, 0, mem_bytes, mem_bytes, mem_bytes);
+}
+
+// the size of IMEM, and of DMEM
+extern "C"
+int mem_dpi_size(void)
+{
+    return mem_bytes;
+}
+
+// the offset of the memory file of memmodel.v
+extern "C"
+int mem_dpi_base(const char *name)
+{
+    return strcmp(name, "dmem.bin") ? 0 : mem_bytes;
+}
+
+// the size of the memory file of memmodel.v, unsigned in the testbench
+extern "C"
+int mem_dpi_span(const char *name)
+{
+    return strcmp(name, "memory.bin") ? mem_bytes : (int)mem_total;
+}
+
+extern "C"
+int mem_read(int address)
+{
+    if ((uint32_t)address >= mem_total)
+        return 0;
+
+    return *(int*)&mem[address & ~3];
+}
+
+extern "C"
+void mem_write(int address, int data, int strb)
+{
+    uint32_t *word;
+    uint32_t mask;
+
+    if ((uint32_t)address >= mem_total) {
+        printf("Address %08x out of range\n", address);
+        return;
+    }
+
+    mask = ((strb & 1) ? 0x000000ff : 0) |
+           ((strb & 2) ? 0x0000ff00 : 0) |
+           ((strb & 4) ? 0x00ff0000 : 0) |
+           ((strb & 8) ? 0xff000000 : 0);
+    if (!mask)
+        return;
+
+    word = (uint32_t*)&mem[address & ~3];
+    *word = (*word & ~mask) | (data & mask);
+}
+
+#ifdef SAVABLE
+// the chunks not all zero, and the end of the memory as the end mark
+void mem_save(VerilatedSerialize &os)
+{
+    uint64_t address;
+    uint32_t i;
+
+    os << mem_bytes;
+    for(address = 0; address < mem_total; address += CHUNK_SIZE) {
+        uint32_t *src = (uint32_t*)&mem[address];
+        uint32_t size = (mem_total - address < CHUNK_SIZE) ?
+                        mem_total - address : CHUNK_SIZE;
+
+        for(i = 0; i < size / 4 && src[i] == 0; i++)
+            ;
+        if (i < size / 4) {
+            os << address << size;
+            os.write(src, size);
+        }
+    }
+    os << mem_total;
+}
+
+// return 0 if the memory size is not the same
+int mem_restore(VerilatedDeserialize &os)
+{
+    uint64_t address;
+    uint32_t size;
+
+    os >> size;
+    if (size != mem_bytes)
+        return 0;
+
+    // drop the pages in place, the memory not in the checkpoint is zero, and
+    // the address of the memory cached by sim/host.cpp is kept
+    if (madvise(mem, mem_total, MADV_DONTNEED) != 0)
+        memset(mem, 0, mem_total);
+
+    for(os >> address; address < mem_total; os >> address) {
+        os >> size;
+        os.read(&mem[address], size);
+    }
+    return 1;
+}
+#endif // SAVABLE
@@ -0,0 +1,158 @@
+// Copyright © 2020 Kuoping Hsu
+// profile.cpp: PC sampling profiler of the Verilator simulation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// With +profile=n, the testbench samples the PC of the write back stage and
+// the stalls of the pipeline about every n cycles. The interval is jittered
+// uniformly between n/2 and 3n/2 cycles, so the samples do not lock to the
+// loops of the same period. The samples are counted for the function of the
+// PC by the symbols of the ELF file, and the profile is written to
+// profile.txt at the end of the simulation.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../tools/elf.h"
+
+#define PROFILE_FILE    "profile.txt"
+
+#ifdef LOCKSTEP
+extern "C" {
+#endif
+int elfsymbols(char *file, ElfSymbol **symbols);
+int elfsymbol_lookup(ElfSymbol *symbols, int count, unsigned int addr);
+#ifdef LOCKSTEP
+}
+#endif
+
+typedef struct {
+    long long   samples;
+    long long   if_stall;
+    long long   ex_stall;
+    long long   ex_flush;
+} PROFILE;
+
+static ElfSymbol *symbols = NULL;
+static int nsymbols = 0;
+static PROFILE *prof = NULL;        // index 0 for the unknown function
+static PROFILE total;
+static int period = 0;
+static uint32_t seed = 1;
+
+void profile_open(const char *elf, int n)
+{
+    period = n > 1 ? n : 1;
+
+    if (elf)
+        nsymbols = elfsymbols((char*)elf, &symbols);
+    if (nsymbols == 0)
+        printf("Warning: no symbol table for the profile\n");
+
+    if ((prof = (PROFILE*)calloc(nsymbols + 1, sizeof(PROFILE))) == NULL) {
+        printf("malloc fail\n");
+        exit(1);
+    }
+}
+
+// return the cycles to the next sample
+extern "C"
+int profile_sample(int pc, int if_stall, int ex_stall, int ex_flush)
+{
+    PROFILE *p;
+
+    if (!prof)
+        return 0;
+
+    p = &prof[elfsymbol_lookup(symbols, nsymbols, (unsigned int)pc) + 1];
+    p->samples++;
+    p->if_stall += if_stall != 0;
+    p->ex_stall += ex_stall != 0;
+    p->ex_flush += ex_flush != 0;
+    total.samples++;
+    total.if_stall += if_stall != 0;
+    total.ex_stall += ex_stall != 0;
+    total.ex_flush += ex_flush != 0;
+
+    seed = seed * 1103515245 + 12345;
+    return period / 2 + (seed >> 8) % period;
+}
+
+void profile_close(void)
+{
+    FILE *fp;
+    int *order;
+    int i, j, n;
+
+    if (!prof)
+        return;
+
+    n = nsymbols + 1;
+    if ((order = (int*)calloc(n, sizeof(int))) == NULL) {
+        printf("malloc fail\n");
+        exit(1);
+    }
+
+    // sort by the samples
+    for(i = 0; i < n; i++) {
+        int v = i;
+        for(j = i; j > 0 && prof[order[j-1]].samples < prof[v].samples; j--)
+            order[j] = order[j-1];
+        order[j] = v;
+    }
+
+    if ((fp = fopen(PROFILE_FILE, "w")) == NULL) {
+        printf("can not open file %s\n", PROFILE_FILE);
+        exit(1);
+    }
+
+    fprintf(fp, "# %lld samples, about every %d cycles\n", total.samples, period);
+    fprintf(fp, "# %-30s %10s %7s %10s %10s %10s\n",
+            "function", "samples", "%", "if_stall", "ex_stall", "ex_flush");
+    for(i = 0; i < n; i++) {
+        PROFILE *p = &prof[order[i]];
+        if (!p->samples)
+            break;
+        fprintf(fp, "%-32s %10lld %6.2f%% %10lld %10lld %10lld\n",
+                order[i] ? symbols[order[i]-1].name : "(unknown)",
+                p->samples, p->samples * 100.0 / total.samples,
+                p->if_stall, p->ex_stall, p->ex_flush);
+    }
+    fclose(fp);
+
+    if (total.samples) {
+        printf("\nProfile of %lld samples: if_stall %.2f%%, ex_stall %.2f%%, ex_flush %.2f%%\n",
+               total.samples,
+               total.if_stall * 100.0 / total.samples,
+               total.ex_stall * 100.0 / total.samples,
+               total.ex_flush * 100.0 / total.samples);
+        for(i = 0; i < n && i < 10 && prof[order[i]].samples; i++) {
+            printf("%-32.32s %6.2f%%\n",
+                   order[i] ? symbols[order[i]-1].name : "(unknown)",
+                   prof[order[i]].samples * 100.0 / total.samples);
+        }
+        printf("The profile is written to %s\n", PROFILE_FILE);
+    }
+
+    free(order);
+    free(prof);
+    prof = NULL;
+}
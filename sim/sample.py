@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+# Copyright © 2020 Kuoping Hsu
+# sample.py: sampled RTL simulation from the checkpoints of rvsim
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the “Software”), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# rvsim runs the whole program and writes a checkpoint every interval
+# instructions. Each checkpoint is a sample: sim starts from it, runs the
+# warm-up instructions, and reports the cycles of the measured instructions.
+# The samples run in parallel, each in its own directory, and the CPI of the
+# program is estimated by the mean CPI of the samples, with the confidence
+# interval of the mean.
+
+import argparse
+import math
+import os
+import re
+import struct
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+# the head of CKPT_HEADER of tools/checkpoint.h
+CKPT_HEAD = struct.Struct('<4sIII32IQQ')
+
+# two-sided 95% of Student's t for 1 to 30 degrees of freedom
+T95 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+       2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+       2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042]
+
+def t95(df):
+    return T95[df - 1] if df <= len(T95) else 1.960
+
+def run_rvsim(args, prefix):
+    cmd = [args.rvsim, '-n', str(args.memsize),
+           '--checkpoints', '%s@%d' % (prefix, args.interval), args.elf]
+    out = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                         universal_newlines=True).stdout
+    m = re.search(r'Excuting (\d+) instructions, (\d+) cycles', out)
+    if not m:
+        sys.exit('rvsim fails:\n' + out)
+    return int(m.group(1)), int(m.group(2))
+
+def read_head(file):
+    with open(file, 'rb') as f:
+        head = CKPT_HEAD.unpack(f.read(CKPT_HEAD.size))
+    if head[0] != b'RVCP':
+        sys.exit('%s is not a checkpoint' % file)
+    # instret and cycle of rvsim
+    return head[-1], head[-2]
+
+def run_sample(args, n, ckpt):
+    cwd = os.path.join(args.workdir, 's%d' % n)
+    os.makedirs(cwd, exist_ok=True)
+    cmd = [os.path.abspath(args.sim), '+checkpoint=' + os.path.abspath(ckpt),
+           '+warmup=%d' % args.warmup, '+measure=%d' % args.measure]
+    out = subprocess.run(cmd, cwd=cwd, stdout=subprocess.PIPE,
+                         stderr=subprocess.STDOUT, universal_newlines=True).stdout
+    with open(os.path.join(cwd, 'sim.log'), 'w') as f:
+        f.write(out)
+    m = re.search(r'Measured (\d+) instructions, (\d+) cycles', out)
+    if not m:
+        return None
+    return int(m.group(1)), int(m.group(2))
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Sampled RTL simulation from the checkpoints of rvsim')
+    parser.add_argument('elf', help='the elf executable file')
+    parser.add_argument('-i', '--interval', type=int, default=1000000,
+                        help='instructions between the samples (default 1000000)')
+    parser.add_argument('-w', '--warmup', type=int, default=2000,
+                        help='warm-up instructions of a sample (default 2000)')
+    parser.add_argument('-m', '--measure', type=int, default=20000,
+                        help='measured instructions of a sample (default 20000)')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(),
+                        help='parallel simulations (default the host cores)')
+    parser.add_argument('-n', '--memsize', type=int, default=256,
+                        help='memory size in Kb (default 256)')
+    parser.add_argument('-d', '--workdir', default='sample',
+                        help='directory of the checkpoints and logs (default sample)')
+    parser.add_argument('--rvsim', default='../tools/rvsim', help='the ISS')
+    parser.add_argument('--sim', default='./sim', help='the Verilator sim')
+    args = parser.parse_args()
+
+    if args.warmup + args.measure > args.interval:
+        print('Warning: the samples overlap, warm-up + measure > interval')
+
+    os.makedirs(args.workdir, exist_ok=True)
+    prefix = os.path.join(args.workdir, 'ckpt')
+    for f in os.listdir(args.workdir):
+        if f.startswith('ckpt.'):
+            os.remove(os.path.join(args.workdir, f))
+
+    instret, cycles = run_rvsim(args, prefix)
+    ckpts = []
+    while os.path.exists('%s.%d' % (prefix, len(ckpts) + 1)):
+        ckpts.append('%s.%d' % (prefix, len(ckpts) + 1))
+    if len(ckpts) < 2:
+        sys.exit('%d instructions give %d samples, reduce the interval' %
+                 (instret, len(ckpts)))
+
+    print('rvsim: %d instructions, %d cycles, %d samples' %
+          (instret, cycles, len(ckpts)))
+
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        results = list(pool.map(lambda a: run_sample(args, *a),
+                                enumerate(ckpts, 1)))
+
+    cpi = []
+    for n, (ckpt, r) in enumerate(zip(ckpts, results), 1):
+        start, _ = read_head(ckpt)
+        if r is None:
+            print('sample %3d at %10d: no result, see %s/s%d/sim.log' %
+                  (n, start, args.workdir, n))
+            continue
+        cpi.append(r[1] / r[0])
+        print('sample %3d at %10d: %d instructions, %d cycles, %.3f CPI' %
+              (n, start, r[0], r[1], cpi[-1]))
+
+    if len(cpi) < 2:
+        sys.exit('not enough samples')
+
+    mean = sum(cpi) / len(cpi)
+    sd = math.sqrt(sum((c - mean) ** 2 for c in cpi) / (len(cpi) - 1))
+    err = t95(len(cpi) - 1) * sd / math.sqrt(len(cpi))
+
+    print('')
+    print('RTL   : %.3f CPI +- %.3f (95%%), %d +- %d cycles' %
+          (mean, err, mean * instret, err * instret))
+    print('rvsim : %.3f CPI, %d cycles, %+.2f%% of the RTL estimate' %
+          (cycles / instret, cycles, (cycles / instret / mean - 1) * 100))
+
+if __name__ == '__main__':
+    main()
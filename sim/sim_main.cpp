@@ -1,6 +1,10 @@
 #include <signal.h>
+#include <string.h>
 #include "Vriscv.h"
 #include "verilated.h"
+#ifdef SAVABLE
+#include "verilated_save.h"
+#endif
 
 #define HAVE_CHRONO
 
@@ -9,14 +13,37 @@
 #include <iostream>
 #endif
 
-#define RESOLUTION 4
+#define RESOLUTION 4     // time units of a cycle
+#define RESET_CYCLES 1   // resetb is released at the rising edge of the cycle
+#define STALL_CYCLES 7   // stall is released at the falling edge of the cycle
 
-extern "C"
-int elfloader(char *file, char *mem,
-              int imem_base, int dmem_base,
-              int imem_size, int dmem_size);
+void mem_init(int size);
+int mem_load(char *file);
+char *mem_data(void);
+void host_init(int flush_char);
+void trace_close(void);
+void wave_open(Vriscv *top);
+void wave_dump(vluint64_t time, vluint64_t cycles);
+void wave_close(void);
+extern int wave_on;
+int ckpt_open(const char *file);
+void ckpt_load(void);
+const char *farm(const char *list, int workers);
+void profile_open(const char *elf, int period);
+void profile_close(void);
 
-#include "../tools/elfloader.c"
+#ifdef SAVABLE
+void mem_save(VerilatedSerialize &os);
+int mem_restore(VerilatedDeserialize &os);
+void host_save(VerilatedSerialize &os);
+void host_restore(VerilatedDeserialize &os);
+#endif
+
+#ifdef LOCKSTEP
+// the ISS of tools/librvsim.a is the reference model
+extern "C"
+void lockstep_init(char *elf, int memsize, char *rtl_dmem);
+#endif
 
 vluint64_t main_time = 0;
 
@@ -25,58 +52,63 @@ double sc_time_stamp(void)
     return main_time;
 }
 
-void elfread(char *filename)
+void finish(int dummy)
 {
-    FILE *fp;
-    char *mem;
-    int memsize = MEMSIZE * 1024;
-
-    if ((mem = (char*)malloc(memsize*2)) == NULL) {
-        printf("memory allocate failure\n");
-        exit(1);
-    }
-    if (elfloader(filename, (char*)mem, 0, memsize, memsize, memsize) == 0) {
-        printf("Can not read elf file %s\n", filename);
-        exit(1);
-    }
+    puts("\nCtrl-C...\n");
+    exit(-1);
+}
 
-    if ((fp = fopen("imem.bin", "wb")) == NULL) {
-        printf("file imem.bin creates fail\n");
-        exit(1);
-    }
+#ifdef SAVABLE
+// The checkpoint is the model, the memory and the host devices at the end
+// of a cycle. The waveform and the trace log are not in the checkpoint.
+static void save(const char *file, Vriscv *top, vluint64_t cycles)
+{
+    VerilatedSave os;
 
-    if (memsize != fwrite(mem, sizeof(char), memsize, fp)) {
-        printf("file write fail\n");
+    os.open(file);
+    if (!os.isOpen()) {
+        printf("Can not create checkpoint %s\n", file);
         exit(1);
     }
+    os << main_time << cycles;
+    os << *top;
+    mem_save(os);
+    host_save(os);
+    os.close();
+}
 
-    fclose(fp);
+static void restore(const char *file, Vriscv *top, vluint64_t *cycles)
+{
+    VerilatedRestore os;
 
-    if ((fp = fopen("dmem.bin", "wb")) == NULL) {
-        printf("file dmem.bin creates fail\n");
+    os.open(file);
+    if (!os.isOpen()) {
+        printf("Can not read checkpoint %s\n", file);
         exit(1);
     }
-
-    if (memsize != fwrite(&mem[memsize], sizeof(char), memsize, fp)) {
-        printf("file write fail\n");
+    os >> main_time >> *cycles;
+    os >> *top;
+    if (!mem_restore(os)) {
+        printf("The memory size of checkpoint %s is different\n", file);
         exit(1);
     }
-
-    fclose(fp);
-    free(mem);
-}
-
-void finish(int dummy)
-{
-    unlink("imem.bin");
-    unlink("dmem.bin");
-    puts("\nCtrl-C...\n");
-    exit(-1);
+    host_restore(os);
+    os.close();
 }
+#endif // SAVABLE
 
 int main(int argc, char** argv)
 {
-    int elf_loaded = 0;
+    vluint64_t cycles = 0;
+    const char *plusarg;
+    int memsize;
+    int load_elf;
+    const char *elf = NULL;
+    int load_ckpt = 0;
+    #ifdef SAVABLE
+    std::string save_file, restore_file;
+    vluint64_t save_cycle = 0;
+    #endif
     Verilated::commandArgs(argc,argv);
     Verilated::traceEverOn(true);
 
@@ -86,43 +118,150 @@ int main(int argc, char** argv)
 
     signal(SIGINT, finish);
 
-    if (argc >= 2 && argv[argc-1][0] != '+' && argv[argc-1][0] != '-') {
-        elfread(argv[argc-1]);
-        elf_loaded = 1;
+    // the memory size in Kb, the default is MEMSIZE of the build
+    memsize = MEMSIZE;
+    plusarg = Verilated::commandArgsPlusMatch("memsize=");
+    if (plusarg[0]) {
+        memsize = atoi(plusarg + strlen("+memsize="));
+    }
+
+    load_elf = argc >= 2 && argv[argc-1][0] != '+' && argv[argc-1][0] != '-';
+    if (load_elf) {
+        elf = argv[argc-1];
+    }
+
+    // +farm=list [+jobs=n], the workers return with their programs
+    plusarg = Verilated::commandArgsPlusMatch("farm=");
+    if (plusarg[0]) {
+        const char *jobs = Verilated::commandArgsPlusMatch("jobs=");
+        elf = farm(plusarg + strlen("+farm="),
+                   jobs[0] ? atoi(jobs + strlen("+jobs=")) : 0);
+        load_elf = 1;
+    }
+
+    // +checkpoint=file of rvsim, the memory size is of the checkpoint
+    plusarg = Verilated::commandArgsPlusMatch("checkpoint=");
+    if (plusarg[0]) {
+        memsize = ckpt_open(plusarg + strlen("+checkpoint="));
+        load_elf = 0;
+        load_ckpt = 1;
+        #ifdef LOCKSTEP
+        printf("Can not start from the checkpoint in lockstep\n");
+        exit(1);
+        #endif
+    }
+
+    mem_init(memsize * 1024);
+    if (load_ckpt) {
+        ckpt_load();
+    }
+
+    #ifdef SAVABLE
+    // +save=file@cycle, +restore=file
+    plusarg = Verilated::commandArgsPlusMatch("save=");
+    if (plusarg[0]) {
+        const char *at = strrchr(plusarg, '@');
+        if (!at) {
+            printf("Usage: +save=file@cycle\n");
+            exit(1);
+        }
+        save_file = std::string(plusarg + strlen("+save="), at);
+        save_cycle = strtoull(at + 1, NULL, 0);
+    }
+    plusarg = Verilated::commandArgsPlusMatch("restore=");
+    if (plusarg[0]) {
+        restore_file = plusarg + strlen("+restore=");
+        load_elf = 0;
+        #ifdef LOCKSTEP
+        printf("Can not restore the checkpoint in lockstep\n");
+        exit(1);
+        #endif
+    }
+    #endif // SAVABLE
+
+    if (load_elf) {
+        if (!mem_load((char*)elf)) {
+            printf("Can not read elf file %s\n", elf);
+            exit(1);
+        }
+        #ifdef LOCKSTEP
+        lockstep_init((char*)elf, memsize, mem_data() + memsize * 1024);
+        #endif
+    }
+
+    host_init(Verilated::commandArgsPlusMatch("flush-char")[0] != 0);
+
+    // +profile=n, sample the PC about every n cycles
+    plusarg = Verilated::commandArgsPlusMatch("profile=");
+    if (plusarg[0]) {
+        profile_open(elf, atoi(plusarg + strlen("+profile=")));
     }
 
     Vriscv *top = new Vriscv;
 
-    top->stall  = 1;
-    top->resetb = 0;
-    top->clk    = 0;
+    #ifdef SAVABLE
+    if (!restore_file.empty()) {
+        restore(restore_file.c_str(), top, &cycles);
+    } else
+    #endif
+    {
+        // the testbench turns the dump on and off by the triggers
+        if (Verilated::commandArgsPlusMatch("dump")[0]) {
+            wave_open(top);
+        }
+
+        top->stall  = 1;
+        top->resetb = 0;
+        top->clk    = 0;
+        top->eval();
+    }
 
     #ifdef HAVE_CHRONO
     time_begin = std::chrono::steady_clock::now();
     #endif
 
+    // evaluate at the clock edges only, main_time keeps the time of the
+    // edges for $time and the waveform
     while (!Verilated::gotFinish()) {
-        if (main_time > RESOLUTION) {
+        #ifdef SAVABLE
+        if (cycles == save_cycle && !save_file.empty()) {
+            save(save_file.c_str(), top, cycles);
+        }
+        #endif
+        if (cycles >= RESET_CYCLES) {
             top->resetb = 1;
         }
-        if (main_time > 30) {
-            top->stall = 0;
+        main_time = cycles * RESOLUTION + 1;
+        top->clk = 1;
+        top->eval();
+        if (wave_on) {
+            wave_dump(main_time, cycles);
         }
-        if ((main_time % RESOLUTION) == 1) {
-            top->clk = 1;
+
+        if (Verilated::gotFinish()) {
+            break;
         }
-        if ((main_time % RESOLUTION) == (RESOLUTION / 2 + 1)) {
-            top->clk = 0;
+
+        if (cycles >= STALL_CYCLES) {
+            top->stall = 0;
         }
+        main_time = cycles * RESOLUTION + RESOLUTION / 2 + 1;
+        top->clk = 0;
         top->eval();
-        main_time++;
+        if (wave_on) {
+            wave_dump(main_time, cycles);
+        }
+
+        cycles++;
     }
 
+    trace_close();
+    profile_close();
+
     #ifdef HAVE_CHRONO
     {
           std::chrono::steady_clock::time_point time_end;
           float sec;
-          int cycles = main_time / RESOLUTION;
           time_end = std::chrono::steady_clock::now();
           sec = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_begin).count() / 1000.0;
           float speed_mhz = cycles / sec / 1000000.0;
@@ -140,12 +279,8 @@ int main(int argc, char** argv)
     #endif
 
     top->final();
+    wave_close();
     delete top;
 
-    if (elf_loaded) {
-        unlink("imem.bin");
-        unlink("dmem.bin");
-    }
-
     return 0;
 }
@@ -0,0 +1,207 @@
+// Copyright © 2020 Kuoping Hsu
+// trace.cpp: trace log writer of the testbench
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The testbench passes each retired instruction by DPI. The records are
+// filled into the blocks of a ring, and a thread writes the full blocks in
+// the text format of trace.log, or the binary format of tools/trace.h, so
+// the simulation does not wait for the formatting and the file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../tools/trace.h"
+
+#define TRACE_BLOCK     8192    // records of a block
+#define TRACE_BLOCKS    16      // blocks of the ring
+
+static const char *regname[32] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "s0(fp)", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+    "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+};
+
+static TRACE_RECORD ring[TRACE_BLOCKS][TRACE_BLOCK];
+static int ring_count[TRACE_BLOCKS];
+static unsigned int head = 0;   // blocks filled by the simulation
+static unsigned int tail = 0;   // blocks written by the thread
+static int fill = 0;            // records in the block of head
+static bool done = false;
+static std::mutex lock;
+static std::condition_variable cv;
+static std::thread *writer = NULL;
+static FILE *fp = NULL;
+static int binary = 0;
+
+static void write_text(const TRACE_RECORD *r)
+{
+    fprintf(fp, "%10u %08x %08x", r->cycle, r->pc, r->inst);
+
+    if (r->flags & TRACE_LOAD) {
+        fprintf(fp, " read 0x%08x", r->address);
+        if (r->flags & TRACE_REG)
+            fprintf(fp, ", x%02u (%s) <= 0x%08x", r->rd, regname[r->rd], r->data);
+    } else if (r->flags & TRACE_REG) {
+        fprintf(fp, " x%02u (%s) <= 0x%08x", r->rd, regname[r->rd], r->data);
+    } else if (r->flags & TRACE_STORE) {
+        fprintf(fp, " write 0x%08x <= 0x%08x", r->address, r->data);
+    }
+    fputc('\n', fp);
+}
+
+static void write_blocks(void)
+{
+    std::unique_lock<std::mutex> lk(lock);
+
+    while(1) {
+        int n;
+
+        cv.wait(lk, [] { return tail != head || done; });
+        if (tail == head)
+            break;
+
+        lk.unlock();
+        n = ring_count[tail % TRACE_BLOCKS];
+        if (binary) {
+            fwrite(ring[tail % TRACE_BLOCKS], sizeof(TRACE_RECORD), n, fp);
+        } else {
+            for(int i = 0; i < n; i++)
+                write_text(&ring[tail % TRACE_BLOCKS][i]);
+        }
+        lk.lock();
+
+        tail++;
+        cv.notify_all();
+    }
+}
+
+// pass the block of head to the thread, wait if the ring is full
+static void trace_submit(void)
+{
+    std::unique_lock<std::mutex> lk(lock);
+
+    ring_count[head % TRACE_BLOCKS] = fill;
+    head++;
+    fill = 0;
+    cv.notify_all();
+    cv.wait(lk, [] { return head - tail < TRACE_BLOCKS; });
+}
+
+extern "C"
+void trace_open(const char *file, int bin)
+{
+    if ((fp = fopen(file, bin ? "wb" : "w")) == NULL) {
+        printf("can not open file %s\n", file);
+        exit(1);
+    }
+
+    binary = bin;
+    if (binary) {
+        TRACE_HEADER header;
+
+        memcpy(header.magic, TRACE_MAGIC, 4);
+        header.version = TRACE_VERSION;
+        fwrite(&header, sizeof(header), 1, fp);
+    }
+
+    writer = new std::thread(write_blocks);
+}
+
+// The store data is masked by the size of op and the byte enables, as the
+// text of the testbench
+extern "C"
+void trace_retire(int cycle, int pc, int insn, int flags, int rd, int rd_data,
+                  int address, int wdata, int wstrb, int op)
+{
+    TRACE_RECORD *r;
+    uint32_t data = rd_data;
+
+    if (!fp)
+        return;
+
+    if (flags & TRACE_STORE) {
+        switch(op) {
+            case 0: // byte
+                switch(wstrb) {
+                    case 0x1: data = ((uint32_t)wdata >>  0) & 0xff; break;
+                    case 0x2: data = ((uint32_t)wdata >>  8) & 0xff; break;
+                    case 0x4: data = ((uint32_t)wdata >> 16) & 0xff; break;
+                    case 0x8: data = ((uint32_t)wdata >> 24) & 0xff; break;
+                    default : flags &= ~TRACE_STORE; break;
+                }
+                break;
+            case 1: // half word
+                switch(wstrb) {
+                    case 0x3: data = ((uint32_t)wdata >>  0) & 0xffff; break;
+                    case 0xc: data = ((uint32_t)wdata >> 16) & 0xffff; break;
+                    default : flags &= ~TRACE_STORE; break;
+                }
+                break;
+            case 2: // word
+                data = wdata;
+                break;
+            default:
+                flags &= ~TRACE_STORE;
+                break;
+        }
+    }
+
+    r = &ring[head % TRACE_BLOCKS][fill];
+    r->cycle    = cycle;
+    r->pc       = pc;
+    r->inst     = insn;
+    r->flags    = flags;
+    r->rd       = (flags & TRACE_REG) ? rd : 0;
+    r->reserved = 0;
+    r->address  = (flags & (TRACE_LOAD | TRACE_STORE)) ? address : 0;
+    r->data     = (flags & (TRACE_REG | TRACE_STORE)) ? data : 0;
+
+    if (++fill == TRACE_BLOCK)
+        trace_submit();
+}
+
+// write the rest of the trace, and close the file
+void trace_close(void)
+{
+    if (!fp)
+        return;
+
+    if (fill)
+        trace_submit();
+
+    {
+        std::unique_lock<std::mutex> lk(lock);
+        done = true;
+        cv.notify_all();
+    }
+
+    writer->join();
+    delete writer;
+    writer = NULL;
+
+    fclose(fp);
+    fp = NULL;
+}
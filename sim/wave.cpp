@@ -0,0 +1,129 @@
+// Copyright © 2020 Kuoping Hsu
+// wave.cpp: waveform dump of the Verilator simulation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The testbench decides when the dump is on by the triggers, and tells it by
+// wave_trigger(). The simulation dumps at the clock edges only while wave_on
+// is set, so the cycles out of the window cost nothing.
+//
+// With +dump-window=n, the cycles before the first trigger are dumped into
+// two segment files of n cycles in turn. At the trigger, the older segment
+// becomes wave.pre0.fst and the newer one wave.pre1.fst, so at least the last
+// n cycles before the trigger are kept, and the dump goes on in wave.fst.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Vriscv.h"
+#include "verilated.h"
+#include "verilated_fst_c.h"
+
+#define WAVE_FILE   "wave.fst"
+
+int wave_on = 0;                    // dump at the clock edges
+
+static VerilatedFstC *tfp = NULL;
+static vluint64_t window = 0;       // cycles of a segment, 0 if no window
+static vluint64_t segment_begin = 0;
+static int segment = -1;            // the segment file, -1 if none
+static int triggered = 0;
+
+static const char *segment_name[2] = {"wave.seg0.fst", "wave.seg1.fst"};
+
+// +dump-depth=n, +dump-scope=hier and +dump-window=n
+void wave_open(Vriscv *top)
+{
+    const char *plusarg;
+    int depth = 99;
+
+    plusarg = Verilated::commandArgsPlusMatch("dump-depth=");
+    if (plusarg[0] && atoi(plusarg + strlen("+dump-depth=")) > 0) {
+        depth = atoi(plusarg + strlen("+dump-depth="));
+    }
+
+    plusarg = Verilated::commandArgsPlusMatch("dump-window=");
+    if (plusarg[0]) {
+        window = strtoull(plusarg + strlen("+dump-window="), NULL, 0);
+    }
+
+    tfp = new VerilatedFstC;
+    top->trace(tfp, depth);
+
+    plusarg = Verilated::commandArgsPlusMatch("dump-scope=");
+    if (plusarg[0]) {
+        #if defined(VERILATOR_VERSION_INTEGER) && VERILATOR_VERSION_INTEGER >= 5000000
+        tfp->dumpvars(depth, plusarg + strlen("+dump-scope="));
+        #else
+        printf("+dump-scope needs Verilator 5\n");
+        #endif
+    }
+
+    // on from the start, until the testbench turns it off
+    wave_on = 1;
+    if (window) {
+        segment = 0;
+        tfp->open(segment_name[segment]);
+    } else {
+        tfp->open(WAVE_FILE);
+    }
+}
+
+void wave_dump(vluint64_t time, vluint64_t cycles)
+{
+    // the next segment of the window before the trigger
+    if (segment >= 0 && cycles - segment_begin >= window) {
+        tfp->close();
+        segment ^= 1;
+        segment_begin = cycles;
+        tfp->open(segment_name[segment]);
+    }
+    tfp->dump(time);
+}
+
+// called by the testbench when the dump is on or off
+extern "C"
+void wave_trigger(int on)
+{
+    if (!tfp)
+        return;
+
+    if (on && !triggered) {
+        triggered = 1;
+        if (segment >= 0) {
+            tfp->close();
+            rename(segment_name[segment ^ 1], "wave.pre0.fst");
+            rename(segment_name[segment], "wave.pre1.fst");
+            segment = -1;
+            tfp->open(WAVE_FILE);
+        }
+    }
+
+    wave_on = on || segment >= 0;
+}
+
+void wave_close(void)
+{
+    if (!tfp)
+        return;
+
+    tfp->close();
+    delete tfp;
+    tfp = NULL;
+}
@@ -8,6 +8,17 @@
 #define MSIP_SWIRQ      0
 #define MSIP_EXIRQ      16
 
+// mhpmevent selector, mhpmcounter3 ... mhpmcounter6 are implemented
+#define HPM_NONE            0
+#define HPM_CYCLE           1   // cycles
+#define HPM_INSTRET         2   // instructions retired
+#define HPM_BRANCH_TAKEN    3   // taken conditional branches
+#define HPM_LOAD            4   // loads
+#define HPM_STORE           5   // stores
+#define HPM_MULDIV          6   // multiply and divide instructions
+#define HPM_STALL           7   // cycles without retiring an instruction
+#define HPM_TRAP            8   // exceptions and interrupts, mret excluded
+
 #define _CSRR_MEPC()        ({ int result; __asm volatile("csrr %0, mepc" : "=r"(result)); result; })
 #define _CSRW_MEPC(v)       __asm volatile("csrw mepc, %0" : : "r"(v))
 #define _CSRR_MCAUSE()      ({ int result; __asm volatile("csrr %0, mcause" : "=r"(result)); result; })
@@ -44,6 +55,33 @@
 #define _CSRR_MISA()        ({ int result; __asm volatile("csrr %0, misa" : "=r"(result)); result; })
 #define _CSRW_MISA(v)       __asm volatile("csrw misa, %0" : : "r"(v))
 
+#define _CSRR_MCOUNTINHIBIT() ({ int result; __asm volatile("csrr %0, mcountinhibit" : "=r"(result)); result; })
+#define _CSRW_MCOUNTINHIBIT(v) __asm volatile("csrw mcountinhibit, %0" : : "r"(v))
+#define _CSRR_MHPMEVENT3()  ({ int result; __asm volatile("csrr %0, mhpmevent3" : "=r"(result)); result; })
+#define _CSRW_MHPMEVENT3(v) __asm volatile("csrw mhpmevent3, %0" : : "r"(v))
+#define _CSRR_MHPMEVENT4()  ({ int result; __asm volatile("csrr %0, mhpmevent4" : "=r"(result)); result; })
+#define _CSRW_MHPMEVENT4(v) __asm volatile("csrw mhpmevent4, %0" : : "r"(v))
+#define _CSRR_MHPMEVENT5()  ({ int result; __asm volatile("csrr %0, mhpmevent5" : "=r"(result)); result; })
+#define _CSRW_MHPMEVENT5(v) __asm volatile("csrw mhpmevent5, %0" : : "r"(v))
+#define _CSRR_MHPMEVENT6()  ({ int result; __asm volatile("csrr %0, mhpmevent6" : "=r"(result)); result; })
+#define _CSRW_MHPMEVENT6(v) __asm volatile("csrw mhpmevent6, %0" : : "r"(v))
+#define _CSRR_MHPMCOUNTER3() ({ int result; __asm volatile("csrr %0, mhpmcounter3" : "=r"(result)); result; })
+#define _CSRW_MHPMCOUNTER3(v) __asm volatile("csrw mhpmcounter3, %0" : : "r"(v))
+#define _CSRR_MHPMCOUNTER3H() ({ int result; __asm volatile("csrr %0, mhpmcounter3h" : "=r"(result)); result; })
+#define _CSRW_MHPMCOUNTER3H(v) __asm volatile("csrw mhpmcounter3h, %0" : : "r"(v))
+#define _CSRR_MHPMCOUNTER4() ({ int result; __asm volatile("csrr %0, mhpmcounter4" : "=r"(result)); result; })
+#define _CSRW_MHPMCOUNTER4(v) __asm volatile("csrw mhpmcounter4, %0" : : "r"(v))
+#define _CSRR_MHPMCOUNTER4H() ({ int result; __asm volatile("csrr %0, mhpmcounter4h" : "=r"(result)); result; })
+#define _CSRW_MHPMCOUNTER4H(v) __asm volatile("csrw mhpmcounter4h, %0" : : "r"(v))
+#define _CSRR_MHPMCOUNTER5() ({ int result; __asm volatile("csrr %0, mhpmcounter5" : "=r"(result)); result; })
+#define _CSRW_MHPMCOUNTER5(v) __asm volatile("csrw mhpmcounter5, %0" : : "r"(v))
+#define _CSRR_MHPMCOUNTER5H() ({ int result; __asm volatile("csrr %0, mhpmcounter5h" : "=r"(result)); result; })
+#define _CSRW_MHPMCOUNTER5H(v) __asm volatile("csrw mhpmcounter5h, %0" : : "r"(v))
+#define _CSRR_MHPMCOUNTER6() ({ int result; __asm volatile("csrr %0, mhpmcounter6" : "=r"(result)); result; })
+#define _CSRW_MHPMCOUNTER6(v) __asm volatile("csrw mhpmcounter6, %0" : : "r"(v))
+#define _CSRR_MHPMCOUNTER6H() ({ int result; __asm volatile("csrr %0, mhpmcounter6h" : "=r"(result)); result; })
+#define _CSRW_MHPMCOUNTER6H(v) __asm volatile("csrw mhpmcounter6h, %0" : : "r"(v))
+
 // no support CSR
 #define _CSRR_DPC()         ({ int result; __asm volatile("csrr %0, dpc" : "=r"(result)); result; })
 #define _CSRW_DPC(v)        __asm volatile("csrw dpc, %0" : : "r"(v))
@@ -83,6 +121,41 @@ static inline void CSRW_MSCRATCH(int v)   { _CSRW_MSCRATCH(v); }
 static inline int  CSRR_MISA(void)        { return _CSRR_MISA(); }
 static inline void CSRW_MISA(int v)       { _CSRW_MISA(v); }
 
+static inline int  CSRR_MCOUNTINHIBIT(void) { return _CSRR_MCOUNTINHIBIT(); }
+static inline void CSRW_MCOUNTINHIBIT(int v) { _CSRW_MCOUNTINHIBIT(v); }
+static inline int  CSRR_MHPMEVENT3(void)  { return _CSRR_MHPMEVENT3(); }
+static inline void CSRW_MHPMEVENT3(int v) { _CSRW_MHPMEVENT3(v); }
+static inline int  CSRR_MHPMEVENT4(void)  { return _CSRR_MHPMEVENT4(); }
+static inline void CSRW_MHPMEVENT4(int v) { _CSRW_MHPMEVENT4(v); }
+static inline int  CSRR_MHPMEVENT5(void)  { return _CSRR_MHPMEVENT5(); }
+static inline void CSRW_MHPMEVENT5(int v) { _CSRW_MHPMEVENT5(v); }
+static inline int  CSRR_MHPMEVENT6(void)  { return _CSRR_MHPMEVENT6(); }
+static inline void CSRW_MHPMEVENT6(int v) { _CSRW_MHPMEVENT6(v); }
+static inline int  CSRR_MHPMCOUNTER3(void) { return _CSRR_MHPMCOUNTER3(); }
+static inline void CSRW_MHPMCOUNTER3(int v) { _CSRW_MHPMCOUNTER3(v); }
+static inline int  CSRR_MHPMCOUNTER3H(void) { return _CSRR_MHPMCOUNTER3H(); }
+static inline void CSRW_MHPMCOUNTER3H(int v) { _CSRW_MHPMCOUNTER3H(v); }
+static inline int  CSRR_MHPMCOUNTER4(void) { return _CSRR_MHPMCOUNTER4(); }
+static inline void CSRW_MHPMCOUNTER4(int v) { _CSRW_MHPMCOUNTER4(v); }
+static inline int  CSRR_MHPMCOUNTER4H(void) { return _CSRR_MHPMCOUNTER4H(); }
+static inline void CSRW_MHPMCOUNTER4H(int v) { _CSRW_MHPMCOUNTER4H(v); }
+static inline int  CSRR_MHPMCOUNTER5(void) { return _CSRR_MHPMCOUNTER5(); }
+static inline void CSRW_MHPMCOUNTER5(int v) { _CSRW_MHPMCOUNTER5(v); }
+static inline int  CSRR_MHPMCOUNTER5H(void) { return _CSRR_MHPMCOUNTER5H(); }
+static inline void CSRW_MHPMCOUNTER5H(int v) { _CSRW_MHPMCOUNTER5H(v); }
+static inline int  CSRR_MHPMCOUNTER6(void) { return _CSRR_MHPMCOUNTER6(); }
+static inline void CSRW_MHPMCOUNTER6(int v) { _CSRW_MHPMCOUNTER6(v); }
+static inline int  CSRR_MHPMCOUNTER6H(void) { return _CSRR_MHPMCOUNTER6H(); }
+static inline void CSRW_MHPMCOUNTER6H(int v) { _CSRW_MHPMCOUNTER6H(v); }
+
+// read the 64-bit performance counter n (3 ... 6)
+#define HPM_COUNTER(n) ({ unsigned int __hi, __lo; \
+    do { \
+        __hi = _CSRR_MHPMCOUNTER##n##H(); \
+        __lo = _CSRR_MHPMCOUNTER##n(); \
+    } while (__hi != (unsigned int)_CSRR_MHPMCOUNTER##n##H()); \
+    (((unsigned long long)__hi) << 32) | __lo; })
+
 // no support CSR
 static inline int  CSRR_DPC(void)         { return _CSRR_DPC(); }
 static inline void CSRW_DPC(int v)        { _CSRW_DPC(v); }
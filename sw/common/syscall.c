@@ -1,6 +1,8 @@
 #include <machine/syscall.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/times.h>
 #include <sys/unistd.h>
 #include <errno.h>
 
@@ -9,6 +11,7 @@
 
 #define MEMIO_PUTC          0xA000001C
 #define MEMIO_GETC          0xA0000020
+#define MEMIO_PUTS          0xA0000024
 #define MEMIO_EXIT          0xA000002C
 #define MEMIO_TOHOST        0xA0000030
 #define MEMIO_FROMHOST      0xA0000034
@@ -20,11 +23,15 @@ enum {
     SYS_CLOSE    = 0x0039,
     SYS_READ     = 0x003f,
     SYS_WRITE    = 0x0040,
+    SYS_WRITEV   = 0x0042,
     SYS_FSTAT    = 0x0050,
     SYS_EXIT     = 0x005d,
+    SYS_GETTIMEOFDAY = 0x00a9,
     SYS_SBRK     = 0x00d6,
     SYS_DUMP     = 0x0088,
     SYS_DUMP_BIN = 0x0099,
+    SYS_TIMES    = 0x0100,
+    SYS_BATCH    = 0x0101,
 };
 
 extern int errno;
@@ -97,18 +104,97 @@ _write(int file, const void *ptr, size_t len)
     int res = __internal_syscall(SYS_WRITE, (long)file, (long)ptr, (long)len, 0, 0, 0, 0);
     return res;
 #else
-    const char *buf = (char*)ptr;
+    // four bytes a store, the lowest byte first
+    const unsigned char *buf = (const unsigned char*)ptr;
     int i;
-    for(i=0; i<len; i++)
+    for(i=0; i+4<=len; i+=4)
+        *(volatile int*)MEMIO_PUTS = buf[i] | (buf[i+1] << 8) |
+                                     (buf[i+2] << 16) | (buf[i+3] << 24);
+    for(; i<len; i++)
         _putchar(buf[i]);
     return len;
 #endif
 }
 
+/* Write the n {base, len} pairs of iov with one system call */
+ssize_t
+_writev(int file, const int32_t *iov, int n)
+{
+#if HAVE_SYSCALL || HAVE_TOHOST
+    int res = __internal_syscall(SYS_WRITEV, (long)file, (long)iov, (long)n, 0, 0, 0, 0);
+    return res;
+#else
+    int i, res = 0;
+    for(i=0; i<n; i++)
+        res += _write(file, (const void*)iov[i*2], iov[i*2+1]);
+    return res;
+#endif
+}
+
+/* Issue n system calls with one trap. Each call is eight words,
+   {number, a0, a1, a2, a3, a4, a5, result}. Return the calls done. */
+int
+_syscall_batch(int32_t *calls, int n)
+{
+#if HAVE_SYSCALL || HAVE_TOHOST
+    int res = __internal_syscall(SYS_BATCH, (long)calls, (long)n, 0, 0, 0, 0, 0);
+    return res;
+#else
+    return 0;
+#endif
+}
+
 int _fstat(int file, struct stat *st)
 {
+#if HAVE_SYSCALL || HAVE_TOHOST
+    int32_t buf[2];
+
+    // newlib buffers the console fully when fstat fails, keep it that way
+    if (file == STDIN_FILENO || file == STDOUT_FILENO || file == STDERR_FILENO)
+        return -1;
+
+    if (__internal_syscall(SYS_FSTAT, (long)file, (long)buf, 0, 0, 0, 0, 0) < 0)
+        return -1;
+
+    __builtin_memset(st, 0, sizeof(*st));
+    st->st_mode = buf[0];
+    st->st_size = buf[1];
+    return 0;
+#else
     //errno = ENOENT;
     return -1;
+#endif
+}
+
+/* The time is the simulated time of the cycle counter */
+int _gettimeofday(struct timeval *tv, void *tz)
+{
+#if HAVE_SYSCALL || HAVE_TOHOST
+    int32_t buf[2];
+
+    __internal_syscall(SYS_GETTIMEOFDAY, (long)buf, 0, 0, 0, 0, 0, 0);
+    tv->tv_sec  = buf[0];
+    tv->tv_usec = buf[1];
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+clock_t _times(struct tms *buf)
+{
+#if HAVE_SYSCALL || HAVE_TOHOST
+    int32_t t[4];
+    int res = __internal_syscall(SYS_TIMES, (long)t, 0, 0, 0, 0, 0, 0);
+
+    buf->tms_utime  = t[0];
+    buf->tms_stime  = t[1];
+    buf->tms_cutime = t[2];
+    buf->tms_cstime = t[3];
+    return res;
+#else
+    return -1;
+#endif
 }
 
 int _close(int file)
@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "rvconfig.h"
+
+#define PERIOD  1000
+#define TICKS   10
+
+volatile int ticks = 0;
+
+void user_trap_handler(void) {
+    int mcause = CSRR_MCAUSE();
+
+    // machine timer interrupt, the next one PERIOD later
+    if (mcause == (0x80000000 | 7)) {
+        *(volatile int*)(MTIMECMP_BASE) = *(volatile int*)(MTIMECMP_BASE)+PERIOD;
+        ticks++;
+    } else {
+        CSRW_MEPC(CSRR_MEPC()+4);
+    }
+}
+
+int main(void) {
+    *(volatile int*)(MTIMECMP_BASE)   = 32768+PERIOD;
+    *(volatile int*)(MTIMECMP_BASE+4) = 0;
+    *(volatile int*)(MTIME_BASE)      = 32768;
+    *(volatile int*)(MTIME_BASE+4)    = 0;
+
+    CSRW_MIE(1<<7);
+    CSRW_MSTATUS(CSRR_MSTATUS() | 1<<3);
+
+    // sleep until each timer interrupt
+    while(ticks != TICKS)
+        __asm volatile("wfi");
+
+    // WFI is a NOP with the timer interrupt disabled
+    CSRW_MIE(0);
+    __asm volatile("wfi");
+
+    printf("%d timer interrupts in WFI\n", ticks);
+
+    return 0;
+}
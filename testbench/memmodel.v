@@ -26,6 +26,16 @@
 
 /* verilator coverage_off */
 /* verilator lint_off DECLFILENAME */
+
+`ifdef VERILATOR
+// The memory is the sparse pages of sim/memory.cpp, sized by +memsize at run
+// time and loaded with the ELF. FILE selects the offset of the memory.
+import "DPI-C" function int mem_dpi_base(input string name);
+import "DPI-C" function int mem_dpi_span(input string name);
+import "DPI-C" function int mem_read(input int address);
+import "DPI-C" function void mem_write(input int address, input int data, input int strb);
+`endif // VERILATOR
+
 `ifdef HAVE_MEM2PORTS
 module mem2ports # (
     parameter SIZE  = 4096,
@@ -46,7 +56,12 @@ module mem2ports # (
 
     localparam ADDRW = $clog2(SIZE/4);
 
+`ifdef VERILATOR
+    reg         [31: 0] base;
+    reg         [31: 0] span;
+`else
     reg         [31: 0] ram [(SIZE/4)-1: 0];
+`endif // VERILATOR
     reg         [31: 0] data;
     wire   [ADDRW-1: 0] radr;
     wire   [ADDRW-1: 0] wadr;
@@ -57,6 +72,64 @@ module mem2ports # (
 assign radr[ADDRW-1: 0] = raddr[ADDRW+1: 2];
 assign wadr[ADDRW-1: 0] = waddr[ADDRW+1: 2];
 
+`ifdef VERILATOR
+function [7:0] getb;
+    input [31:0] address;
+    reg   [31:0] word;
+begin
+    word = mem_read(base + {address[31:2], 2'b00});
+    getb = word[8*address[1:0]+:8];
+end
+endfunction
+
+function [31:0] getw;
+    input [31:0] address;
+begin
+    if (address[1:0] != 0) begin
+        $display("Address %08x is not aligned", address);
+    end
+
+    getw = mem_read(base + {address[31:2], 2'b00});
+end
+endfunction
+
+function [7:0] setb;
+    input [31:0] address;
+    input [7:0] din;
+begin
+    mem_write(base + {address[31:2], 2'b00}, {4{din}},
+              {28'h0, 4'b0001 << address[1:0]});
+    setb = din;
+end
+endfunction
+
+// the word at the offset of the memory, and zero for the loads outside of
+// it, such as the MMIO loads answered by the testbench
+function [31:0] getr;
+    input [31:0] address;
+begin
+    getr = (address < span) ? mem_read(base + address) : 32'h0;
+end
+endfunction
+
+// the write data over the read data at the same address
+function [31:0] merge;
+    input [31:0] rd;
+    input [31:0] wd;
+    input [ 3:0] strb;
+begin
+    merge[8*0+7:8*0] = strb[0] ? wd[8*0+7:8*0] : rd[8*0+7:8*0];
+    merge[8*1+7:8*1] = strb[1] ? wd[8*1+7:8*1] : rd[8*1+7:8*1];
+    merge[8*2+7:8*2] = strb[2] ? wd[8*2+7:8*2] : rd[8*2+7:8*2];
+    merge[8*3+7:8*3] = strb[3] ? wd[8*3+7:8*3] : rd[8*3+7:8*3];
+end
+endfunction
+
+initial begin
+    base = mem_dpi_base(FILE);
+    span = mem_dpi_span(FILE);
+end
+`else
 function [7:0] getb;
     input [31:0] address;
 begin
@@ -128,6 +201,7 @@ initial begin
     end
 end
 `endif
+`endif // VERILATOR
 
 always @(posedge clk or negedge resetb) begin
     if (!resetb)
@@ -136,6 +210,21 @@ always @(posedge clk or negedge resetb) begin
         rresp <= rready;
 end
 
+`ifdef VERILATOR
+always @(posedge clk) begin
+    if (rready) begin
+        if (wready && raddr == waddr) begin
+            rdata <= merge(getr({raddr, 2'b00}), wdata, wstrb);
+        end else begin
+            rdata <= getr({raddr, 2'b00});
+        end
+    end
+
+    if (wready) begin
+        mem_write(base + {waddr, 2'b00}, wdata, {28'h0, wstrb});
+    end
+end
+`else
 always @(posedge clk) begin
     if (rready) begin
         if (wready && radr == wadr) begin
@@ -155,6 +244,7 @@ always @(posedge clk) begin
         if (wstrb[3]) ram[wadr][8*3+7:8*3] <= wdata[8*3+7:8*3];
     end
 end
+`endif // VERILATOR
 
 endmodule
 
@@ -178,7 +268,12 @@ module mem2r1w # (
 
     localparam ADDRW = $clog2(SIZE/4);
 
+`ifdef VERILATOR
+    reg         [31: 0] base;
+    reg         [31: 0] span;
+`else
     reg         [31: 0] ram [(SIZE/4)-1: 0];
+`endif // VERILATOR
     reg         [31: 0] data;
     reg         [31: 0] rdata1;
     reg         [31: 0] rdata2;
@@ -194,6 +289,53 @@ assign radr1[ADDRW-1: 0] = raddr[ADDRW+1: 2];
 assign radr2[ADDRW-1: 0] = raddr[ADDRW+1: 2]+1;
 assign wadr[ADDRW-1: 0]  = waddr[ADDRW+1: 2];
 
+`ifdef VERILATOR
+function [7:0] getb;
+    input [31:0] address;
+    reg   [31:0] word;
+begin
+    word = mem_read(base + {address[31:2], 2'b00});
+    getb = word[8*address[1:0]+:8];
+end
+endfunction
+
+function [7:0] setb;
+    input [31:0] address;
+    input [7:0] din;
+begin
+    mem_write(base + {address[31:2], 2'b00}, {4{din}},
+              {28'h0, 4'b0001 << address[1:0]});
+    setb = din;
+end
+endfunction
+
+// the word at the offset of the memory, and zero for the loads outside of
+// it, such as the MMIO loads answered by the testbench
+function [31:0] getr;
+    input [31:0] address;
+begin
+    getr = (address < span) ? mem_read(base + address) : 32'h0;
+end
+endfunction
+
+// the write data over the read data at the same address
+function [31:0] merge;
+    input [31:0] rd;
+    input [31:0] wd;
+    input [ 3:0] strb;
+begin
+    merge[8*0+7:8*0] = strb[0] ? wd[8*0+7:8*0] : rd[8*0+7:8*0];
+    merge[8*1+7:8*1] = strb[1] ? wd[8*1+7:8*1] : rd[8*1+7:8*1];
+    merge[8*2+7:8*2] = strb[2] ? wd[8*2+7:8*2] : rd[8*2+7:8*2];
+    merge[8*3+7:8*3] = strb[3] ? wd[8*3+7:8*3] : rd[8*3+7:8*3];
+end
+endfunction
+
+initial begin
+    base = mem_dpi_base(FILE);
+    span = mem_dpi_span(FILE);
+end
+`else
 function [7:0] getb;
     input [31:0] address;
 begin
@@ -253,6 +395,7 @@ end
 `endif
 
 assign rdata[31: 0] = aligned ? rdata1[31: 0] : {rdata2[15: 0], rdata1[31:16]};
+`endif // VERILATOR
 
 always @(posedge clk or negedge resetb) begin
     if (!resetb)
@@ -268,6 +411,26 @@ always @(posedge clk or negedge resetb) begin
         aligned <= !raddr[1];
 end
 
+`ifdef VERILATOR
+always @(posedge clk) begin
+    if (rready) begin
+        if (wready && raddr[31:2] == waddr) begin
+            rdata1 <= merge(getr({raddr[31:2], 2'b00}), wdata, wstrb);
+        end else begin
+            rdata1 <= getr({raddr[31:2], 2'b00});
+        end
+        if (wready && raddr[31:2]+30'd1 == waddr) begin
+            rdata2 <= merge(getr({raddr[31:2]+30'd1, 2'b00}), wdata, wstrb);
+        end else begin
+            rdata2 <= getr({raddr[31:2]+30'd1, 2'b00});
+        end
+    end
+
+    if (wready) begin
+        mem_write(base + {waddr, 2'b00}, wdata, {28'h0, wstrb});
+    end
+end
+`else
 always @(posedge clk) begin
     if (rready) begin
         if (wready && radr1 == wadr) begin
@@ -295,6 +458,7 @@ always @(posedge clk) begin
         if (wstrb[3]) ram[wadr][8*3+7:8*3] <= wdata[8*3+7:8*3];
     end
 end
+`endif // VERILATOR
 
 endmodule
 `endif // RV32C_ENABLED
@@ -319,7 +483,12 @@ module mem1port # (
 
     localparam ADDRW = $clog2(SIZE/4);
 
+`ifdef VERILATOR
+    reg         [31: 0] base;
+    reg         [31: 0] span;
+`else
     reg         [31: 0] ram [(SIZE/4)-1: 0];
+`endif // VERILATOR
     reg         [31: 0] data;
     wire   [ADDRW-1: 0] adr;
     integer             i;
@@ -328,6 +497,53 @@ module mem1port # (
 
 assign adr[ADDRW-1: 0] = addr[ADDRW+1: 2];
 
+`ifdef VERILATOR
+function [7:0] getb;
+    input [31:0] address;
+    reg   [31:0] word;
+begin
+    word = mem_read(base + {address[31:2], 2'b00});
+    getb = word[8*address[1:0]+:8];
+end
+endfunction
+
+function [7:0] setb;
+    input [31:0] address;
+    input [7:0] din;
+begin
+    mem_write(base + {address[31:2], 2'b00}, {4{din}},
+              {28'h0, 4'b0001 << address[1:0]});
+    setb = din;
+end
+endfunction
+
+// the word at the offset of the memory, and zero for the loads outside of
+// it, such as the MMIO loads answered by the testbench
+function [31:0] getr;
+    input [31:0] address;
+begin
+    getr = (address < span) ? mem_read(base + address) : 32'h0;
+end
+endfunction
+
+// the write data over the read data at the same address
+function [31:0] merge;
+    input [31:0] rd;
+    input [31:0] wd;
+    input [ 3:0] strb;
+begin
+    merge[8*0+7:8*0] = strb[0] ? wd[8*0+7:8*0] : rd[8*0+7:8*0];
+    merge[8*1+7:8*1] = strb[1] ? wd[8*1+7:8*1] : rd[8*1+7:8*1];
+    merge[8*2+7:8*2] = strb[2] ? wd[8*2+7:8*2] : rd[8*2+7:8*2];
+    merge[8*3+7:8*3] = strb[3] ? wd[8*3+7:8*3] : rd[8*3+7:8*3];
+end
+endfunction
+
+initial begin
+    base = mem_dpi_base(FILE);
+    span = mem_dpi_span(FILE);
+end
+`else
 function [7:0] getb;
     input [31:0] address;
 begin
@@ -385,6 +601,7 @@ initial begin
     end
 end
 `endif
+`endif // VERILATOR
 
 always @(posedge clk or negedge resetb) begin
     if (!resetb)
@@ -395,6 +612,17 @@ always @(posedge clk or negedge resetb) begin
         rresp <= 1'b0;
 end
 
+`ifdef VERILATOR
+always @(posedge clk) begin
+    if (ready) begin
+        if (we) begin
+            mem_write(base + {addr, 2'b00}, wdata, {28'h0, wstrb});
+        end else begin
+            rdata <= getr({addr, 2'b00});
+        end
+    end
+end
+`else
 always @(posedge clk) begin
     if (ready) begin
         if (we) begin
@@ -407,6 +635,7 @@ always @(posedge clk) begin
         end
     end
 end
+`endif // VERILATOR
 
 endmodule
 `endif // HAVE_MEM1PORT
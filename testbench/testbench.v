@@ -27,6 +27,38 @@
 
 `ifdef VERILATOR
 import "DPI-C" function byte getch();
+import "DPI-C" function int mem_dpi_size();
+import "DPI-C" function void host_putc(input byte c, input longint cycle);
+import "DPI-C" function int host_idle(input longint cycle);
+import "DPI-C" function int host_tohost(input int ptr, input longint cycle);
+import "DPI-C" function int host_syscall(
+    input int func, input int a0, input int a1, input int a2,
+    input int a3, input int a4, input int a5, input longint cycle);
+import "DPI-C" function int host_exit();
+import "DPI-C" function void wave_trigger(input int on);
+import "DPI-C" function int ckpt_valid();
+import "DPI-C" function int ckpt_pc();
+import "DPI-C" function int ckpt_reg(input int n);
+import "DPI-C" function int ckpt_csr(input int addr);
+import "DPI-C" function longint ckpt_mtime();
+import "DPI-C" function longint ckpt_mtimecmp();
+import "DPI-C" function int ckpt_msip();
+import "DPI-C" function int profile_sample(
+    input int pc, input int if_stall, input int ex_stall, input int ex_flush);
+`ifdef TRACE
+import "DPI-C" function void trace_open(input string file, input int binary);
+import "DPI-C" function void trace_retire(
+    input int cycle, input int pc, input int insn, input int flags,
+    input int rd, input int rd_data,
+    input int address, input int wdata, input int wstrb, input int op);
+`endif
+`ifdef LOCKSTEP
+import "DPI-C" function int lockstep_retire(
+    input int pc, input int insn,
+    input int rd_valid, input int rd, input int rd_data,
+    input int st_valid, input int st_addr, input int st_strb, input int st_data);
+import "DPI-C" function void lockstep_syscall(input int res);
+`endif
 `endif
 
 `ifdef SYNTHESIS
@@ -61,6 +93,23 @@ module testbench();
     localparam      DRAMBASE    = 128*1024;
 `endif
 
+    // the memory map, the size is given by +memsize at run time with Verilator
+    reg     [31: 0] iram_size;
+    reg     [31: 0] dram_size;
+    reg     [31: 0] dram_base;
+
+initial begin
+`ifdef VERILATOR
+    iram_size   = mem_dpi_size();
+    dram_size   = mem_dpi_size();
+    dram_base   = mem_dpi_size();
+`else
+    iram_size   = IRAMSIZE;
+    dram_size   = DRAMSIZE;
+    dram_base   = DRAMBASE;
+`endif // VERILATOR
+end
+
 `ifdef RV32M_ENABLED
     localparam RV32M = 1;
 `else
@@ -104,7 +153,9 @@ module testbench();
     reg     [ 1: 0] fillcount;
     integer         i;
     integer         dump;
+    integer         sysres;
     integer         STDIN = 0;
+    reg     [63: 0] wfi_cycles;
 
 task printStatistics;
 begin
@@ -112,33 +163,151 @@ begin
             `TOP.csr_instret, `TOP.csr_cycle,
             `TOP.csr_cycle/`TOP.csr_instret,
             (`TOP.csr_cycle * 1000 /`TOP.csr_instret) % 1000);
+    if (wfi_cycles != 0)
+        $display("Idle %0d cycles in WFI", wfi_cycles);
     $display("Program terminate");
 end
 endtask
 
+`ifndef SYNTHESIS
+////////////////////////////////////////////////////////////
+// Console, flushed at newline, when CON_SIZE bytes are
+// buffered, or after CON_IDLE cycles without output
+////////////////////////////////////////////////////////////
+    localparam      CON_SIZE    = 4096;
+    localparam      CON_IDLE    = 1000000;
+    integer         con_pending;
+    integer         con_idle;
+    reg             con_char;
+
+/* verilator lint_off BLKSEQ */
+task console_putc;
+input [7:0] c;
+begin
+`ifdef VERILATOR
+    // the console of sim/host.cpp
+    host_putc(c, `TOP.csr_cycle);
+    con_pending = 1;
+`else
+    $write("%c", c);
+    con_pending = con_pending + 1;
+    con_idle    = 0;
+    if (con_char || c == 8'h0a || con_pending >= CON_SIZE) begin
+        $fflush;
+        con_pending = 0;
+    end
+`endif // VERILATOR
+end
+endtask
+
+// the bytes of MMIO_PUTS, the lowest byte first
+task console_puts;
+input [31:0] data;
+input [ 3:0] strb;
+begin
+    if (strb[0]) console_putc(data[ 7: 0]);
+    if (strb[1]) console_putc(data[15: 8]);
+    if (strb[2]) console_putc(data[23:16]);
+    if (strb[3]) console_putc(data[31:24]);
+end
+endtask
+
+initial begin
+    con_pending = 0;
+    con_idle    = 0;
+    con_char    = $test$plusargs("flush-char") != 0;
+end
+
+always @(posedge clk) begin
+    if (con_pending != 0) begin
+`ifdef VERILATOR
+        con_pending = host_idle(`TOP.csr_cycle);
+`else
+        con_idle = con_idle + 1;
+        if (con_idle >= CON_IDLE) begin
+            $fflush;
+            con_pending = 0;
+        end
+`endif // VERILATOR
+    end
+end
+
+`ifdef VERILATOR
+// syscall of sim/host.cpp, a0 is the result unless it is -1, and the ISS
+// takes the result in lockstep
+task host_call;
+begin
+    sysres = host_syscall(`TOP.regs[REG_SYS],
+                          `TOP.regs[REG_A0], `TOP.regs[REG_A1],
+                          `TOP.regs[REG_A2], `TOP.regs[REG_A3],
+                          `TOP.regs[REG_A4], `TOP.regs[REG_A5],
+                          `TOP.csr_cycle);
+    if (host_exit() != 0) begin
+        printStatistics();
+        $finish(2);
+    end else if (sysres != -1) begin
+        /* verilator lint_off IGNOREDRETURN */
+        `TOP.set_reg(REG_A0, sysres);
+        /* verilator lint_on IGNOREDRETURN */
+    end
+`ifdef LOCKSTEP
+    lockstep_syscall(sysres);
+`endif // LOCKSTEP
+end
+endtask
+`endif // VERILATOR
+/* verilator lint_on BLKSEQ */
+`endif // SYNTHESIS
+
 `ifndef SYNTHESIS
 initial begin
     if ($test$plusargs("help") != 0) begin
-        $display("Usage: sim [+help] [+no-meminit] [+dump] [+trace] [prog.elf]");
+        $display("Usage: sim [+help] [+no-meminit] [+memsize=n] [+dump] [+trace] [+binary] [+flush-char] [+save=file@cycle] [+restore=file] [+checkpoint=file] [+warmup=n] [+measure=n] [+farm=list] [+jobs=n] [+profile=n] [prog.elf]");
         $display("");
         $display("    +help         usage help");
         $display("    +no-meminit   memory uninitialized");
+        $display("    +memsize=n    memory size in Kb (Verilator)");
         $display("    +dump         dump vcd file");
+        $display("    +dump-on-cycle=n, +dump-off-cycle=n");
+        $display("                  dump from/until the cycle");
+        $display("    +dump-on-pc=h, +dump-off-pc=h");
+        $display("                  dump from/until the retired PC");
+        $display("    +dump-on-instret=n, +dump-off-instret=n");
+        $display("                  dump from/until the instructions retired");
+        $display("    +dump-depth=n dump n levels of the scope");
+        $display("    +dump-core    dump the core only (Icarus Verilog)");
+        $display("    +dump-scope=s dump the scope only (Verilator)");
+        $display("    +dump-window=n  keep n cycles before the trigger (Verilator)");
         $display("    +trace        generate trace log");
+        $display("    +binary       write the trace log in the binary format (Verilator)");
+        $display("    +flush-char   flush the console at each character");
+        $display("    +save=file@cycle  save the checkpoint at the cycle (Verilator)");
+        $display("    +restore=file restore the checkpoint (Verilator)");
+        $display("    +checkpoint=file  start from the checkpoint of rvsim (Verilator)");
+        $display("    +warmup=n     run n instructions before the measure");
+        $display("    +measure=n    report the cycles of n instructions, and finish");
+        $display("    +farm=list    run the programs of the list in the workers (Verilator)");
+        $display("    +jobs=n       workers of the farm (default the host cores)");
+        $display("    +profile=n    sample the PC about every n cycles (Verilator)");
         $display("");
         $finish(0);
     end
 
+`ifndef VERILATOR
+    // sim/host.cpp writes the dump of Verilator
     dump = $fopen("dump.txt", "w");
+`endif // VERILATOR
 
+`ifndef VERILATOR
+    // sim/wave.cpp dumps the waveform of Verilator
     if ($test$plusargs("dump") != 0) begin
-        `ifdef VERILATOR
-        $dumpfile("wave.fst");
-        `else
         $dumpfile("wave.vcd");
-        `endif
-        $dumpvars(0, testbench);
+        if ($test$plusargs("dump-core") != 0)
+            $dumpvars(dump_depth, `TOP);
+        else
+            $dumpvars(dump_depth, testbench);
     end
+`endif // VERILATOR
 
 `ifndef VERILATOR
     clk             = 1'b1;
@@ -155,7 +324,207 @@ end
 always #10 clk      = ~clk;
 `endif // VERILATOR
 
-// check timeout if the PC do not change anymore
+////////////////////////////////////////////////////////////
+// Waveform dump window, turned on and off by the cycle, the
+// retired PC, the instructions retired, or the write of
+// MMIO_DUMP by the program (non-zero on, zero off). Each
+// trigger of the cycle, the PC or the instret fires once.
+////////////////////////////////////////////////////////////
+    reg             dump_en;
+    reg             dump_on;
+    integer         dump_depth;
+    reg     [63: 0] dump_on_cycle;
+    reg     [63: 0] dump_off_cycle;
+    reg     [31: 0] dump_on_pc;
+    reg     [31: 0] dump_off_pc;
+    reg     [63: 0] dump_on_instret;
+    reg     [63: 0] dump_off_instret;
+    reg     [ 5: 0] dump_trig;      // the triggers not fired yet
+    reg     [ 5: 0] dump_fire;
+    reg             dump_retire;
+
+task dump_switch;
+input on;
+begin
+    if (dump_on != on) begin
+        dump_on = on;
+        `ifdef VERILATOR
+        wave_trigger({31'h0, on});
+        `else
+        if (on)
+            $dumpon;
+        else
+            $dumpoff;
+        `endif
+    end
+end
+endtask
+
+initial begin
+    dump_en   = $test$plusargs("dump") != 0;
+    dump_trig = 6'h0;
+    if ($value$plusargs("dump-depth=%d", dump_depth) == 0)
+        dump_depth = 0;
+    if ($value$plusargs("dump-on-cycle=%d", dump_on_cycle) != 0)
+        dump_trig[0] = 1'b1;
+    if ($value$plusargs("dump-on-instret=%d", dump_on_instret) != 0)
+        dump_trig[1] = 1'b1;
+    if ($value$plusargs("dump-on-pc=%h", dump_on_pc) != 0)
+        dump_trig[2] = 1'b1;
+    if ($value$plusargs("dump-off-cycle=%d", dump_off_cycle) != 0)
+        dump_trig[3] = 1'b1;
+    if ($value$plusargs("dump-off-instret=%d", dump_off_instret) != 0)
+        dump_trig[4] = 1'b1;
+    if ($value$plusargs("dump-off-pc=%h", dump_off_pc) != 0)
+        dump_trig[5] = 1'b1;
+
+    // on from the start unless there is a trigger to turn it on
+    dump_on = 1'b1;
+    if (dump_en)
+        #0 dump_switch(dump_trig[2:0] == 3'b000);
+end
+
+/* verilator lint_off BLKSEQ */
+always @(posedge clk) begin
+    if (dump_en && resetb) begin
+        dump_retire = !`TOP.wb_stall && !`TOP.stall_r && !`TOP.wb_flush;
+        dump_fire   = dump_trig & {
+                          dump_retire && `TOP.wb_pc == dump_off_pc,
+                          `TOP.csr_instret >= dump_off_instret,
+                          `TOP.csr_cycle >= dump_off_cycle,
+                          dump_retire && `TOP.wb_pc == dump_on_pc,
+                          `TOP.csr_instret >= dump_on_instret,
+                          `TOP.csr_cycle >= dump_on_cycle};
+        dump_trig   = dump_trig & ~dump_fire;
+        if (`TOP.dmem_wready && `TOP.dmem_waddr == MMIO_DUMP)
+            dump_switch(`TOP.dmem_wdata != 32'h0);
+        else if (!dump_on && dump_fire[2:0] != 3'b000)
+            dump_switch(1'b1);
+        else if (dump_on && dump_fire[5:3] != 3'b000)
+            dump_switch(1'b0);
+    end
+end
+/* verilator lint_on BLKSEQ */
+
+`ifdef VERILATOR
+// load the checkpoint of rvsim into the core while the pipeline is stalled
+// after the reset, the memory is loaded by sim/checkpoint.cpp
+    reg             ckpt_done = 1'b0;
+    integer         ckpt_n;
+
+/* verilator lint_off BLKSEQ */
+/* verilator lint_off IGNOREDRETURN */
+always @(posedge clk) begin
+    if (!ckpt_done && resetb && stall && ckpt_valid() != 0) begin
+        ckpt_done = 1'b1;
+        for (ckpt_n = 1; ckpt_n < 32; ckpt_n = ckpt_n + 1)
+            `TOP.set_reg(ckpt_n[4:0], ckpt_reg(ckpt_n));
+        `TOP.set_csr(CSR_MSTATUS, ckpt_csr({20'h0, CSR_MSTATUS}));
+        `TOP.set_csr(CSR_MSTATUSH, ckpt_csr({20'h0, CSR_MSTATUSH}));
+        `TOP.set_csr(CSR_MIE, ckpt_csr({20'h0, CSR_MIE}));
+        `TOP.set_csr(CSR_MIP, ckpt_csr({20'h0, CSR_MIP}));
+        `TOP.set_csr(CSR_MTVEC, ckpt_csr({20'h0, CSR_MTVEC}));
+        `TOP.set_csr(CSR_MSCRATCH, ckpt_csr({20'h0, CSR_MSCRATCH}));
+        `TOP.set_csr(CSR_MEPC, ckpt_csr({20'h0, CSR_MEPC}));
+        `TOP.set_csr(CSR_MCAUSE, ckpt_csr({20'h0, CSR_MCAUSE}));
+        `TOP.set_csr(CSR_MTVAL, ckpt_csr({20'h0, CSR_MTVAL}));
+        `TOP.set_csr(CSR_RDCYCLE, ckpt_csr({20'h0, CSR_RDCYCLE}));
+        `TOP.set_csr(CSR_RDCYCLEH, ckpt_csr({20'h0, CSR_RDCYCLEH}));
+        `TOP.set_csr(CSR_RDINSTRET, ckpt_csr({20'h0, CSR_RDINSTRET}));
+        `TOP.set_csr(CSR_RDINSTRETH, ckpt_csr({20'h0, CSR_RDINSTRETH}));
+        `TOP.set_csr(CSR_MCOUNTINHIBIT, ckpt_csr({20'h0, CSR_MCOUNTINHIBIT}));
+        for (ckpt_n = 3; ckpt_n < HPM_NUM + 3; ckpt_n = ckpt_n + 1) begin
+            `TOP.set_csr(CSR_MHPMEVENT3 + ckpt_n[11:0] - 12'd3,
+                         ckpt_csr({20'h0, CSR_MHPMEVENT3 + ckpt_n[11:0] - 12'd3}));
+            `TOP.set_csr(CSR_MHPMCOUNTER3 + ckpt_n[11:0] - 12'd3,
+                         ckpt_csr({20'h0, CSR_MHPMCOUNTER3 + ckpt_n[11:0] - 12'd3}));
+            `TOP.set_csr(CSR_MHPMCOUNTER3H + ckpt_n[11:0] - 12'd3,
+                         ckpt_csr({20'h0, CSR_MHPMCOUNTER3H + ckpt_n[11:0] - 12'd3}));
+        end
+        `TOP.set_pc(ckpt_pc());
+        top.clint.set_time(ckpt_mtime(), ckpt_mtimecmp(), ckpt_msip());
+    end
+end
+/* verilator lint_on IGNOREDRETURN */
+/* verilator lint_on BLKSEQ */
+`endif // VERILATOR
+
+`ifdef VERILATOR
+////////////////////////////////////////////////////////////
+// PC sampling profiler, sim/profile.cpp returns the cycles
+// to the next sample.
+////////////////////////////////////////////////////////////
+    reg             profile_en;
+    integer         profile_wait;
+
+initial begin
+    profile_en   = $test$plusargs("profile=") != 0;
+    profile_wait = 0;
+end
+
+/* verilator lint_off BLKSEQ */
+always @(posedge clk) begin
+    if (profile_en && resetb && !stall) begin
+        if (profile_wait <= 1)
+            profile_wait = profile_sample(`TOP.wb_pc, {31'h0, `TOP.if_stall},
+                                          {31'h0, `TOP.ex_stall},
+                                          {31'h0, `TOP.ex_flush});
+        else
+            profile_wait = profile_wait - 1;
+    end
+end
+/* verilator lint_on BLKSEQ */
+`endif // VERILATOR
+
+////////////////////////////////////////////////////////////
+// Sampling window, +warmup=n instructions from the start,
+// then the cycles of +measure=n instructions are reported
+// and the simulation finishes.
+////////////////////////////////////////////////////////////
+    reg             sample_en;
+    reg     [ 1: 0] sample_state;   // 0: start, 1: warm-up, 2: measure
+    reg     [63: 0] sample_warmup;
+    reg     [63: 0] sample_measure;
+    reg     [63: 0] sample_instret;
+    reg     [63: 0] sample_cycle;
+
+initial begin
+    sample_en = $value$plusargs("measure=%d", sample_measure) != 0;
+    if ($value$plusargs("warmup=%d", sample_warmup) == 0)
+        sample_warmup = 64'd0;
+    sample_state = 2'd0;
+end
+
+/* verilator lint_off BLKSEQ */
+always @(posedge clk) begin
+    if (sample_en && resetb && !stall) begin
+        case(sample_state)
+            2'd0: begin
+                // the counters are of the checkpoint, if any
+                sample_instret = `TOP.csr_instret;
+                sample_state   = 2'd1;
+            end
+            2'd1: begin
+                if (`TOP.csr_instret - sample_instret >= sample_warmup) begin
+                    sample_instret = `TOP.csr_instret;
+                    sample_cycle   = `TOP.csr_cycle;
+                    sample_state   = 2'd2;
+                end
+            end
+            default: begin
+                if (`TOP.csr_instret - sample_instret >= sample_measure) begin
+                    $display("\nMeasured %0d instructions, %0d cycles from instruction %0d",
+                             `TOP.csr_instret - sample_instret,
+                             `TOP.csr_cycle - sample_cycle, sample_instret);
+                    $finish(0);
+                end
+            end
+        endcase
+    end
+end
+/* verilator lint_on BLKSEQ */
+
+// check timeout if the PC do not change anymore, except in WFI
 always @(posedge clk or negedge resetb) begin
     if (!resetb) begin
         next_pc     <= 32'h0;
@@ -163,7 +532,7 @@ always @(posedge clk or negedge resetb) begin
     end else begin
         next_pc     <= `TOP.if_pc;
 
-        if (next_pc == `TOP.if_pc)
+        if (next_pc == `TOP.if_pc && !`TOP.wfi_sleep)
             count   <= count + 1;
         else
             count   <= 8'h0;
@@ -175,6 +544,14 @@ always @(posedge clk or negedge resetb) begin
     end
 end
 
+// idle cycles in WFI
+always @(posedge clk or negedge resetb) begin
+    if (!resetb)
+        wfi_cycles  <= 64'h0;
+    else if (`TOP.wfi_sleep)
+        wfi_cycles  <= wfi_cycles + 1;
+end
+
 // stop at exception
 `ifdef STOP_AT_EXCEPTION
 always @(posedge clk) begin
@@ -249,8 +626,10 @@ end
     // check memory range
     always @(posedge clk) begin
         if (mem_ready && mem_we && mem_addr == MMIO_PUTC) begin
-            $write("%c", mem_wdata[7:0]);
-            $fflush;
+            console_putc(mem_wdata[7:0]);
+        end
+        else if (mem_ready && mem_we && mem_addr == MMIO_PUTS) begin
+            console_puts(mem_wdata, mem_wstrb);
         end
         else if (mem_ready && !mem_we && mem_addr == MMIO_GETC) begin
             `ifdef VERILATOR
@@ -266,15 +645,38 @@ end
             $finish(1);
         end
         else if (mem_ready && mem_we && mem_addr == MMIO_TOHOST) begin
+            `ifdef VERILATOR
+            /* verilator lint_off IGNOREDRETURN */
+            host_tohost(mem_wdata, `TOP.csr_cycle);
+            /* verilator lint_on IGNOREDRETURN */
+            if (host_exit() != 0) begin
+                printStatistics();
+                $finish(2);
+            end
+            `else
             // TODO
+            `endif
+        end
+        else if (mem_ready && mem_we && mem_addr == MMIO_DUMP) begin
+            // the waveform dump
         end
         else if (mem_ready &&
-                 mem_addr[31:$clog2(DRAMSIZE+IRAMSIZE)] != 'd0) begin
+                 mem_addr >= iram_size + dram_size) begin
             $display("DMEM address %x out of range", mem_addr);
             $finish(2);
         end
     end
 
+`ifdef VERILATOR
+`ifndef LOCKSTEP
+    // syscall of sim/host.cpp, before the retirement in lockstep
+    always @(posedge clk) begin
+        if (`TOP.wb_system && !`TOP.wb_stall && `TOP.wb_break == 2'b00) begin
+            host_call;
+        end
+    end
+`endif // LOCKSTEP
+`else
     // syscall
     always @(posedge clk) begin
         if (`TOP.wb_system && !`TOP.wb_stall) begin
@@ -284,12 +686,11 @@ end
             end else if (`TOP.wb_break == 2'b00 && `TOP.regs[REG_SYS] == SYS_WRITE &&
                 `TOP.regs[REG_A0] == 32'h1) begin // stdout
                 for (i = 0; i < `TOP.regs[REG_A2]; i = i + 1) begin
-                    $write("%c", mem.getb(`TOP.regs[REG_A1] + i));
+                    console_putc(mem.getb(`TOP.regs[REG_A1] + i));
                 end
                 /* verilator lint_off IGNOREDRETURN */
                 `TOP.set_reg(REG_A0, `TOP.regs[REG_A2]);
                 /* verilator lint_on IGNOREDRETURN */
-                $fflush;
             end else if (`TOP.wb_break == 2'b00 && `TOP.regs[REG_SYS] == SYS_READ &&
                 `TOP.regs[REG_A0] == 32'h0) begin // stdin
                 // TODO
@@ -307,6 +708,7 @@ end
             end
         end
     end
+`endif // VERILATOR
 `endif // SYNTHESIS
 
 `else // IRAM and DRAM seperate
@@ -427,8 +829,8 @@ assign imem_raddr_i[29:0] = imem_addr[31:2]-(IRAMBASE/4);
 wire [29:0] dmem_raddr_i;
 wire [29:0] dmem_waddr_i;
 
-assign dmem_raddr_i = dmem_raddr[31:2]-(DRAMBASE/4);
-assign dmem_waddr_i = dmem_waddr[31:2]-(DRAMBASE/4);
+assign dmem_raddr_i = dmem_raddr[31:2]-dram_base[31:2];
+assign dmem_waddr_i = dmem_waddr[31:2]-dram_base[31:2];
 
     mem2ports # (
         .SIZE(DRAMSIZE),
@@ -449,26 +851,62 @@ assign dmem_waddr_i = dmem_waddr[31:2]-(DRAMBASE/4);
 
 `ifndef SYNTHESIS
     reg [31: 0] result;
+    integer     j;
+    integer     n;
+    reg [31: 0] addr;
+    reg [63: 0] usec;
+
+// write a word to DMEM
+task dmem_setw;
+input [31:0] address;
+input [31:0] data;
+begin
+    /* verilator lint_off IGNOREDRETURN */
+    dmem.setb(address - iram_size + 0, data[ 7: 0]);
+    dmem.setb(address - iram_size + 1, data[15: 8]);
+    dmem.setb(address - iram_size + 2, data[23:16]);
+    dmem.setb(address - iram_size + 3, data[31:24]);
+    /* verilator lint_on IGNOREDRETURN */
+end
+endtask
+
+// the simulated time, as SIM_CLOCK_HZ of tools/opcode.h
+    localparam  SIM_CLOCK_HZ = 100000000;
+    localparam  TIMES_HZ     = 1000;
 
     // check memory range
+    /* verilator lint_off BLKSEQ */
     always @(posedge clk) begin
-        if (imem_ready && imem_addr[31:$clog2(IRAMSIZE)] != 'd0) begin
+        if (imem_ready && imem_addr >= iram_size) begin
             $display("IMEM address %x out of range", imem_addr);
             $finish(2);
         end
 
         if (`TOP.dmem_wready && `TOP.dmem_waddr == MMIO_PUTC) begin
-            $write("%c", dmem_wdata[7:0]);
+            console_putc(dmem_wdata[7:0]);
+            result[31: 0] <= 'h1;
+        end
+        else if (`TOP.dmem_wready && `TOP.dmem_waddr == MMIO_PUTS) begin
+            console_puts(dmem_wdata, dmem_wstrb);
             result[31: 0] <= 'h1;
-            $fflush;
         end
         else if (`TOP.dmem_wready && `TOP.dmem_waddr == MMIO_EXIT) begin
             printStatistics();
             result[31: 0] <= 'h1;
             $finish(1);
         end
+`ifdef VERILATOR
+        // HTIF of sim/host.cpp
+        else if (`TOP.dmem_wready && `TOP.dmem_waddr == MMIO_TOHOST) begin
+            result[31: 0] <= host_tohost(dmem_wdata, `TOP.csr_cycle);
+            if (host_exit() != 0) begin
+                printStatistics();
+                $finish(2);
+            end
+        end
+`else
         else if (`TOP.dmem_wready && `TOP.dmem_waddr == MMIO_TOHOST) begin
-            case (dmem.getw(dmem_wdata-IRAMSIZE))
+            case (dmem.getw(dmem_wdata-iram_size))
                 //SYS_OPEN:  // TODO
                 SYS_LSEEK:
                 begin
@@ -478,14 +916,71 @@ assign dmem_waddr_i = dmem_waddr[31:2]-(DRAMBASE/4);
                 //SYS_READ:  // TODO
                 SYS_WRITE:
                 begin
-                    if (dmem.getw(dmem_wdata-IRAMSIZE+'h4) == 32'h1) begin // STDOUT
-                        for (i = 0; i < dmem.getw(dmem_wdata-IRAMSIZE+'hc); i = i + 1) begin
-                            $write("%c", dmem.getb(dmem.getw(dmem_wdata-IRAMSIZE+'h8) - IRAMSIZE + i));
+                    if (dmem.getw(dmem_wdata-iram_size+'h4) == 32'h1) begin // STDOUT
+                        for (i = 0; i < dmem.getw(dmem_wdata-iram_size+'hc); i = i + 1) begin
+                            console_putc(dmem.getb(dmem.getw(dmem_wdata-iram_size+'h8) - iram_size + i));
+                        end
+                    end
+                    result[31: 0] <= dmem.getw(dmem_wdata-iram_size+'hc);
+                end
+                SYS_WRITEV:
+                begin
+                    n = 0;
+                    if (dmem.getw(dmem_wdata-iram_size+'h4) == 32'h1) begin // STDOUT
+                        for (j = 0; j < dmem.getw(dmem_wdata-iram_size+'hc); j = j + 1) begin
+                            addr = dmem.getw(dmem_wdata-iram_size+'h8) + j * 8;
+                            for (i = 0; i < dmem.getw(addr-iram_size+'h4); i = i + 1) begin
+                                console_putc(dmem.getb(dmem.getw(addr-iram_size) - iram_size + i));
+                            end
+                            n = n + dmem.getw(addr-iram_size+'h4);
+                        end
+                    end
+                    result[31: 0] <= n;
+                end
+                SYS_FSTAT:
+                begin
+                    // the console only
+                    if (dmem.getw(dmem_wdata-iram_size+'h4) <= 32'h2) begin
+                        dmem_setw(dmem.getw(dmem_wdata-iram_size+'h8) + 0, 32'h2000); // S_IFCHR
+                        dmem_setw(dmem.getw(dmem_wdata-iram_size+'h8) + 4, 32'h0);
+                        result[31: 0] <= 'h0;
+                    end else begin
+                        result[31: 0] <= 32'hffff_ffff;
+                    end
+                end
+                SYS_GETTIMEOFDAY:
+                begin
+                    usec = `TOP.csr_cycle / (SIM_CLOCK_HZ / 1000000);
+                    dmem_setw(dmem.getw(dmem_wdata-iram_size+'h4) + 0, usec / 1000000);
+                    dmem_setw(dmem.getw(dmem_wdata-iram_size+'h4) + 4, usec % 1000000);
+                    result[31: 0] <= 'h0;
+                end
+                SYS_TIMES:
+                begin
+                    n = `TOP.csr_cycle / (SIM_CLOCK_HZ / TIMES_HZ);
+                    dmem_setw(dmem.getw(dmem_wdata-iram_size+'h4) + 0, n);
+                    for (j = 4; j < 16; j = j + 4) begin
+                        dmem_setw(dmem.getw(dmem_wdata-iram_size+'h4) + j, 32'h0);
+                    end
+                    result[31: 0] <= n;
+                end
+                SYS_BATCH:
+                begin
+                    // writes to the stdout only, the others fail
+                    for (j = 0; j < dmem.getw(dmem_wdata-iram_size+'h8); j = j + 1) begin
+                        addr = dmem.getw(dmem_wdata-iram_size+'h4) + j * 32;
+                        if (dmem.getw(addr-iram_size) == SYS_WRITE &&
+                            dmem.getw(addr-iram_size+'h4) == 32'h1) begin
+                            for (i = 0; i < dmem.getw(addr-iram_size+'hc); i = i + 1) begin
+                                console_putc(dmem.getb(dmem.getw(addr-iram_size+'h8) - iram_size + i));
+                            end
+                            dmem_setw(addr + 28, dmem.getw(addr-iram_size+'hc));
+                        end else begin
+                            dmem_setw(addr + 28, 32'hffff_ffff);
                         end
                     end
-                    result[31: 0] <= dmem.getw(dmem_wdata-IRAMSIZE+'hc);
+                    result[31: 0] <= dmem.getw(dmem_wdata-iram_size+'h8);
                 end
-                //SYS_FSTAT: // TODO
                 SYS_EXIT:
                 begin
                     printStatistics();
@@ -496,10 +991,10 @@ assign dmem_waddr_i = dmem_waddr[31:2]-(DRAMBASE/4);
                 SYS_DUMP:
                 begin
                     if (dump != 0) begin
-                        for (i = dmem.getw(dmem_wdata-IRAMSIZE+'h4);
-                             i < dmem.getw(dmem_wdata-IRAMSIZE+'h8);
+                        for (i = dmem.getw(dmem_wdata-iram_size+'h4);
+                             i < dmem.getw(dmem_wdata-iram_size+'h8);
                              i = i + 4) begin
-                            $fdisplay(dump, "%08x", dmem.getw(i - IRAMSIZE));
+                            $fdisplay(dump, "%08x", dmem.getw(i - iram_size));
                         end
                     end
                     result[31: 0] <= 'h0;
@@ -507,25 +1002,31 @@ assign dmem_waddr_i = dmem_waddr[31:2]-(DRAMBASE/4);
                 SYS_DUMP_BIN:
                 begin
                     if (dump != 0) begin
-                        for (i = dmem.getw(dmem_wdata-IRAMSIZE+'h4);
-                             i < dmem.getw(dmem_wdata-IRAMSIZE+'h8);
+                        for (i = dmem.getw(dmem_wdata-iram_size+'h4);
+                             i < dmem.getw(dmem_wdata-iram_size+'h8);
                              i = i + 1) begin
-                            $fdisplay(dump, "%c", dmem.getb(i - IRAMSIZE));
+                            $fdisplay(dump, "%c", dmem.getb(i - iram_size));
                         end
                     end
                     result[31: 0] <= 'h0;
                 end
                 default:
-                    $display("Unknown TOHOST command %x", dmem.getw(dmem_wdata-IRAMSIZE));
+                    $display("Unknown TOHOST command %x", dmem.getw(dmem_wdata-iram_size));
             endcase
         end
+`endif // VERILATOR
+        else if (`TOP.dmem_wready && `TOP.dmem_waddr == MMIO_DUMP) begin
+            // the waveform dump
+        end
         else if (dmem_wready &&
-                 dmem_waddr[31:$clog2(DRAMSIZE+IRAMSIZE)] != 'd0) begin
+                 dmem_waddr >= iram_size + dram_size) begin
             $display("DMEM address %x out of range", dmem_waddr);
             $finish(2);
         end
     end
 
+    /* verilator lint_on BLKSEQ */
+
     always @(posedge clk) begin
         if (`TOP.dmem_rready && `TOP.dmem_raddr == MMIO_FROMHOST) begin
             rready <= 1'b1;
@@ -550,6 +1051,16 @@ assign dmem_waddr_i = dmem_waddr[31:2]-(DRAMBASE/4);
         end
     end
 
+`ifdef VERILATOR
+`ifndef LOCKSTEP
+    // syscall of sim/host.cpp, before the retirement in lockstep
+    always @(posedge clk) begin
+        if (`TOP.wb_system && !`TOP.wb_stall && `TOP.wb_break == 2'b00) begin
+            host_call;
+        end
+    end
+`endif // LOCKSTEP
+`else
     // syscall
     always @(posedge clk) begin
         if (`TOP.wb_system && !`TOP.wb_stall) begin
@@ -559,31 +1070,31 @@ assign dmem_waddr_i = dmem_waddr[31:2]-(DRAMBASE/4);
             end else if (`TOP.wb_break == 2'b00 && `TOP.regs[REG_SYS] == SYS_WRITE &&
                 `TOP.regs[REG_A0] == 32'h1) begin // stdout
                 for (i = 0; i < `TOP.regs[REG_A2]; i = i + 1) begin
-                    $write("%c", dmem.getb(`TOP.regs[REG_A1] - IRAMSIZE + i));
+                    console_putc(dmem.getb(`TOP.regs[REG_A1] - iram_size + i));
                 end
                 /* verilator lint_off IGNOREDRETURN */
                 `ifdef VERILATOR
                 `TOP.set_reg(REG_A0, `TOP.regs[REG_A2]);
                 `endif
                 /* verilator lint_on IGNOREDRETURN */
-                $fflush;
             end else if (`TOP.wb_break == 2'b00 && `TOP.regs[REG_SYS] == SYS_READ &&
                 `TOP.regs[REG_A0] == 32'h0) begin // stdin
                 // TODO
             end else if (`TOP.wb_break == 2'b00 && `TOP.regs[REG_SYS] == SYS_DUMP && dump != 0) begin
                 for (i = `TOP.regs[REG_A0]; i < `TOP.regs[REG_A1]; i = i + 4) begin
-                    $fdisplay(dump, "%02x%02x%02x%02x", dmem.getb(i - IRAMSIZE + 3),
-                                                        dmem.getb(i - IRAMSIZE + 2),
-                                                        dmem.getb(i - IRAMSIZE + 1),
-                                                        dmem.getb(i - IRAMSIZE + 0));
+                    $fdisplay(dump, "%02x%02x%02x%02x", dmem.getb(i - iram_size + 3),
+                                                        dmem.getb(i - iram_size + 2),
+                                                        dmem.getb(i - iram_size + 1),
+                                                        dmem.getb(i - iram_size + 0));
                 end
             end else if (`TOP.wb_break == 2'b00 && `TOP.regs[REG_SYS] == SYS_DUMP_BIN && dump != 0) begin
                 for (i = `TOP.regs[REG_A0]; i < `TOP.regs[REG_A1]; i = i + 1) begin
-                    $fwrite(dump, "%c", dmem.getb(i - IRAMSIZE));
+                    $fwrite(dump, "%c", dmem.getb(i - iram_size));
                 end
             end
         end
     end
+`endif // VERILATOR
 `endif // SYNTHESIS
 
 `endif // SINGLE_RAM
@@ -593,12 +1104,34 @@ assign dmem_waddr_i = dmem_waddr[31:2]-(DRAMBASE/4);
 ////////////////////////////////////////////////////////////
 // Generate trace.log
 ////////////////////////////////////////////////////////////
+    reg             trace_en;
+
+initial begin
+    trace_en = $test$plusargs("trace") != 0;
+end
+
+    // the retirement of the trace log and the lockstep
+    wire            rt_load     = `TOP.wb_mem2reg && !`TOP.wb_ld_align_excp;
+    wire            rt_rd_valid = rt_load ? `TOP.wb_alu2reg :
+                                  (`TOP.wb_alu2reg && !`TOP.wb_trap_nop);
+    wire    [31: 0] rt_rd_data  = rt_load ? `TOP.wb_rdata : `TOP.wb_result;
+    wire            rt_st_valid = !rt_load && !`TOP.wb_alu2reg && `TOP.dmem_wready;
+
+`ifdef VERILATOR
+// the trace is formatted and written by sim/trace.cpp, +binary writes it in
+// the format of tools/trace.h
+initial begin
+    if (trace_en) begin
+        trace_open("trace.log", {31'h0, $test$plusargs("binary") != 0});
+    end
+end
+`else
     integer         fp;
 
     reg [7*8:1] regname;
 
 initial begin
-    if ($test$plusargs("trace") != 0) begin
+    if (trace_en) begin
         fp = $fopen("trace.log", "w");
     end
 end
@@ -640,6 +1173,7 @@ always @* begin
         default: regname = "xx";
     endcase
 end
+`endif // VERILATOR
 
 always @(posedge clk or negedge resetb) begin
     if (!resetb) begin
@@ -650,8 +1184,21 @@ always @(posedge clk or negedge resetb) begin
     end
 end
 
+`ifdef VERILATOR
+always @(posedge clk) begin
+    if (trace_en && !`TOP.wb_stall && !`TOP.stall_r &&
+        !`TOP.wb_flush && fillcount == 2'b11) begin
+        trace_retire(`TOP.csr_cycle[31:0], `TOP.wb_pc, `TOP.wb_insn,
+                     {29'h0, rt_st_valid, rt_load, rt_rd_valid},
+                     {27'h0, `TOP.wb_dst_sel}, rt_rd_data,
+                     rt_load ? `TOP.wb_raddress : `TOP.dmem_waddr,
+                     `TOP.dmem_wdata, {28'h0, `TOP.wb_wstrb},
+                     {29'h0, `TOP.wb_alu_op});
+    end
+end
+`else
 always @(posedge clk) begin
-    if ($test$plusargs("trace") != 0 && !`TOP.wb_stall && !`TOP.stall_r &&
+    if (trace_en && !`TOP.wb_stall && !`TOP.stall_r &&
         !`TOP.wb_flush && fillcount == 2'b11) begin
         `ifdef PRINT_TIMELOG
         $fwrite(fp, "%d ", top.riscv.csr_cycle[31:0]);
@@ -704,6 +1251,29 @@ always @(posedge clk) begin
         end
     end
 end
+`endif // VERILATOR
+
+`ifdef LOCKSTEP
+////////////////////////////////////////////////////////////
+// Compare each retired instruction with the ISS
+////////////////////////////////////////////////////////////
+always @(posedge clk) begin
+    // the result of the host call is given to the ISS before the ecall
+    // retires
+    if (`TOP.wb_system && !`TOP.wb_stall && `TOP.wb_break == 2'b00) begin
+        host_call;
+    end
+    if (!`TOP.wb_stall && !`TOP.stall_r && !`TOP.wb_flush && fillcount == 2'b11) begin
+        if (lockstep_retire(`TOP.wb_pc, `TOP.wb_insn,
+                            {31'h0, rt_rd_valid}, {27'h0, `TOP.wb_dst_sel}, rt_rd_data,
+                            {31'h0, rt_st_valid}, `TOP.dmem_waddr,
+                            {28'h0, `TOP.wb_wstrb}, `TOP.dmem_wdata) != 0) begin
+            $display("Lockstep failed");
+            $finish(2);
+        end
+    end
+end
+`endif // LOCKSTEP
 `endif // TRACE
 `endif // SYNTHESIS
 
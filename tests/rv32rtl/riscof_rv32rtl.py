@@ -57,6 +57,14 @@ class rv32rtl(pluginTemplate):
         else:
             self.target_run = True
 
+        # The tests run in the workers of one Verilator sim (see sim/farm.cpp), on all of the
+        # host cores unless jobs is given. Set farm=0 to run a sim for each test, as for Icarus.
+        if 'farm' in config and config['farm']=='0':
+            self.farm = False
+        else:
+            self.farm = True
+        self.farm_jobs = str(config['jobs'] if 'jobs' in config else 0)
+
     def initialise(self, suite, work_dir, archtest_env):
 
        # capture the working directory. Any artifacts that the DUT creates should be placed in this
@@ -119,6 +127,9 @@ class rv32rtl(pluginTemplate):
       # function earlier
       make.makeCommand = 'make -k -j' + self.num_jobs
 
+      # the elf and the work directory of each test for the farm
+      farm = []
+
       # we will iterate over each entry in the testList. Each entry node will be refered to by the
       # variable testname.
       for testname in testList:
@@ -153,7 +164,11 @@ class rv32rtl(pluginTemplate):
           # if the user wants to disable running the tests and only compile the tests, then
           # the "else" clause is executed below assigning the sim command to simple no action
           # echo statement.
-          if self.target_run:
+          if self.target_run and self.farm:
+            # the test is run by the farm after all of the tests are compiled
+            simcmd = 'true'
+            farm.append((os.path.join(test_dir, elf), test_dir, sig_file))
+          elif self.target_run:
             # set up the simulation command. Template is for spike. Please change.
             simcmd = self.dut_exe + ' +trace {0}; mv dump.txt DUT-rv32rtl.signature'.format(elf)
           else:
@@ -174,6 +189,18 @@ class rv32rtl(pluginTemplate):
       # parallel using the make command set above.
       make.execute_all(self.work_dir)
 
+      # run the tests in the workers of one sim, and collect the signatures
+      if farm:
+          farm_list = os.path.join(self.work_dir, 'farm.txt')
+          with open(farm_list, 'w') as f:
+              for elf, test_dir, sig_file in farm:
+                  f.write('{0} {1}\n'.format(elf, test_dir))
+          subprocess.run(shlex.split(self.dut_exe) + ['+trace', '+farm=' + farm_list,
+                         '+jobs=' + self.farm_jobs], cwd=self.work_dir)
+          for elf, test_dir, sig_file in farm:
+              if os.path.exists(os.path.join(test_dir, 'dump.txt')):
+                  shutil.move(os.path.join(test_dir, 'dump.txt'), sig_file)
+
       # if target runs are not required then we simply exit as this point after running all
       # the makefile targets.
       if not self.target_run:
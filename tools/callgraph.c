@@ -0,0 +1,418 @@
+// Copyright © 2020 Kuoping Hsu
+// callgraph.c: call graph profiler with folded stack output
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The profiler keeps a shadow call stack for the running context. Each frame
+// points to a node of the call tree, and the cycles are charged to the node
+// on the top of the stack whenever the stack changes. A trap pushes a trap
+// frame, and mret pops it. When mret does not return to the interrupted
+// context (e.g. the context switch of FreeRTOS), the interrupted stack is
+// suspended and keyed by its mepc and sp, so that it can be resumed later.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "opcode.h"
+#include "elf.h"
+
+#define MAX_DEPTH       1024
+#define MAX_SUSPEND     64
+#define MAXLEN_PATH     8192
+
+extern CSR csr;
+extern int32_t regs[REGNUM];
+extern int quiet;
+
+int elfsymbols(char *file, ElfSymbol **symbols);
+int elfsymbol_lookup(ElfSymbol *symbols, int count, unsigned int addr);
+
+typedef struct {
+    int         func;       // symbol index, -1 for unknown function
+    int32_t     addr;       // entry address, for unknown function
+    int         parent;
+    int         child;
+    int         sibling;
+    long long   cycles;     // exclusive cycles
+    long long   insts;      // exclusive instructions
+    long long   calls;
+} NODE;
+
+typedef struct {
+    int         node;
+    int32_t     ret;        // return address, or mepc for trap frame
+    int32_t     sp;         // sp at trap, zero for call frame
+    int         trap;
+} FRAME;
+
+typedef struct {
+    int32_t     mepc;
+    int32_t     sp;
+    int         depth;
+    FRAME      *frames;
+} CONTEXT;
+
+static ElfSymbol *symbols = NULL;
+static int nsymbols = 0;
+
+static NODE *nodes = NULL;
+static int nnodes = 0;
+static int maxnodes = 0;
+static int roots = -1;
+
+static FRAME stack[MAX_DEPTH];
+static int depth = 0;
+
+static CONTEXT suspend[MAX_SUSPEND];
+static int nsuspend = 0;
+
+static long long last_cycle = 0;
+static long long last_inst = 0;
+
+static char *outfile = NULL;
+
+static int func_of(int32_t addr) {
+    return elfsymbol_lookup(symbols, nsymbols, (unsigned int)addr);
+}
+
+static int new_node(int parent, int func, int32_t addr) {
+    NODE *n;
+
+    if (nnodes == maxnodes) {
+        maxnodes = maxnodes ? maxnodes * 2 : 1024;
+        if ((nodes = (NODE*)realloc(nodes, sizeof(NODE) * maxnodes)) == NULL) {
+            // LCOV_EXCL_START
+            printf("malloc fail\n");
+            exit(1);
+            // LCOV_EXCL_STOP
+        }
+    }
+
+    n = &nodes[nnodes];
+    memset(n, 0, sizeof(NODE));
+    n->func    = func;
+    n->addr    = addr;
+    n->parent  = parent;
+    n->child   = -1;
+    n->sibling = -1;
+
+    if (parent >= 0) {
+        n->sibling = nodes[parent].child;
+        nodes[parent].child = nnodes;
+    } else {
+        n->sibling = roots;
+        roots = nnodes;
+    }
+
+    return nnodes++;
+}
+
+// find or create the child node of the function at addr
+static int child_node(int parent, int32_t addr) {
+    int func = func_of(addr);
+    int i;
+
+    i = (parent >= 0) ? nodes[parent].child : roots;
+    for(; i >= 0; i = nodes[i].sibling) {
+        if (nodes[i].func == func && (func >= 0 || nodes[i].addr == addr))
+            return i;
+    }
+
+    return new_node(parent, func, addr);
+}
+
+// charge the cycles since the last event to the top of the stack
+static void charge(void) {
+    if (depth > 0) {
+        NODE *n = &nodes[stack[depth-1].node];
+        n->cycles += csr.cycle.c - last_cycle;
+        n->insts  += csr.instret.c - last_inst;
+    }
+    last_cycle = csr.cycle.c;
+    last_inst  = csr.instret.c;
+}
+
+static void push(int32_t target, int32_t ret, int32_t sp, int trap) {
+    int parent = (depth > 0) ? stack[depth-1].node : -1;
+    int node;
+
+    if (depth == MAX_DEPTH)
+        return;
+
+    node = child_node(parent, target);
+    nodes[node].calls++;
+
+    stack[depth].node = node;
+    stack[depth].ret  = ret;
+    stack[depth].sp   = sp;
+    stack[depth].trap = trap;
+    depth++;
+}
+
+// replace the top frame, for tail calls and unknown returns
+static void replace(int32_t target) {
+    int parent;
+    int node;
+
+    if (depth == 0) {
+        push(target, 0, 0, 0);
+        return;
+    }
+
+    parent = (depth > 1) ? stack[depth-2].node : -1;
+    node = child_node(parent, target);
+    nodes[node].calls++;
+    stack[depth-1].node = node;
+}
+
+void callgraph_init(char *elf, char *file, int32_t entry) {
+    nsymbols = elfsymbols(elf, &symbols);
+    if (nsymbols == 0)
+        printf("Warning: no symbol table in %s\n", elf);
+
+    outfile = file;
+    depth = 0;
+    push(entry, 0, 0, 0);
+}
+
+void callgraph_jump(int rd, int rs1, int jalr, int32_t pc, int32_t target, int32_t ret) {
+    int link_rd  = (rd == RA || rd == T0);
+    int link_rs1 = jalr && (rs1 == RA || rs1 == T0);
+
+    if (!link_rd && !link_rs1) {
+        int func;
+        // tail call: jump to the entry of another function
+        if (depth == 0 || (func = func_of(target)) < 0 ||
+            symbols[func].addr != (unsigned int)target ||
+            func == func_of(pc))
+            return;
+        charge();
+        replace(target);
+        return;
+    }
+
+    charge();
+
+    // return: pop to the frame that returns to the target
+    if (link_rs1 && !link_rd) {
+        int i;
+        for(i = depth - 1; i >= 0 && !stack[i].trap; i--) {
+            if (stack[i].ret == target) {
+                depth = i;
+                return;
+            }
+        }
+        // the return address is unknown, e.g. the first task starts by ret
+        replace(target);
+        return;
+    }
+
+    // call, and co-routine swap when both are different link registers
+    if (link_rs1 && rd != rs1 && depth > 0 && !stack[depth-1].trap)
+        depth--;
+    push(target, ret, 0, 0);
+}
+
+void callgraph_trap(int32_t mepc, int32_t handler) {
+    charge();
+    push(handler, mepc, regs[SP], 1);
+}
+
+// The trap handler returns to mepc+4 for ecall.
+static int resume_at(int32_t mepc, int32_t sp, int32_t target) {
+    return (target == mepc || target == mepc + 4) && sp == regs[SP];
+}
+
+void callgraph_mret(int32_t target) {
+    int i;
+    int trap;
+
+    charge();
+
+    for(trap = depth - 1; trap >= 0 && !stack[trap].trap; trap--);
+
+    if (trap < 0) {
+        replace(target);
+        return;
+    }
+
+    if (resume_at(stack[trap].ret, stack[trap].sp, target)) {
+        depth = trap;
+        return;
+    }
+
+    // context switch: suspend the interrupted context
+    if (nsuspend < MAX_SUSPEND && trap > 0) {
+        CONTEXT *ctx = &suspend[nsuspend++];
+        ctx->mepc   = stack[trap].ret;
+        ctx->sp     = stack[trap].sp;
+        ctx->depth  = trap;
+        if ((ctx->frames = (FRAME*)malloc(sizeof(FRAME) * trap)) == NULL) {
+            // LCOV_EXCL_START
+            printf("malloc fail\n");
+            exit(1);
+            // LCOV_EXCL_STOP
+        }
+        memcpy(ctx->frames, stack, sizeof(FRAME) * trap);
+    }
+
+    // resume the suspended context if any
+    for(i = 0; i < nsuspend; i++) {
+        if (resume_at(suspend[i].mepc, suspend[i].sp, target)) {
+            CONTEXT *ctx = &suspend[i];
+            depth = ctx->depth;
+            memcpy(stack, ctx->frames, sizeof(FRAME) * depth);
+            free(ctx->frames);
+            *ctx = suspend[--nsuspend];
+            return;
+        }
+    }
+
+    depth = 0;
+    push(target, 0, 0, 0);
+}
+
+static char *func_name(int node, char *buf, int len) {
+    if (nodes[node].func >= 0)
+        return symbols[nodes[node].func].name;
+    snprintf(buf, len, "0x%08x", nodes[node].addr);
+    return buf;
+}
+
+static void write_folded(FILE *fp, int node, char *path, int len) {
+    char buf[16];
+    char *name = func_name(node, buf, sizeof(buf));
+    int n = strlen(name);
+    int i;
+
+    if (len + n + 2 < MAXLEN_PATH) {
+        if (len) path[len++] = ';';
+        memcpy(&path[len], name, n);
+        len += n;
+        path[len] = 0;
+    }
+
+    if (nodes[node].cycles)
+        fprintf(fp, "%s %lld\n", path, nodes[node].cycles);
+
+    for(i = nodes[node].child; i >= 0; i = nodes[i].sibling)
+        write_folded(fp, i, path, len);
+}
+
+// Returns the inclusive cycles of the node. The inclusive cycles of a
+// function are counted at the outermost node of the function on the path,
+// so that the recursion is not counted twice.
+static long long summarize(int node, long long *incl, long long *excl,
+                           long long *calls, int *active) {
+    int func = nodes[node].func + 1; // zero for unknown functions
+    long long cycles = nodes[node].cycles;
+    int i;
+
+    active[func]++;
+    for(i = nodes[node].child; i >= 0; i = nodes[i].sibling)
+        cycles += summarize(i, incl, excl, calls, active);
+    active[func]--;
+
+    if (!active[func])
+        incl[func] += cycles;
+    excl[func]  += nodes[node].cycles;
+    calls[func] += nodes[node].calls;
+
+    return cycles;
+}
+
+void callgraph_exit(void) {
+    FILE *fp;
+    char *path;
+    long long *incl, *excl, *calls;
+    int *active, *order;
+    int i, j, n;
+
+    charge();
+
+    if ((fp = fopen(outfile, "w")) == NULL) {
+        printf("can not open file %s\n", outfile);
+        return;
+    }
+
+    if ((path = (char*)malloc(MAXLEN_PATH)) == NULL) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(1);
+        // LCOV_EXCL_STOP
+    }
+
+    for(i = roots; i >= 0; i = nodes[i].sibling) {
+        path[0] = 0;
+        write_folded(fp, i, path, 0);
+    }
+    fclose(fp);
+    free(path);
+
+    if (quiet)
+        return;
+
+    n      = nsymbols + 1;
+    incl   = (long long*)calloc(n, sizeof(long long));
+    excl   = (long long*)calloc(n, sizeof(long long));
+    calls  = (long long*)calloc(n, sizeof(long long));
+    active = (int*)calloc(n, sizeof(int));
+    order  = (int*)calloc(n, sizeof(int));
+
+    if (!incl || !excl || !calls || !active || !order) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(1);
+        // LCOV_EXCL_STOP
+    }
+
+    for(i = roots; i >= 0; i = nodes[i].sibling)
+        summarize(i, incl, excl, calls, active);
+
+    // sort by the inclusive cycles
+    for(i = 0; i < n; i++) {
+        int v = i;
+        for(j = i; j > 0 && incl[order[j-1]] < incl[v]; j--)
+            order[j] = order[j-1];
+        order[j] = v;
+    }
+
+    printf("\nCall graph profile (%lld cycles)\n", csr.cycle.c);
+    printf("%-32s %14s %7s %14s %7s %10s\n",
+           "function", "inclusive", "%", "exclusive", "%", "calls");
+    for(i = 0; i < n && i < 32; i++) {
+        int f = order[i];
+        if (!incl[f])
+            break;
+        printf("%-32.32s %14lld %6.2f%% %14lld %6.2f%% %10lld\n",
+               f ? symbols[f-1].name : "(unknown)",
+               incl[f], incl[f] * 100.0 / csr.cycle.c,
+               excl[f], excl[f] * 100.0 / csr.cycle.c,
+               calls[f]);
+    }
+    printf("Folded stacks are written to %s\n", outfile);
+
+    free(incl);
+    free(excl);
+    free(calls);
+    free(active);
+    free(order);
+}
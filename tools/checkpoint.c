@@ -0,0 +1,108 @@
+// Copyright © 2020 Kuoping Hsu
+// checkpoint.c: architectural checkpoint for the RTL simulation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// The memory is written in the chunks not all zero, so the checkpoint of a
+// large memory is about the size of the program and its data.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "opcode.h"
+#include "checkpoint.h"
+
+extern CSR csr;
+extern int32_t pc;
+extern int32_t regs[REGNUM];
+extern int *mem;
+extern int mem_size;
+
+long long hpm_value(int n);
+
+// Return 0 if fails
+int checkpoint_write(char *file) {
+    CKPT_HEADER h;
+    CKPT_CHUNK chunk;
+    FILE *fp;
+    uint32_t total = mem_size * 2;
+    uint32_t offset, size, i;
+    int n;
+
+    if ((fp = fopen(file, "wb")) == NULL) {
+        printf("can not open file %s\n", file);
+        return 0;
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CKPT_MAGIC, 4);
+    h.version   = CKPT_VERSION;
+    h.mem_size  = mem_size;
+    h.pc        = pc;
+    for(n = 0; n < REGNUM; n++)
+        h.regs[n] = regs[n];
+    h.cycle     = csr.cycle.c;
+    h.instret   = csr.instret.c;
+    h.mtime     = csr.mtime.c;
+    h.mtimecmp  = csr.mtimecmp.c;
+    h.mstatus   = csr.mstatus;
+    h.mstatush  = csr.mstatush;
+    h.mie       = csr.mie;
+    h.mip       = csr.mip;
+    h.mtvec     = csr.mtvec;
+    h.mscratch  = csr.mscratch;
+    h.mepc      = csr.mepc;
+    h.mcause    = csr.mcause;
+    h.mtval     = csr.mtval;
+    h.msip      = csr.msip;
+    for(n = 0; n < HPM_NUM; n++) {
+        h.mhpmcounter[n] = hpm_value(n);
+        h.mhpmevent[n] = csr.mhpmevent[n];
+    }
+    h.mcountinhibit = csr.mcountinhibit;
+    fwrite(&h, sizeof(h), 1, fp);
+
+    for(offset = 0; offset < total; offset += CKPT_CHUNK_SIZE) {
+        uint32_t *src = (uint32_t*)&mem[offset / 4];
+
+        size = (total - offset < CKPT_CHUNK_SIZE) ? total - offset : CKPT_CHUNK_SIZE;
+        for(i = 0; i < size / 4 && src[i] == 0; i++)
+            ;
+        if (i == size / 4)
+            continue;
+
+        chunk.offset = offset;
+        chunk.size   = size;
+        fwrite(&chunk, sizeof(chunk), 1, fp);
+        fwrite(src, 1, size, fp);
+    }
+
+    chunk.offset = CKPT_END;
+    chunk.size   = 0;
+    fwrite(&chunk, sizeof(chunk), 1, fp);
+
+    if (fclose(fp) != 0) {
+        printf("can not write file %s\n", file);
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,69 @@
+// Copyright © 2020 Kuoping Hsu
+// checkpoint.h: architectural checkpoint format
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// The architectural state of rvsim at an instruction boundary, loaded by the
+// RTL simulation with +checkpoint. The header is followed by the chunks of
+// the memory not all zero, IMEM at the offset 0 and DMEM at the offset
+// mem_size, and the chunk of CKPT_END ends the file. All fields are little
+// endian.
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <stdint.h>
+
+#define CKPT_MAGIC      "RVCP"
+#define CKPT_VERSION    2
+#define CKPT_CHUNK_SIZE 65536
+#define CKPT_END        0xffffffff
+
+typedef struct {
+    char        magic[4];       // CKPT_MAGIC
+    uint32_t    version;
+    uint32_t    mem_size;       // the size of IMEM, and of DMEM
+    uint32_t    pc;
+    uint32_t    regs[32];
+    uint64_t    cycle;
+    uint64_t    instret;
+    uint64_t    mtime;
+    uint64_t    mtimecmp;
+    uint32_t    mstatus;
+    uint32_t    mstatush;
+    uint32_t    mie;
+    uint32_t    mip;
+    uint32_t    mtvec;
+    uint32_t    mscratch;
+    uint32_t    mepc;
+    uint32_t    mcause;
+    uint32_t    mtval;
+    uint32_t    msip;
+    uint64_t    mhpmcounter[4]; // mhpmcounter3 ... mhpmcounter6, HPM_NUM
+    uint32_t    mhpmevent[4];
+    uint32_t    mcountinhibit;
+} CKPT_HEADER;
+
+typedef struct {
+    uint32_t    offset;         // CKPT_END for the end
+    uint32_t    size;
+} CKPT_CHUNK;
+
+#endif // __CHECKPOINT_H__
@@ -0,0 +1,127 @@
+// Copyright © 2020 Kuoping Hsu
+// console.c: buffered console of the simulator
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The console output of the program goes to the buffer of stdout, which is
+// flushed by the policy instead of at each character, so that the messages of
+// the simulator keep their order with the console. The policy is a list of
+//     char        flush at each character
+//     line        flush at newline
+//     size=n      flush when n bytes are buffered
+//     idle=n      flush after n cycles without output
+//     exit        flush at the program exit only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "opcode.h"
+
+#define CONSOLE_SIZE    4096        // default buffer size
+#define CONSOLE_IDLE    1000000     // default idle cycles
+
+extern CSR csr;
+
+int console_pending = 0;            // bytes in the buffer
+
+static int flush_char = 0;
+static int flush_line = 1;
+static int flush_size = CONSOLE_SIZE;
+static int flush_idle = CONSOLE_IDLE;
+static long long last_cycle = 0;
+static char *console_buf = NULL;
+
+// Return 0 if the policy is valid
+int console_policy(char *policy) {
+    char *s = strdup(policy);
+    char *tok;
+    int n;
+
+    if (!s) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(1);
+        // LCOV_EXCL_STOP
+    }
+
+    flush_char = 0;
+    flush_line = 0;
+    flush_idle = 0;
+
+    for(tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+        if (!strcmp(tok, "char")) {
+            flush_char = 1;
+        } else if (!strcmp(tok, "line")) {
+            flush_line = 1;
+        } else if (sscanf(tok, "size=%i", &n) == 1 && n > 0) {
+            flush_size = n;
+        } else if (sscanf(tok, "idle=%i", &n) == 1 && n > 0) {
+            flush_idle = n;
+        } else if (!strcmp(tok, "exit")) {
+            ;
+        } else {
+            printf("Unknown console flush policy %s\n", tok);
+            free(s);
+            return 1;
+        }
+    }
+
+    free(s);
+    return 0;
+}
+
+void console_init(void) {
+    if ((console_buf = (char*)malloc(flush_size)) == NULL) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(1);
+        // LCOV_EXCL_STOP
+    }
+    setvbuf(stdout, console_buf, _IOFBF, flush_size);
+}
+
+void console_flush(void) {
+    fflush(stdout);
+    console_pending = 0;
+}
+
+void console_write(const char *buf, int len) {
+    if (len <= 0)
+        return;
+
+    fwrite(buf, 1, len, stdout);
+    console_pending += len;
+    last_cycle = csr.cycle.c;
+
+    // stdio writes the buffer when it is full
+    if (flush_char || (flush_line && memchr(buf, '\n', len)))
+        console_flush();
+}
+
+void console_putc(char c) {
+    console_write(&c, 1);
+}
+
+// called at each instruction while the buffer is not empty
+void console_idle(void) {
+    if (flush_idle && csr.cycle.c - last_cycle >= flush_idle)
+        console_flush();
+}
@@ -21,11 +21,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <stdint.h>
 
 #include "opcode.h"
 #include "riscv-disas.h"
+#include "elf.h"
+
+#define MAX_POINTS  64
 
 extern CSR csr;
 extern int32_t pc;
@@ -38,23 +42,65 @@ extern char *regname[32];
 extern int mem_base;
 extern int mem_size;
 
+int elfsymbols(char *file, ElfSymbol **symbols);
+int elfsymbols_all(char *file, ElfSymbol **symbols);
+int elfsymbol_lookup(ElfSymbol *symbols, int count, unsigned int addr);
+int elfsymbol_find(ElfSymbol *symbols, int count, const char *name);
+
+typedef struct {
+    int         id;
+    int         type;
+    int32_t     addr;
+    int32_t     len;
+} POINT;
+
+// The simulator checks the breakpoint bitmap and the instruction count
+// before each instruction, and the watchpoint page table on each memory
+// access, so it runs at full speed between the stops.
+uint32_t *bp_map = NULL;
+uint8_t *watch_map = NULL;
+int debug_stop = 1;
+long long debug_instret = 0;
+int32_t debug_watch_addr = 0;   // the last watchpoint hit
+int debug_watch_type = 0;
+
+extern int gdb_en;
+void gdbstub_stop(void);
+void console_flush(void);
+
+static POINT points[MAX_POINTS];
+static int npoints = 0;
+static int point_id = 0;
+
+static ElfSymbol *symbols = NULL;   // functions
+static int nsymbols = 0;
+static ElfSymbol *allsyms = NULL;   // functions and variables
+static int nallsyms = 0;
+
 static void debug_usage(void) {
     printf(
 "Interactive command\n"
+"break|b <addr>             # set breakpoint at address or symbol\n"
+"continue|c                 # run until breakpoint or watchpoint\n"
 "csrs                       # dunp csr registers\n"
+"delete <n>                 # delete breakpoint or watchpoint n\n"
 "mem <addr> <len>           # dump memory\n"
 "help|h                     # help\n"
+"info                       # list breakpoints and watchpoints\n"
 "list [count]               # list disassembly code (defualt 16)\n"
 "pc                         # show pc\n"
 "quit|q                     # quit\n"
 "regs                       # dump registers\n"
-"step [count]               # run\n"
-"until <val>                # run until pc htis <val>\n"
+"rwatch <addr> [len]        # stop after reading the memory\n"
+"awatch <addr> [len]        # stop after accessing the memory\n"
+"step [count]               # run count instructions (default 1)\n"
+"until <addr>               # run until pc hits address or symbol\n"
+"watch <addr> [len]         # stop after writing the memory\n"
 "\n"
     );
 }
 
-static uint8_t *get_mem(int addr) {
+uint8_t *get_mem(int addr) {
     char *iptr = (char*)imem;
     char *dptr = (char*)dmem;
 
@@ -135,6 +181,148 @@ static void dump_csrs(void) {
     printf("\n");
 }
 
+static const char *symbol_name(int32_t addr) {
+    int i = elfsymbol_lookup(symbols, nsymbols, (unsigned int)addr);
+    return (i >= 0) ? symbols[i].name : "";
+}
+
+// the address is a number, or the name of a function or variable
+static int parse_addr(const char *str, int32_t *addr) {
+    char *end;
+    int i;
+
+    *addr = (int32_t)strtoul(str, &end, 0);
+    if (end != str && *end == 0)
+        return 1;
+
+    if ((i = elfsymbol_find(allsyms, nallsyms, str)) >= 0) {
+        *addr = allsyms[i].addr;
+        return 1;
+    }
+
+    printf("Unknown address or symbol %s\n", str);
+    return 0;
+}
+
+static void update_maps(void) {
+    int i;
+
+    memset(bp_map, 0, (IMEM_SIZE/64+1)*sizeof(uint32_t));
+    memset(watch_map, 0, ((IMEM_SIZE+DMEM_SIZE)>>WATCH_PAGE_BITS)+1);
+
+    for(i = 0; i < npoints; i++) {
+        POINT *p = &points[i];
+        uint32_t addr = (uint32_t)IVA2PA(p->addr);
+
+        if (p->type == POINT_BREAK || p->type == POINT_TEMP) {
+            if (addr < (uint32_t)IMEM_SIZE)
+                bp_map[addr>>6] |= 1u << ((addr>>1)&31);
+        } else {
+            uint32_t end = addr + p->len - 1;
+            for(; addr <= end && addr < (uint32_t)(IMEM_SIZE+DMEM_SIZE);
+                addr = ((addr >> WATCH_PAGE_BITS) + 1) << WATCH_PAGE_BITS)
+                watch_map[addr>>WATCH_PAGE_BITS] = 1;
+        }
+    }
+}
+
+int debug_point_add(int type, int32_t addr, int32_t len) {
+    if (npoints == MAX_POINTS) {
+        printf("Too many breakpoints and watchpoints\n");
+        return 0;
+    }
+
+    points[npoints].id   = ++point_id;
+    points[npoints].type = type;
+    points[npoints].addr = addr;
+    points[npoints].len  = len > 0 ? len : 4;
+    npoints++;
+
+    update_maps();
+    return point_id;
+}
+
+int debug_point_remove(int type, int32_t addr, int32_t len) {
+    int i;
+
+    for(i = 0; i < npoints; i++) {
+        if (points[i].type == type && points[i].addr == addr &&
+            points[i].len == (len > 0 ? len : 4)) {
+            points[i] = points[--npoints];
+            update_maps();
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void delete_point(int id) {
+    int i;
+
+    for(i = 0; i < npoints; i++) {
+        if (points[i].id == id) {
+            points[i] = points[--npoints];
+            update_maps();
+            return;
+        }
+    }
+
+    printf("No breakpoint or watchpoint %d\n", id);
+}
+
+static void list_points(void) {
+    static const char *types[] = {
+        "break", "until", "watch", "rwatch", "awatch"
+    };
+    int i;
+
+    for(i = 0; i < npoints; i++) {
+        POINT *p = &points[i];
+        if (p->type == POINT_BREAK || p->type == POINT_TEMP)
+            printf("%3d %-7s %08x <%s>\n", p->id, types[p->type], p->addr,
+                   symbol_name(p->addr));
+        else
+            printf("%3d %-7s %08x len %d\n", p->id, types[p->type], p->addr,
+                   p->len);
+    }
+}
+
+void debug_init(char *elf) {
+    if ((bp_map = (uint32_t*)calloc(IMEM_SIZE/64+1, sizeof(uint32_t))) == NULL ||
+        (watch_map = (uint8_t*)calloc(((IMEM_SIZE+DMEM_SIZE)>>WATCH_PAGE_BITS)+1, 1)) == NULL) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(1);
+        // LCOV_EXCL_STOP
+    }
+
+    nsymbols = elfsymbols(elf, &symbols);
+    nallsyms = elfsymbols_all(elf, &allsyms);
+}
+
+// called by the memory access on a page with watchpoints
+void debug_watch(int32_t address, int size, int write) {
+    int i;
+
+    for(i = 0; i < npoints; i++) {
+        POINT *p = &points[i];
+
+        if (p->type < POINT_WATCH ||
+            (p->type == POINT_WATCH && !write) ||
+            (p->type == POINT_RWATCH && write) ||
+            address >= p->addr + p->len || address + size <= p->addr)
+            continue;
+
+        if (!gdb_en)
+            printf("Watchpoint %d: %s 0x%08x at pc %08x <%s>\n", p->id,
+                   write ? "write" : "read", address, pc, symbol_name(pc));
+        debug_watch_addr = address;
+        debug_watch_type = p->type;
+        debug_stop = 1;
+    }
+}
+
 static int isspace_ascii(int c)
 {
     return c == '\t' || c == '\n' || c == '\v' ||
@@ -159,119 +347,161 @@ static char * trim(char * s, int size) {
 }
 
 void debug(void) {
-    static int running = 0;
     static char cmd[1024];
     static char cmd_last[1024];
-    static int until_pc = 0;
-    static int count = 0;
-    static int count_en = 0;
-
-    if (running) {
-        if (until_pc == pc) {
-            running = 0;
-            until_pc = 0;
-        }
+    int i;
 
-        if (count_en) {
-            if (count <= 1) {
-                running = 0;
-                count_en = 0;
-            } else {
-                show_pc(pc);
-                count--;
+    if (gdb_en) {
+        gdbstub_stop();
+        return;
+    }
+
+    // report the breakpoint, and remove the breakpoint of until
+    if (BREAKPOINT(bp_map, pc)) {
+        for(i = npoints - 1; i >= 0; i--) {
+            if ((points[i].type == POINT_BREAK || points[i].type == POINT_TEMP) &&
+                points[i].addr == pc) {
+                if (points[i].type == POINT_BREAK)
+                    printf("Breakpoint %d at %08x <%s>\n", points[i].id, pc,
+                           symbol_name(pc));
+                else
+                    delete_point(points[i].id);
             }
         }
     }
 
-    if (!running) {
-        dump_regs();
-        do {
-            printf("(rvsim) ");
-
-            if (!fgets(cmd, sizeof(cmd), stdin))
-                continue;
+    debug_stop = 0;
+    debug_instret = 0;
 
-            trim(cmd, sizeof(cmd));
+    dump_regs();
+    do {
+        printf("(rvsim) ");
+        console_flush();
 
-            if (cmd[0] == 0) {
-                strncpy(cmd, cmd_last, sizeof(cmd));
-            } else {
-                strncpy(cmd_last, cmd, sizeof(cmd));
-            }
+        if (!fgets(cmd, sizeof(cmd), stdin))
+            exit(0);
 
-            if (!strncmp(cmd, "help", sizeof(cmd)) || !strncmp(cmd, "h", sizeof(cmd))) {
-                debug_usage();
-                continue;
-            }
+        trim(cmd, sizeof(cmd));
 
-            if (!strncmp(cmd, "quit", sizeof(cmd)) || !strncmp(cmd, "q", sizeof(cmd))) {
-                exit(0);
-            }
+        if (cmd[0] == 0) {
+            strncpy(cmd, cmd_last, sizeof(cmd));
+        } else {
+            strncpy(cmd_last, cmd, sizeof(cmd));
+        }
 
-            if (!strncmp(cmd, "until", sizeof("until")-1)) {
-                until_pc = 0;
-                count_en = 0;
-                sscanf(cmd, "until %i", &until_pc);
-                running = 1;
-                break;
-            }
+        if (!strncmp(cmd, "help", sizeof(cmd)) || !strncmp(cmd, "h", sizeof(cmd))) {
+            debug_usage();
+            continue;
+        }
 
-            if (!strncmp(cmd, "regs", sizeof(cmd))) {
-                dump_regs();
-                continue;
-            }
+        if (!strncmp(cmd, "quit", sizeof(cmd)) || !strncmp(cmd, "q", sizeof(cmd))) {
+            exit(0);
+        }
 
-            if (!strncmp(cmd, "mem", sizeof("mem")-1)) {
-                int addr=0, len=0;
-                sscanf(cmd, "mem %i %i", &addr, &len);
+        if (!strncmp(cmd, "continue", sizeof(cmd)) || !strncmp(cmd, "c", sizeof(cmd))) {
+            break;
+        }
 
-                if (!len) {
-                    printf("memory size should be > 0\n");
-                    continue;
-                }
+        if (!strncmp(cmd, "until ", sizeof("until ")-1)) {
+            int32_t addr;
+            if (!parse_addr(&cmd[sizeof("until ")-1], &addr))
+                continue;
+            debug_point_add(POINT_TEMP, addr, 2);
+            break;
+        }
 
-                dump_mem(addr, len);
+        if (!strncmp(cmd, "break ", sizeof("break ")-1) ||
+            !strncmp(cmd, "b ", sizeof("b ")-1)) {
+            int32_t addr;
+            if (!parse_addr(strchr(cmd, ' ')+1, &addr))
                 continue;
-            }
+            debug_point_add(POINT_BREAK, addr, 2);
+            printf("Breakpoint %d at %08x <%s>\n", point_id, addr, symbol_name(addr));
+            continue;
+        }
 
-            if (!strncmp(cmd, "csrs", sizeof(cmd))) {
-                dump_csrs();
+        if (!strncmp(cmd, "watch ", sizeof("watch ")-1) ||
+            !strncmp(cmd, "rwatch ", sizeof("rwatch ")-1) ||
+            !strncmp(cmd, "awatch ", sizeof("awatch ")-1)) {
+            char name[1024];
+            int32_t addr, len = 4;
+            name[0] = 0;
+            sscanf(strchr(cmd, ' ')+1, "%1023s %i", name, &len);
+            if (!parse_addr(name, &addr))
                 continue;
-            }
+            debug_point_add(cmd[0] == 'r' ? POINT_RWATCH :
+                      cmd[0] == 'a' ? POINT_AWATCH : POINT_WATCH, addr, len);
+            printf("Watchpoint %d at %08x len %d\n", point_id, addr, len);
+            continue;
+        }
+
+        if (!strncmp(cmd, "delete", sizeof("delete")-1)) {
+            int id = 0;
+            sscanf(cmd, "delete %i", &id);
+            delete_point(id);
+            continue;
+        }
+
+        if (!strncmp(cmd, "info", sizeof(cmd))) {
+            list_points();
+            continue;
+        }
 
-            if (!strncmp(cmd, "pc", sizeof(cmd))) {
-                printf("pc %08x\n", pc);
+        if (!strncmp(cmd, "regs", sizeof(cmd))) {
+            dump_regs();
+            continue;
+        }
+
+        if (!strncmp(cmd, "mem", sizeof("mem")-1)) {
+            int addr=0, len=0;
+            sscanf(cmd, "mem %i %i", &addr, &len);
+
+            if (!len) {
+                printf("memory size should be > 0\n");
                 continue;
             }
 
-            if (!strncmp(cmd, "step", sizeof("step")-1)) {
-                count_en = 1;
-                count = 1;
-                sscanf(cmd, "step %i", &count);
+            dump_mem(addr, len);
+            continue;
+        }
+
+        if (!strncmp(cmd, "csrs", sizeof(cmd))) {
+            dump_csrs();
+            continue;
+        }
 
-                if (count > 1)
-                    running = 1;
+        if (!strncmp(cmd, "pc", sizeof(cmd))) {
+            printf("pc %08x\n", pc);
+            continue;
+        }
 
-                break;
-            }
+        if (!strncmp(cmd, "step", sizeof("step")-1)) {
+            long long count = 1;
+            sscanf(cmd, "step %lli", &count);
 
-            if (!strncmp(cmd, "list", sizeof("list")-1)) {
-                int n = 16;
-                int i, addr;
+            if (count < 1)
+                count = 1;
 
-                sscanf(cmd, "list %i", &n);
+            debug_instret = csr.instret.c + count;
 
-                for (i = 0, addr = pc; i < n; i++) {
-                    int inst_len = show_pc(addr);
-                    addr += inst_len;
-                }
+            break;
+        }
 
-                continue;
+        if (!strncmp(cmd, "list", sizeof("list")-1)) {
+            int n = 16;
+            int i, addr;
+
+            sscanf(cmd, "list %i", &n);
+
+            for (i = 0, addr = pc; i < n; i++) {
+                int inst_len = show_pc(addr);
+                addr += inst_len;
             }
 
-            printf("Unknow command %s\n", cmd);
+            continue;
+        }
+
+        printf("Unknow command %s\n", cmd);
 
-        } while(1);
-    }
+    } while(1);
 }
-
@@ -9,6 +9,18 @@
 
 #define PT_LOAD   1
 
+#define SHT_SYMTAB     2
+#define SHF_EXECINSTR  0x4
+#define SHN_UNDEF      0
+#define SHN_ABS        0xfff1
+
+#define STB_GLOBAL     1
+#define STT_NOTYPE     0
+#define STT_FUNC       2
+
+#define ELF32_ST_BIND(i)  ((i)>>4)
+#define ELF32_ST_TYPE(i)  ((i)&0xf)
+
 /* 32-bit ELF base types. */
 typedef unsigned int        Elf32_Addr;
 typedef unsigned short      Elf32_Half;
@@ -67,6 +79,15 @@ typedef struct elf32_phdr {
     Elf32_Word              p_align;
 } Elf32_Phdr;
 
+typedef struct elf32_sym {
+    Elf32_Word              st_name;
+    Elf32_Addr              st_value;
+    Elf32_Word              st_size;
+    unsigned char           st_info;
+    unsigned char           st_other;
+    Elf32_Half              st_shndx;
+} Elf32_Sym;
+
 typedef struct elf64_hdr {
     unsigned char           e_ident[EI_NIDENT];
     Elf64_Half              e_type;
@@ -108,4 +129,11 @@ typedef struct elf64_phdr {
     Elf64_Xword             p_align;
 } Elf64_Phdr;
 
+/* Code symbols returned by elfsymbols(), sorted by address. */
+typedef struct elf_symbol {
+    Elf32_Addr              addr;
+    Elf32_Word              size;
+    char                   *name;
+} ElfSymbol;
+
 #endif // __ELF_H
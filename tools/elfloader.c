@@ -181,6 +181,177 @@ int elfloader(char *file, char *mem,
     return 1;
 }
 
+static int symbol_cmp(const void *a, const void *b)
+{
+    const ElfSymbol *s1 = (const ElfSymbol*)a;
+    const ElfSymbol *s2 = (const ElfSymbol*)b;
+
+    if (s1->addr != s2->addr)
+        return (s1->addr < s2->addr) ? -1 : 1;
+
+    // keep the symbol with a size first when they share the same address
+    return (s1->size > s2->size) ? -1 : (s1->size < s2->size) ? 1 : 0;
+}
+
+static int load_symbols(char *file, ElfSymbol **symbols, int code)
+{
+    FILE *fp;
+    Elf32_Ehdr elf32_header;
+    Elf32_Shdr *shdr = NULL;
+    Elf32_Sym *syms = NULL;
+    char *strtab = NULL;
+    ElfSymbol *list = NULL;
+    int i, j, num, count = 0;
+
+    *symbols = NULL;
+
+    if ((fp = fopen(file, "rb")) == NULL) {
+        printf("Can not open file %s\n", file);
+        return 0;
+    }
+
+    if (!fread(&elf32_header, sizeof(Elf32_Ehdr), 1, fp) ||
+        elf32_header.e_ident[EI_CLASS] != 1 ||
+        elf32_header.e_shnum == 0) {
+        fclose(fp);
+        return 0;
+    }
+
+    if (!(shdr = (Elf32_Shdr*)malloc(sizeof(Elf32_Shdr) * elf32_header.e_shnum))) {
+        // LCOV_EXCL_START
+        goto done;
+        // LCOV_EXCL_STOP
+    }
+
+    fseek(fp, elf32_header.e_shoff, SEEK_SET);
+    if (!fread(shdr, sizeof(Elf32_Shdr) * elf32_header.e_shnum, 1, fp))
+        goto done;
+
+    for(i = 0; i < elf32_header.e_shnum; i++) {
+        Elf32_Shdr *strsec;
+
+        if (shdr[i].sh_type != SHT_SYMTAB || shdr[i].sh_link >= elf32_header.e_shnum)
+            continue;
+
+        strsec = &shdr[shdr[i].sh_link];
+        num    = shdr[i].sh_size / sizeof(Elf32_Sym);
+
+        if (!(syms = (Elf32_Sym*)malloc(shdr[i].sh_size)) ||
+            !(strtab = (char*)malloc(strsec->sh_size)) ||
+            !(list = (ElfSymbol*)malloc(sizeof(ElfSymbol) * num))) {
+            // LCOV_EXCL_START
+            goto done;
+            // LCOV_EXCL_STOP
+        }
+
+        fseek(fp, shdr[i].sh_offset, SEEK_SET);
+        if (!fread(syms, shdr[i].sh_size, 1, fp))
+            goto done;
+
+        fseek(fp, strsec->sh_offset, SEEK_SET);
+        if (!fread(strtab, strsec->sh_size, 1, fp))
+            goto done;
+
+        for(j = 0; j < num; j++) {
+            int type = ELF32_ST_TYPE(syms[j].st_info);
+            int bind = ELF32_ST_BIND(syms[j].st_info);
+
+            if (syms[j].st_shndx == SHN_UNDEF ||
+                (syms[j].st_shndx >= elf32_header.e_shnum &&
+                 (code || syms[j].st_shndx != SHN_ABS)) ||
+                syms[j].st_name >= strsec->sh_size ||
+                !strtab[syms[j].st_name])
+                continue;
+
+            if (code && type != STT_FUNC &&
+                !(type == STT_NOTYPE && bind == STB_GLOBAL &&
+                  (shdr[syms[j].st_shndx].sh_flags & SHF_EXECINSTR)))
+                continue;
+
+            list[count].addr = syms[j].st_value;
+            list[count].size = syms[j].st_size;
+            list[count].name = strdup(&strtab[syms[j].st_name]);
+            count++;
+        }
+        break;
+    }
+
+    if (count) {
+        qsort(list, count, sizeof(ElfSymbol), symbol_cmp);
+
+        // remove the aliases
+        for(i = 1, j = 0; code && i < count; i++) {
+            if (list[i].addr == list[j].addr) {
+                free(list[i].name);
+                continue;
+            }
+            list[++j] = list[i];
+        }
+        if (code) count = j + 1;
+        *symbols = list;
+        list = NULL;
+    }
+
+done:
+    if (list) free(list);
+    if (strtab) free(strtab);
+    if (syms) free(syms);
+    if (shdr) free(shdr);
+    fclose(fp);
+    return count;
+}
+
+// Read the function symbols of the ELF file. Global labels in executable
+// sections are kept too, as the assembly entry points are not typed as
+// functions. Returns the number of symbols, or zero if there is no symbol
+// table.
+int elfsymbols(char *file, ElfSymbol **symbols)
+{
+    return load_symbols(file, symbols, 1);
+}
+
+// Read all the named symbols, including the data objects and the absolute
+// symbols defined by the linker script (e.g. _stack).
+int elfsymbols_all(char *file, ElfSymbol **symbols)
+{
+    return load_symbols(file, symbols, 0);
+}
+
+// Find the symbol that covers the address. The symbol without size covers
+// until the next symbol. Returns -1 if not found.
+int elfsymbol_lookup(ElfSymbol *symbols, int count, unsigned int addr)
+{
+    int lo = 0, hi = count - 1, idx = -1;
+
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (symbols[mid].addr <= addr) {
+            idx = mid;
+            lo  = mid + 1;
+        } else {
+            hi  = mid - 1;
+        }
+    }
+
+    if (idx >= 0 && symbols[idx].size && addr >= symbols[idx].addr + symbols[idx].size)
+        return -1;
+
+    return idx;
+}
+
+// Find the symbol by name. Returns -1 if not found.
+int elfsymbol_find(ElfSymbol *symbols, int count, const char *name)
+{
+    int i;
+
+    for(i = 0; i < count; i++) {
+        if (!strcmp(symbols[i].name, name))
+            return i;
+    }
+
+    return -1;
+}
+
 #if LIBRARY == 0
 int memsize = 256 * 1024;
 
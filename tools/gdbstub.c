@@ -0,0 +1,474 @@
+// Copyright © 2020 Kuoping Hsu
+// gdbstub.c: GDB remote serial protocol stub for ISS
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The stub shares the breakpoints and watchpoints of the interactive debug
+// mode, and it is called by debug() when the simulator stops. While running,
+// the stop of the instruction count is used to poll the socket for Ctrl-C
+// every POLL_INSTS instructions.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "opcode.h"
+
+#define PACKET_SIZE     4096
+#define POLL_INSTS      100000
+
+extern CSR csr;
+extern int32_t pc;
+extern int32_t regs[REGNUM];
+extern int debug_en;
+extern int debug_stop;
+extern long long debug_instret;
+extern int32_t debug_watch_addr;
+extern int debug_watch_type;
+extern uint32_t *bp_map;
+extern int mem_base;
+extern int mem_size;
+
+uint8_t *get_mem(int addr);
+int debug_point_add(int type, int32_t addr, int32_t len);
+int debug_point_remove(int type, int32_t addr, int32_t len);
+
+static int fd = -1;
+static int stepping = 0;
+static int attached = 0;
+static char packet[PACKET_SIZE];
+static char reply[PACKET_SIZE];
+
+static const char *target_xml =
+"<?xml version=\"1.0\"?>"
+"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+"<target version=\"1.0\">"
+"<architecture>riscv:rv32</architecture>"
+"<feature name=\"org.gnu.gdb.riscv.cpu\">"
+"<reg name=\"zero\" bitsize=\"32\" type=\"int\" regnum=\"0\"/>"
+"<reg name=\"ra\" bitsize=\"32\" type=\"code_ptr\"/>"
+"<reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>"
+"<reg name=\"gp\" bitsize=\"32\" type=\"data_ptr\"/>"
+"<reg name=\"tp\" bitsize=\"32\" type=\"data_ptr\"/>"
+"<reg name=\"t0\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"t1\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"t2\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"fp\" bitsize=\"32\" type=\"data_ptr\"/>"
+"<reg name=\"s1\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"a0\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"a1\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"a2\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"a3\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"a4\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"a5\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"a6\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"a7\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"s2\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"s3\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"s4\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"s5\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"s6\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"s7\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"s8\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"s9\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"s10\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"s11\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"t3\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"t4\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"t5\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"t6\" bitsize=\"32\" type=\"int\"/>"
+"<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+"</feature>"
+"</target>";
+
+static int hex(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// registers are sent in the target byte order
+static char *put_reg(char *p, uint32_t val) {
+    int i;
+    for(i = 0; i < 4; i++, val >>= 8)
+        p += sprintf(p, "%02x", val & 0xff);
+    return p;
+}
+
+static uint32_t get_reg(const char *p) {
+    uint32_t val = 0;
+    int i;
+    for(i = 3; i >= 0; i--)
+        val = (val << 8) | (hex(p[i*2]) << 4) | hex(p[i*2+1]);
+    return val;
+}
+
+static int get_char(void) {
+    unsigned char c;
+    if (read(fd, &c, 1) != 1) {
+        printf("gdb connection closed\n");
+        exit(0);
+    }
+    return c;
+}
+
+static void put_packet(const char *data) {
+    char buf[PACKET_SIZE+4];
+    unsigned char sum = 0;
+    int i, len;
+
+    for(i = 0; data[i]; i++)
+        sum += (unsigned char)data[i];
+
+    len = snprintf(buf, sizeof(buf), "$%s#%02x", data, sum);
+
+    do {
+        if (write(fd, buf, len) != len) {
+            printf("gdb connection closed\n");
+            exit(0);
+        }
+    } while(get_char() != '+');
+}
+
+// Returns the packet, or NULL if Ctrl-C is received.
+static char *get_packet(void) {
+    unsigned char sum;
+    int c, len;
+
+    while(1) {
+        while((c = get_char()) != '$') {
+            if (c == 0x03)
+                return NULL;
+        }
+
+        for(len = 0, sum = 0; (c = get_char()) != '#'; sum += c) {
+            if (len < PACKET_SIZE-1)
+                packet[len++] = c;
+        }
+        packet[len] = 0;
+
+        c = hex(get_char()) << 4;
+        c |= hex(get_char());
+
+        if (c == sum) {
+            if (write(fd, "+", 1) != 1)
+                exit(0);
+            return packet;
+        }
+
+        if (write(fd, "-", 1) != 1)
+            exit(0);
+    }
+}
+
+static void read_mem(int32_t addr, int len) {
+    char *p = reply;
+    int i;
+
+    if (len > (PACKET_SIZE-1)/2)
+        len = (PACKET_SIZE-1)/2;
+
+    for(i = 0; i < len; i++) {
+        uint8_t *m = get_mem(addr + i);
+        if (!m) {
+            if (!i) strcpy(reply, "E01");
+            break;
+        }
+        p += sprintf(p, "%02x", *m);
+    }
+}
+
+static void write_mem(int32_t addr, int len, const char *data) {
+    int i;
+
+    for(i = 0; i < len; i++) {
+        uint8_t *m = get_mem(addr + i);
+        if (!m || hex(data[i*2]) < 0 || hex(data[i*2+1]) < 0) {
+            strcpy(reply, "E01");
+            return;
+        }
+        *m = (hex(data[i*2]) << 4) | hex(data[i*2+1]);
+    }
+    strcpy(reply, "OK");
+}
+
+// Z/z packets: type 0,1 breakpoint, 2 write, 3 read, 4 access watchpoint
+static void set_point(int insert, const char *args) {
+    static const int types[] = {
+        POINT_BREAK, POINT_BREAK, POINT_WATCH, POINT_RWATCH, POINT_AWATCH
+    };
+    unsigned int type, addr, len;
+
+    if (sscanf(args, "%x,%x,%x", &type, &addr, &len) != 3 || type > 4) {
+        reply[0] = 0;
+        return;
+    }
+
+    if (type <= 1)
+        len = 2;
+
+    if (insert)
+        strcpy(reply, debug_point_add(types[type], addr, len) ? "OK" : "E01");
+    else
+        strcpy(reply, debug_point_remove(types[type], addr, len) ? "OK" : "E01");
+}
+
+static void xfer_features(const char *args) {
+    unsigned int off, len, size = strlen(target_xml);
+
+    if (strncmp(args, "target.xml:", 11) ||
+        sscanf(args + 11, "%x,%x", &off, &len) != 2) {
+        strcpy(reply, "E00");
+        return;
+    }
+
+    if (len > PACKET_SIZE - 2)
+        len = PACKET_SIZE - 2;
+
+    if (off >= size) {
+        strcpy(reply, "l");
+    } else {
+        reply[0] = (off + len >= size) ? 'l' : 'm';
+        strncpy(&reply[1], target_xml + off, len);
+        reply[1 + ((off + len >= size) ? size - off : len)] = 0;
+    }
+}
+
+static void resume(int step) {
+    stepping = step;
+    debug_stop = 0;
+    debug_instret = csr.instret.c + (step ? 1 : POLL_INSTS);
+}
+
+// The command loop when the simulator stops. It returns to continue.
+static void command_loop(const char *status) {
+    char *p;
+    int i;
+
+    // gdb asks the status by '?' when it attaches
+    if (attached)
+        put_packet(status);
+    attached = 1;
+
+    while(1) {
+        if ((p = get_packet()) == NULL) {
+            put_packet("S02");
+            continue;
+        }
+
+        reply[0] = 0;
+
+        switch(p[0]) {
+            case '?':
+                strcpy(reply, "S05");
+                break;
+            case 'g':
+                for(i = 0, p = reply; i < 32; i++)
+                    p = put_reg(p, i < REGNUM ? regs[i] : 0);
+                put_reg(p, pc);
+                break;
+            case 'G':
+                for(i = 1; i < REGNUM && (int)strlen(p+1) >= (i+1)*8; i++)
+                    regs[i] = get_reg(p + 1 + i*8);
+                if ((int)strlen(p+1) >= 33*8)
+                    pc = get_reg(p + 1 + 32*8);
+                strcpy(reply, "OK");
+                break;
+            case 'p': {
+                unsigned int n = strtoul(p+1, NULL, 16);
+                if (n < 32)
+                    put_reg(reply, n < REGNUM ? regs[n] : 0);
+                else if (n == 32)
+                    put_reg(reply, pc);
+                else
+                    strcpy(reply, "E01");
+                break;
+            }
+            case 'P': {
+                unsigned int n = strtoul(p+1, &p, 16);
+                uint32_t val = get_reg(p+1);
+                if (n > 0 && n < REGNUM)
+                    regs[n] = val;
+                else if (n == 32)
+                    pc = val;
+                strcpy(reply, "OK");
+                break;
+            }
+            case 'm': {
+                unsigned int addr, len;
+                if (sscanf(p+1, "%x,%x", &addr, &len) == 2)
+                    read_mem(addr, len);
+                else
+                    strcpy(reply, "E01");
+                break;
+            }
+            case 'M': {
+                unsigned int addr, len;
+                char *data = strchr(p, ':');
+                if (data && sscanf(p+1, "%x,%x", &addr, &len) == 2)
+                    write_mem(addr, len, data+1);
+                else
+                    strcpy(reply, "E01");
+                break;
+            }
+            case 'c':
+            case 's':
+                if (p[1])
+                    pc = strtoul(p+1, NULL, 16);
+                resume(p[0] == 's');
+                return;
+            case 'Z':
+            case 'z':
+                set_point(p[0] == 'Z', p+1);
+                break;
+            case 'H':
+                strcpy(reply, "OK");
+                break;
+            case 'k':
+                exit(0);
+            case 'D':
+                put_packet("OK");
+                close(fd);
+                fd = -1;
+                debug_en = 0;
+                return;
+            case 'q':
+                if (!strncmp(p, "qSupported", 10))
+                    snprintf(reply, sizeof(reply),
+                             "PacketSize=%x;qXfer:features:read+;swbreak+;hwbreak+",
+                             PACKET_SIZE);
+                else if (!strncmp(p, "qXfer:features:read:", 20))
+                    xfer_features(p + 20);
+                else if (!strcmp(p, "qAttached"))
+                    strcpy(reply, "1");
+                break;
+        }
+
+        put_packet(reply);
+    }
+}
+
+void gdbstub_init(char *port) {
+    int sock, on = 1;
+    char *end;
+    long n = strtol(port, &end, 10);
+
+    if (*end == 0) {
+        struct sockaddr_in addr;
+
+        if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+            printf("can not create socket\n");
+            exit(1);
+        }
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(n);
+        if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            printf("can not bind port %s\n", port);
+            exit(1);
+        }
+    } else {
+        struct sockaddr_un addr;
+
+        if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+            printf("can not create socket\n");
+            exit(1);
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, port, sizeof(addr.sun_path)-1);
+        unlink(port);
+        if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            printf("can not bind %s\n", port);
+            exit(1);
+        }
+    }
+
+    listen(sock, 1);
+    printf("Waiting for gdb connection on %s\n", port);
+    fflush(stdout);
+
+    if ((fd = accept(sock, NULL, NULL)) < 0) {
+        printf("accept fail\n");
+        exit(1);
+    }
+    close(sock);
+
+    if (*end == 0)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    // stop at the first instruction
+    debug_stop = 1;
+    stepping = 1;
+}
+
+// called by debug() when the simulator stops
+void gdbstub_stop(void) {
+    char status[32];
+
+    debug_stop = 0;
+    debug_instret = 0;
+
+    if (debug_watch_type) {
+        snprintf(status, sizeof(status), "T05%swatch:%08x;",
+                 debug_watch_type == POINT_RWATCH ? "r" :
+                 debug_watch_type == POINT_AWATCH ? "a" : "",
+                 debug_watch_addr);
+        debug_watch_addr = 0;
+        debug_watch_type = 0;
+    } else if (BREAKPOINT(bp_map, pc)) {
+        strcpy(status, "T05swbreak:;");
+    } else if (stepping) {
+        strcpy(status, "S05");
+    } else {
+        // poll for Ctrl-C, and keep running if not
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        unsigned char c = 0;
+
+        if (poll(&pfd, 1, 0) <= 0 || read(fd, &c, 1) != 1 || c != 0x03) {
+            debug_instret = csr.instret.c + POLL_INSTS;
+            return;
+        }
+        strcpy(status, "S02");
+    }
+
+    command_loop(status);
+}
+
+void gdbstub_exit(int code) {
+    char status[8];
+
+    if (fd < 0)
+        return;
+
+    snprintf(status, sizeof(status), "W%02x", code & 0xff);
+    put_packet(status);
+    close(fd);
+}
@@ -0,0 +1,298 @@
+// Copyright © 2020 Kuoping Hsu
+// heatmap.c: memory access heatmap and working set analysis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// IMEM and DMEM are contiguous, so one table of lines covers both. Each line
+// is stamped with the interval number when it is touched, and the working
+// set of an interval is the number of lines stamped in that interval.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "opcode.h"
+#include "elf.h"
+
+#define LINE_BITS       5
+#define LINE_SIZE       (1 << LINE_BITS)
+#define HEATMAP_VERSION 1
+
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+extern int32_t regs[REGNUM];
+extern int *dmem;
+extern int mem_base;
+extern int mem_size;
+extern int quiet;
+
+int elfsymbols_all(char *file, ElfSymbol **symbols);
+int elfsymbol_find(ElfSymbol *symbols, int count, const char *name);
+
+typedef struct {
+    long long   fetch;
+    long long   read;
+    long long   write;
+    uint32_t    epoch;
+} LINE;
+
+// file format, all fields are 32-bit little endian
+typedef struct {
+    char        magic[4];   // "RVHM"
+    uint32_t    version;
+    uint32_t    line_size;
+    uint32_t    interval;   // instructions per interval
+    uint32_t    imem_base;
+    uint32_t    dmem_base;
+    uint32_t    mem_size;   // size of IMEM, and DMEM
+    uint32_t    nlines;     // number of LINE_RECORD
+    uint32_t    nintervals; // number of INTERVAL_RECORD
+    uint32_t    stack_top;
+    uint32_t    stack_max;  // stack high-water mark in bytes
+    uint32_t    heap_base;
+    uint32_t    heap_max;   // heap size in bytes
+} HEADER;
+
+typedef struct {
+    uint32_t    addr;
+    uint32_t    fetch;      // saturated counts
+    uint32_t    read;
+    uint32_t    write;
+} LINE_RECORD;
+
+typedef struct {
+    uint32_t    imem;       // working set in lines
+    uint32_t    dmem;
+    uint32_t    stack;      // stack depth in bytes
+    uint32_t    heap;       // heap size in bytes
+} INTERVAL_RECORD;
+
+static LINE *lines = NULL;
+static uint32_t nlines = 0;
+static uint32_t imem_lines = 0;
+static char *outfile = NULL;
+
+static INTERVAL_RECORD *intervals = NULL;
+static int nintervals = 0;
+static int maxintervals = 0;
+static INTERVAL_RECORD cur;
+static uint32_t epoch = 1;
+static int interval = 100000;
+static int insts = 0;
+
+static int32_t stack_top = 0;
+static int32_t stack_min = 0;
+static int32_t heap_ptr = 0;    // address of heap_ptr in syscall.c
+static int32_t heap_base = 0;
+static int32_t heap_top = 0;
+static int32_t heap_max = 0;
+
+void heatmap_init(char *elf, char *file, int n) {
+    ElfSymbol *symbols = NULL;
+    int count, i;
+
+    outfile = file;
+    if (n > 0)
+        interval = n;
+
+    nlines = (mem_size * 2) >> LINE_BITS;
+    imem_lines = mem_size >> LINE_BITS;
+    if ((lines = (LINE*)calloc(nlines, sizeof(LINE))) == NULL) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(1);
+        // LCOV_EXCL_STOP
+    }
+
+    count = elfsymbols_all(elf, &symbols);
+    if ((i = elfsymbol_find(symbols, count, "_stack")) >= 0)
+        stack_top = symbols[i].addr;
+    if ((i = elfsymbol_find(symbols, count, "_end")) >= 0)
+        heap_base = heap_top = symbols[i].addr;
+    if ((i = elfsymbol_find(symbols, count, "heap_ptr")) >= 0)
+        heap_ptr = symbols[i].addr;
+    stack_min = stack_top;
+
+    for(i = 0; i < count; i++)
+        free(symbols[i].name);
+    if (symbols)
+        free(symbols);
+
+    if (!stack_top && !quiet)
+        printf("Warning: no _stack symbol, the stack is not tracked\n");
+}
+
+static void interval_end(void) {
+    if (nintervals == maxintervals) {
+        maxintervals = maxintervals ? maxintervals * 2 : 1024;
+        if ((intervals = (INTERVAL_RECORD*)realloc(intervals,
+                          maxintervals * sizeof(INTERVAL_RECORD))) == NULL) {
+            // LCOV_EXCL_START
+            printf("malloc fail\n");
+            exit(1);
+            // LCOV_EXCL_STOP
+        }
+    }
+
+    cur.heap = heap_top - heap_base;
+    intervals[nintervals++] = cur;
+    memset(&cur, 0, sizeof(cur));
+    epoch++;
+    insts = 0;
+}
+
+static inline void touch(LINE *line, uint32_t idx) {
+    if (line->epoch != epoch) {
+        line->epoch = epoch;
+        if (idx < imem_lines)
+            cur.imem++;
+        else
+            cur.dmem++;
+    }
+}
+
+void heatmap_fetch(int32_t pc) {
+    uint32_t idx = (uint32_t)(pc - mem_base) >> LINE_BITS;
+    int32_t sp = regs[SP];
+
+    if (idx < nlines) {
+        lines[idx].fetch++;
+        touch(&lines[idx], idx);
+    }
+
+    // only the sp between the heap and _stack is the main stack, the task
+    // stacks of FreeRTOS are not.
+    if (sp > heap_top && sp <= stack_top) {
+        if (sp < stack_min)
+            stack_min = sp;
+        if (stack_top - sp > (int32_t)cur.stack)
+            cur.stack = stack_top - sp;
+    }
+
+    if (++insts == interval)
+        interval_end();
+}
+
+void heatmap_access(int32_t address, int write) {
+    uint32_t idx = (uint32_t)(address - mem_base) >> LINE_BITS;
+
+    if (idx >= nlines)
+        return;
+
+    if (write) {
+        lines[idx].write++;
+        if (heap_ptr && (address & ~3) == heap_ptr) {
+            heap_top = dmem[DVA2PA(heap_ptr)/4];
+            if (heap_top - heap_base > heap_max)
+                heap_max = heap_top - heap_base;
+        }
+    } else {
+        lines[idx].read++;
+    }
+    touch(&lines[idx], idx);
+}
+
+static uint32_t saturate(long long n) {
+    return n > 0xffffffffLL ? 0xffffffff : (uint32_t)n;
+}
+
+void heatmap_exit(void) {
+    FILE *fp;
+    HEADER header;
+    LINE_RECORD rec;
+    int used[2] = {0, 0}, written = 0, extent[2] = {0, 0};
+    long long sum[2] = {0, 0};
+    int peak[2] = {0, 0};
+    int i;
+
+    if (insts)
+        interval_end();
+
+    for(i = 0; i < nlines; i++) {
+        int r = (i >= imem_lines);
+        if (!lines[i].fetch && !lines[i].read && !lines[i].write)
+            continue;
+        used[r]++;
+        if (r && lines[i].write)
+            written++;
+        extent[r] = (i - (r ? imem_lines : 0) + 1) * LINE_SIZE;
+    }
+
+    for(i = 0; i < nintervals; i++) {
+        sum[0] += intervals[i].imem;
+        sum[1] += intervals[i].dmem;
+        peak[0] = MAX(peak[0], (int)intervals[i].imem);
+        peak[1] = MAX(peak[1], (int)intervals[i].dmem);
+    }
+
+    if ((fp = fopen(outfile, "wb")) == NULL) {
+        printf("can not open file %s\n", outfile);
+    } else {
+        memcpy(header.magic, "RVHM", 4);
+        header.version    = HEATMAP_VERSION;
+        header.line_size  = LINE_SIZE;
+        header.interval   = interval;
+        header.imem_base  = IMEM_BASE;
+        header.dmem_base  = DMEM_BASE;
+        header.mem_size   = mem_size;
+        header.nlines     = used[0] + used[1];
+        header.nintervals = nintervals;
+        header.stack_top  = stack_top;
+        header.stack_max  = stack_top - stack_min;
+        header.heap_base  = heap_base;
+        header.heap_max   = heap_max;
+        fwrite(&header, sizeof(header), 1, fp);
+
+        for(i = 0; i < nlines; i++) {
+            if (!lines[i].fetch && !lines[i].read && !lines[i].write)
+                continue;
+            rec.addr  = mem_base + (i << LINE_BITS);
+            rec.fetch = saturate(lines[i].fetch);
+            rec.read  = saturate(lines[i].read);
+            rec.write = saturate(lines[i].write);
+            fwrite(&rec, sizeof(rec), 1, fp);
+        }
+
+        fwrite(intervals, sizeof(INTERVAL_RECORD), nintervals, fp);
+        fclose(fp);
+    }
+
+    if (quiet)
+        return;
+
+    printf("\nMemory footprint (%d-byte lines, %d intervals of %d instructions)\n",
+           LINE_SIZE, nintervals, interval);
+    printf("%-6s %12s %12s %16s %16s\n",
+           "memory", "touched", "extent", "peak working set", "avg working set");
+    for(i = 0; i < 2; i++) {
+        printf("%-6s %12d %12d %16d %16lld\n", i ? "DMEM" : "IMEM",
+               used[i] * LINE_SIZE, extent[i], peak[i] * LINE_SIZE,
+               nintervals ? sum[i] * LINE_SIZE / nintervals : 0);
+    }
+    printf("DMEM written      : %d bytes\n", written * LINE_SIZE);
+    printf("Stack high-water  : %d bytes (sp 0x%08x, _stack 0x%08x)\n",
+           stack_top - stack_min, stack_min, stack_top);
+    if (heap_ptr)
+        printf("Heap              : %d bytes (0x%08x - 0x%08x)\n",
+               heap_max, heap_base, heap_base + heap_max);
+    else
+        printf("Heap              : no heap_ptr symbol\n");
+    printf("Heatmap is written to %s\n", outfile);
+}
@@ -35,7 +35,16 @@
 extern int *dmem;
 extern int mem_base;
 extern int mem_size;
+extern int lockstep;
 void prog_exit(int exitcode);
+void console_flush(void);
+void console_write(const char *buf, int len);
+int host_writev(int fd, int32_t iov, int count);
+int host_fstat(int fd, int32_t buf);
+int host_gettimeofday(int32_t buf);
+int host_times(int32_t buf);
+void host_dump(int32_t start, int32_t end);
+void host_dump_bin(int32_t start, int32_t end);
 
 static int result = 0;
 
@@ -45,79 +54,96 @@ int srv32_fromhost(
     return result;
 }
 
-void srv32_tohost(
-    int32_t htif_mem)
+static int htif_call(
+    int func, int a0, int a1, int a2)
 {
     char *ptr = (char*)dmem;
-    int *htifMem = (int*)&ptr[DVA2PA(htif_mem)];
-
-    int func = htifMem[0];
-    int a0   = htifMem[1];
-    int a1   = htifMem[2];
-    int a2   = htifMem[3];
-    //int a3   = htifMem[4];
-    //int a4   = htifMem[5];
-    //int a5   = htifMem[6];
-    //int a6   = htifMem[7];
+    int res = -1;
 
     switch(func) {
        case SYS_OPEN:
-           result = (int)open((const char*)(&ptr[DVA2PA(a0)]),
-                              O_RDWR | O_CREAT /* a1 */,
-                              S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH /* a2 */ );
+           res = (int)open((const char*)(&ptr[DVA2PA(a0)]),
+                           O_RDWR | O_CREAT /* a1 */,
+                           S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH /* a2 */ );
            break;
        case SYS_CLOSE:
-           result = (int)close(a0);
+           res = (int)close(a0);
            break;
        case SYS_LSEEK:
-           result = (int)lseek(a0, a1, a2);
+           res = (int)lseek(a0, a1, a2);
            break;
        case SYS_EXIT:
-           result = 0;
+           res = 0;
            prog_exit(a0);
            break;
        case SYS_READ:
-           result = (int)read(a0, (void *)(&ptr[DVA2PA(a1)]), a2);
+           if (a0 == STDIN)
+               console_flush();
+           res = (int)read(a0, (void *)(&ptr[DVA2PA(a1)]), a2);
            break;
        case SYS_WRITE:
-           result = (int)write(a0, (const char*)(&ptr[DVA2PA(a1)]), a2);
-           break;
-       case SYS_DUMP: {
-               FILE *fp;
-               int i;
-               if ((fp = fopen("dump.txt", "w")) == NULL) {
-                   printf("Create dump.txt fail\n");
-                   exit(1);
-               }
-               if ((a0 & 3) != 0 || (a1 & 3) != 0) {
-                   printf("Alignment error on memory dumping.\n");
-                   exit(1);
-               }
-               for(i = DVA2PA(a0)/4;
-                   i < DVA2PA(a1)/4; i++) {
-                   fprintf(fp, "%08x\n", dmem[i]);
-               }
-               fclose(fp);
+           if (a0 == STDOUT) {
+               console_write((const char*)(&ptr[DVA2PA(a1)]), a2);
+               res = a2;
+           } else {
+               res = (int)write(a0, (const char*)(&ptr[DVA2PA(a1)]), a2);
            }
-           result = 0;
            break;
-       case SYS_DUMP_BIN: {
-               FILE *fp;
-               int i;
-               if ((fp = fopen("dump.bin", "wb")) == NULL) {
-                   printf("Create dump.bin fail\n");
-                   exit(1);
-               }
-               for(i = DVA2PA(a0);
-                   i < DVA2PA(a1); i++) {
-                   fprintf(fp, "%c", (dmem[i/4]>>((i%4)*8))&0xff);
+       case SYS_WRITEV:
+           res = host_writev(a0, a1, a2);
+           break;
+       case SYS_FSTAT:
+           res = host_fstat(a0, a1);
+           break;
+       case SYS_GETTIMEOFDAY:
+           res = host_gettimeofday(a0);
+           break;
+       case SYS_TIMES:
+           res = host_times(a0);
+           break;
+       case SYS_DUMP:
+           host_dump(a0, a1);
+           res = 0;
+           break;
+       case SYS_DUMP_BIN:
+           host_dump_bin(a0, a1);
+           res = 0;
+           break;
+       case SYS_BATCH: {
+               int32_t *call = (int32_t*)&ptr[DVA2PA(a0)];
+               for(res = 0; res < a1; res++, call += BATCH_WORDS) {
+                   if (call[0] == SYS_BATCH)
+                       break;
+                   call[7] = htif_call(call[0], call[1], call[2], call[3]);
                }
-               fclose(fp);
            }
-           result = 0;
            break;
        default:
+           res = result;
            break;
     }
+    return res;
 }
 
+void srv32_tohost(
+    int32_t htif_mem)
+{
+    char *ptr = (char*)dmem;
+    int *htifMem = (int*)&ptr[DVA2PA(htif_mem)];
+
+    int func = htifMem[0];
+    int a0   = htifMem[1];
+    int a1   = htifMem[2];
+    int a2   = htifMem[3];
+    //int a3   = htifMem[4];
+    //int a4   = htifMem[5];
+    //int a5   = htifMem[6];
+    //int a6   = htifMem[7];
+
+    // the RTL testbench does the I/O in lockstep, the result is read back
+    // from the RTL, and the buffers are copied by lockstep_fromhost()
+    if (lockstep && func != SYS_EXIT)
+        return;
+
+    result = htif_call(func, a0, a1, a2);
+}
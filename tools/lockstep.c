@@ -0,0 +1,253 @@
+// Copyright © 2020 Kuoping Hsu
+// lockstep.c: lockstep co-simulation of the ISS with the RTL
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The RTL testbench calls lockstep_retire() through DPI whenever an
+// instruction retires, at the same point where trace.log is written. The ISS
+// executes one instruction and compares the PC, the instruction, the written
+// register and the store. The RTL does all of the I/O, so the ISS takes the
+// values of MMIO loads from the RTL and does not touch the console. The host
+// call of an ecall is done once by the testbench, which gives its result by
+// lockstep_syscall() before the ecall retires, and the ISS takes the result.
+// The buffers written by the host calls of the ecall and HTIF are copied from
+// the DMEM of the RTL, at the ecall, and at the load of FROMHOST after the
+// store to TOHOST.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "opcode.h"
+#include "riscv-disas.h"
+
+#define CONTEXT     16      // instructions in the context dump
+
+extern CSR csr;
+extern int32_t regs[REGNUM];
+extern char *regname[32];
+extern RETIRE retire;
+extern int lockstep;
+extern int32_t lockstep_rdata;
+extern int *dmem;
+extern int mem_size;
+extern int mem_base;
+extern int singleram;
+extern int quiet;
+
+void rvsim_init(char *file);
+int rvsim_step(void);
+
+typedef struct {
+    RETIRE      r;
+    int32_t     result;     // the value of the written register
+} HISTORY;
+
+static HISTORY history[CONTEXT];
+static int nhistory = 0;
+static int terminated = 0;
+static int32_t sysres = -1;
+static char *rtl_dmem = NULL;
+static int32_t tohost[4];       // the pending HTIF call, func, a0, a1, a2
+static int tohost_valid = 0;
+
+void lockstep_init(char *elf, int memsize, char *rtl_mem) {
+    rtl_dmem = rtl_mem;
+    mem_size = memsize * 1024;
+    lockstep = 1;
+    quiet = 1;
+#ifdef SINGLE_RAM
+    singleram = 1;
+#endif
+    rvsim_init(elf);
+}
+
+// copy len bytes at address of DMEM from the RTL
+static void sync_mem(int32_t address, int len) {
+    uint32_t offset = (uint32_t)DVA2PA(address);
+
+    if (len <= 0 || offset >= (uint32_t)DMEM_SIZE ||
+        (uint32_t)len > (uint32_t)DMEM_SIZE - offset)
+        return;
+
+    memcpy((char*)dmem + offset, rtl_dmem + offset, len);
+}
+
+// the buffers written by the host call, see the arguments in opcode.h
+static void sync_call(int func, int a0, int a1, int a2) {
+    int32_t address;
+    int i;
+
+    switch(func) {
+        case SYS_READ:
+            sync_mem(a1, a2);
+            break;
+        case SYS_FSTAT:
+            sync_mem(a1, 2 * 4);
+            break;
+        case SYS_GETTIMEOFDAY:
+            sync_mem(a0, 2 * 4);
+            break;
+        case SYS_TIMES:
+            sync_mem(a0, 4 * 4);
+            break;
+        case SYS_BATCH:
+            for(i = 0, address = a0; i < a1; i++, address += BATCH_WORDS * 4) {
+                uint32_t offset = (uint32_t)DVA2PA(address);
+                int32_t *call;
+
+                if (offset > (uint32_t)DMEM_SIZE - BATCH_WORDS * 4)
+                    break;
+                call = (int32_t*)((char*)dmem + offset);
+                if (call[0] == SYS_BATCH)
+                    break;
+                sync_mem(address + 7 * 4, 4);
+                sync_call(call[0], call[1], call[2], call[3]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// the result of the host call of the RTL
+void lockstep_syscall(int res) {
+    sysres = res;
+}
+
+// the host call of the ecall of the ISS, done by the RTL
+int lockstep_host(int func, int a0, int a1, int a2) {
+    sync_call(func, a0, a1, a2);
+    return sysres;
+}
+
+// the HTIF call of the ISS, done by the RTL before its load of FROMHOST
+void lockstep_tohost(int32_t ptr) {
+    uint32_t offset = (uint32_t)DVA2PA(ptr);
+
+    if (offset > (uint32_t)DMEM_SIZE - 4 * 4)
+        return;
+
+    memcpy(tohost, (char*)dmem + offset, sizeof(tohost));
+    tohost_valid = 1;
+}
+
+void lockstep_fromhost(void) {
+    if (tohost_valid)
+        sync_call(tohost[0], tohost[1], tohost[2], tohost[3]);
+    tohost_valid = 0;
+}
+
+// the store data on the byte lanes of the RTL
+static int32_t store_data(int strb, int32_t data) {
+    switch(strb) {
+        case 0x1: return data & 0xff;
+        case 0x2: return (data >> 8) & 0xff;
+        case 0x4: return (data >> 16) & 0xff;
+        case 0x8: return (data >> 24) & 0xff;
+        case 0x3: return data & 0xffff;
+        case 0xc: return (data >> 16) & 0xffff;
+        default:  return data;
+    }
+}
+
+static void print_retire(const char *who, int32_t pc, int32_t inst,
+                         int rd, int32_t result,
+                         int store, int32_t address, int32_t data) {
+    char buf[80] = {0};
+
+    disasm_inst(buf, sizeof(buf), rv32, pc, (uint32_t)inst);
+    printf("%-4s %08x %-56s", who, pc, buf);
+    if (rd >= 0)
+        printf(" x%02d (%s) <= 0x%08x", rd, regname[rd], result);
+    if (store)
+        printf(" write 0x%08x <= 0x%08x", address, data);
+    printf("\n");
+}
+
+static void dump(void) {
+    int i = nhistory > CONTEXT ? nhistory - CONTEXT : 0;
+
+    printf("\nLast %d instructions of the ISS\n", nhistory - i);
+    for(; i < nhistory; i++) {
+        HISTORY *h = &history[i % CONTEXT];
+        print_retire("", h->r.pc, h->r.inst, h->r.rd, h->result,
+                     h->r.store, h->r.address, h->r.data);
+    }
+
+    printf("\nRegisters of the ISS\n");
+    for(i = 0; i < REGNUM; i++) {
+        printf("x%02d %-6s 0x%08x%s", i, regname[i], regs[i],
+               (i % 4) == 3 ? "\n" : "   ");
+    }
+    printf("mstatus 0x%08x mepc 0x%08x mcause 0x%08x mtval 0x%08x\n",
+           csr.mstatus, csr.mepc, csr.mcause, csr.mtval);
+}
+
+// Return 0 if the RTL matches the ISS
+int lockstep_retire(int pc, int insn,
+                    int rd_valid, int rd, int rd_data,
+                    int st_valid, int st_addr, int st_strb, int st_data) {
+    HISTORY *h;
+    int32_t data = store_data(st_strb, st_data);
+    int mismatch;
+
+    if (terminated) {
+        printf("\nLockstep: the ISS has terminated, but the RTL retires\n");
+        print_retire("RTL", pc, insn, rd_valid ? rd : -1, rd_data,
+                     st_valid, st_addr, data);
+        dump();
+        return 1;
+    }
+
+    lockstep_rdata = rd_data;
+    if (!rvsim_step())
+        terminated = 1;
+
+    h = &history[nhistory++ % CONTEXT];
+    h->r = retire;
+    h->result = retire.rd >= 0 ? regs[retire.rd] : 0;
+
+    mismatch = (pc != retire.pc) || (insn != retire.inst);
+
+    // the syscall of the RTL writes a0 without the write back
+    if (rd_valid)
+        mismatch |= (rd != retire.rd) || (rd_data != h->result);
+    else if (retire.rd > 0 && (retire.inst & 0x7f) != OP_SYSTEM)
+        mismatch = 1;
+
+    if (st_valid)
+        mismatch |= !retire.store || (st_addr != retire.address) ||
+                    (data != retire.data);
+    else if (retire.store)
+        mismatch = 1;
+
+    if (!mismatch)
+        return 0;
+
+    printf("\nLockstep mismatch at instruction %lld\n", csr.instret.c);
+    print_retire("RTL", pc, insn, rd_valid ? rd : -1, rd_data,
+                 st_valid, st_addr, data);
+    print_retire("ISS", retire.pc, retire.inst, retire.rd, h->result,
+                 retire.store, retire.address, retire.data);
+    dump();
+
+    return 1;
+}
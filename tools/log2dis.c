@@ -0,0 +1,342 @@
+// Copyright © 2020 Kuoping Hsu
+// log2dis.c: annotate the trace log with the disassembly
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The trace is memory mapped and cut into blocks at the line boundaries. The
+// threads annotate the blocks of a round into their own buffers, which are
+// written in order. The disassembly of each PC is done once and cached; the
+// threads may race to fill an entry, and the loser frees its copy.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "riscv-disas.h"
+
+#define BLOCK_SIZE      (4*1024*1024)   // bytes of the trace per thread
+#define MAX_THREADS     64
+#define COLUMN          74              // column of the disassembly
+
+int elfloader(char *file, char *mem, int imem_base, int dmem_base, int imem_size, int dmem_size);
+
+typedef struct {
+    const char  *begin;
+    const char  *end;
+    char        *buf;
+    size_t      len;
+    size_t      size;
+    long long   lines;
+} JOB;
+
+static char *mem = NULL;
+static int mem_base = 0;
+static int mem_size = 256*1024;
+static const char **cache = NULL;
+
+void usage(void) {
+    printf(
+"Annotate the trace log with the disassembly\n"
+"Usage: log2dis [-h] [-q] [-j n] [-m n] [-n n] trace.log file.elf\n\n"
+"       --help, -h              help\n"
+"       --quiet, -q             no progress\n"
+"       --jobs n, -j n          number of threads (default the number of CPUs)\n"
+"       --membase n, -m n       memory base\n"
+"       --memsize n, -n n       memory size (in Kb, default 256)\n"
+"\n"
+"       The output is written to trace.log.dis\n"
+"\n"
+    );
+}
+
+static const char *disasm(uint32_t pc) {
+    const char *s, *old;
+    char buf[80] = {0};
+    char *p;
+    int n;
+
+    // the offset in IMEM
+    pc -= mem_base;
+    if (pc >= (uint32_t)mem_size)
+        return NULL;
+
+    if ((s = __atomic_load_n(&cache[pc >> 1], __ATOMIC_ACQUIRE)) != NULL)
+        return s;
+
+    disasm_inst(buf, sizeof(buf), rv32, pc + mem_base, *(uint32_t*)&mem[pc]);
+
+    // skip the instruction code, and the trailing spaces
+    p = buf;
+    while(*p && *p != ' ')
+        p++;
+    while(*p == ' ')
+        p++;
+    n = strlen(p);
+    while(n > 0 && p[n-1] == ' ')
+        p[--n] = 0;
+
+    if ((s = strdup(p)) == NULL) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(1);
+        // LCOV_EXCL_STOP
+    }
+
+    old = NULL;
+    if (!__atomic_compare_exchange_n(&cache[pc >> 1], &old, s, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free((void*)s);
+        s = old;
+    }
+    return s;
+}
+
+static void append(JOB *job, const char *s, size_t len) {
+    if (job->len + len > job->size) {
+        job->size = (job->len + len) * 2;
+        if ((job->buf = (char*)realloc(job->buf, job->size)) == NULL) {
+            // LCOV_EXCL_START
+            printf("malloc fail\n");
+            exit(1);
+            // LCOV_EXCL_STOP
+        }
+    }
+    memcpy(job->buf + job->len, s, len);
+    job->len += len;
+}
+
+static int is_hex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+           (c >= 'A' && c <= 'F');
+}
+
+// the same as /^\s+(\d+)\s+([0-9a-fA-F]+)/ of log2dis.pl
+static int parse_pc(const char *p, const char *end, uint32_t *pc) {
+    const char *q = p;
+
+    while(q < end && (*q == ' ' || *q == '\t'))
+        q++;
+    if (q == p || q == end || *q < '0' || *q > '9')
+        return 0;
+    while(q < end && *q >= '0' && *q <= '9')
+        q++;
+    p = q;
+    while(q < end && (*q == ' ' || *q == '\t'))
+        q++;
+    if (q == p || q == end || !is_hex(*q))
+        return 0;
+
+    *pc = 0;
+    while(q < end && is_hex(*q)) {
+        *pc = (*pc << 4) | (*q <= '9' ? *q - '0' : (*q | 0x20) - 'a' + 10);
+        q++;
+    }
+    return 1;
+}
+
+static void *annotate(void *arg) {
+    static const char spaces[COLUMN+1] =
+        "                                                                          ";
+    JOB *job = (JOB*)arg;
+    const char *p = job->begin;
+
+    job->len = 0;
+    job->lines = 0;
+
+    while(p < job->end) {
+        const char *eol = memchr(p, '\n', job->end - p);
+        const char *s;
+        uint32_t pc;
+        size_t len;
+
+        if (eol == NULL)
+            eol = job->end;
+        len = eol - p;
+
+        if (parse_pc(p, eol, &pc)) {
+            append(job, p, len);
+            if ((s = disasm(pc)) != NULL) {
+                append(job, spaces, len < COLUMN ? COLUMN - len : 1);
+                append(job, "; ", 2);
+                append(job, s, strlen(s));
+            }
+            append(job, "\n", 1);
+            job->lines++;
+        }
+        p = eol + 1;
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    JOB jobs[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    struct stat st;
+    char *trace, *out;
+    const char *base, *p, *end;
+    FILE *fo;
+    int fd;
+    int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int verbose = 1;
+    long long lines = 0;
+    int c, i;
+
+    const char *optstring = "hqj:m:n:";
+    struct option opts[] = {
+        {"help", 0, NULL, 'h'},
+        {"quiet", 0, NULL, 'q'},
+        {"jobs", 1, NULL, 'j'},
+        {"membase", 1, NULL, 'm'},
+        {"memsize", 1, NULL, 'n'},
+        {NULL, 0, NULL, 0}
+    };
+
+    while((c = getopt_long(argc, argv, optstring, opts, NULL)) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                return 0;
+            case 'q':
+                verbose = 0;
+                break;
+            case 'j':
+                nthreads = atoi(optarg);
+                break;
+            case 'm':
+                sscanf(optarg, "%i", &mem_base);
+                break;
+            case 'n':
+                sscanf(optarg, "%i", &mem_size);
+                mem_size *= 1024;
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    if (optind + 2 != argc) {
+        usage();
+        return 1;
+    }
+
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+
+    trace = argv[optind];
+
+    // IMEM and DMEM, and the padding for the fetch at the end
+    if ((mem = (char*)calloc(mem_size * 2 + 4, 1)) == NULL ||
+        (cache = (const char**)calloc(mem_size / 2, sizeof(char*))) == NULL) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(1);
+        // LCOV_EXCL_STOP
+    }
+
+    if (elfloader(argv[optind+1], mem, mem_base, mem_base + mem_size,
+                  mem_size, mem_size) == 0) {
+        printf("Can not read elf file %s\n", argv[optind+1]);
+        exit(1);
+    }
+
+    if ((fd = open(trace, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        printf("can not open file %s\n", trace);
+        exit(1);
+    }
+
+    base = NULL;
+    if (st.st_size) {
+        if ((base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+            printf("can not map file %s\n", trace);
+            exit(1);
+        }
+        madvise((void*)base, st.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    if ((out = (char*)malloc(strlen(trace) + 5)) == NULL) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(1);
+        // LCOV_EXCL_STOP
+    }
+    sprintf(out, "%s.dis", trace);
+    if ((fo = fopen(out, "w")) == NULL) {
+        printf("can not open file %s\n", out);
+        exit(1);
+    }
+
+    memset(jobs, 0, sizeof(jobs));
+    p = base;
+    end = base + st.st_size;
+
+    while(p < end) {
+        int n;
+
+        // cut the blocks at the line boundaries
+        for(n = 0; n < nthreads && p < end; n++) {
+            const char *e = (end - p > BLOCK_SIZE) ? p + BLOCK_SIZE : end;
+            while(e < end && e[-1] != '\n')
+                e++;
+            jobs[n].begin = p;
+            jobs[n].end = e;
+            p = e;
+        }
+
+        if (n == 1) {
+            annotate(&jobs[0]);
+        } else {
+            for(i = 0; i < n; i++)
+                pthread_create(&threads[i], NULL, annotate, &jobs[i]);
+            for(i = 0; i < n; i++)
+                pthread_join(threads[i], NULL);
+        }
+
+        for(i = 0; i < n; i++) {
+            fwrite(jobs[i].buf, 1, jobs[i].len, fo);
+            if (verbose) {
+                long long k;
+                for(k = lines / 100000 + 1; k <= (lines + jobs[i].lines) / 100000; k++)
+                    printf(".");
+                fflush(stdout);
+            }
+            lines += jobs[i].lines;
+        }
+    }
+
+    if (verbose)
+        printf("Done.\n");
+
+    fclose(fo);
+    if (base)
+        munmap((void*)base, st.st_size);
+
+    return 0;
+}
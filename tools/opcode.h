@@ -275,6 +275,8 @@ enum {
     OP_REMU    = 7
 };
 
+#define INST_WFI   0x10500073
+
 enum {
     OP_ECALL   = 0,
     OP_CSRRW   = 1,
@@ -367,6 +369,9 @@ enum {
     CSR_MTVEC       = 0x305,    // Machine trap-handler base address
     CSR_MCOUNTEREN  = 0x306,    // Machine counter enable
     CSR_MSTATUSH    = 0x310,    // Machine status hi register
+    CSR_MCOUNTINHIBIT = 0x320,  // Machine counter-inhibit register
+    CSR_MHPMEVENT3  = 0x323,    // Machine performance-monitoring event selector
+    CSR_MHPMEVENT31 = 0x33F,
 
     CSR_MSCRATCH    = 0x340,    // Scratch register for machine trap handlers
     CSR_MEPC        = 0x341,    // Machine exception program counter
@@ -389,7 +394,16 @@ enum {
     CSR_RDTIME      = 0xc01,    // timer counter
     CSR_RDTIMEH     = 0xc81,    // upper 32-bits of timer counter
     CSR_RDINSTRET   = 0xc02,    // Intructions-retired counter
-    CSR_RDINSTRETH  = 0xc82     // upper 32-bits of intruction-retired counter
+    CSR_RDINSTRETH  = 0xc82,    // upper 32-bits of intruction-retired counter
+
+    CSR_MHPMCOUNTER3    = 0xb03,    // Machine performance-monitoring counter
+    CSR_MHPMCOUNTER31   = 0xb1f,
+    CSR_MHPMCOUNTER3H   = 0xb83,    // upper 32-bits of performance-monitoring counter
+    CSR_MHPMCOUNTER31H  = 0xb9f,
+    CSR_HPMCOUNTER3     = 0xc03,    // User-mode alias of mhpmcounter, read only
+    CSR_HPMCOUNTER31    = 0xc1f,
+    CSR_HPMCOUNTER3H    = 0xc83,
+    CSR_HPMCOUNTER31H   = 0xc9f
 };
 
 // system call defined in the file /usr/include/asm-generic/unistd.h
@@ -399,13 +413,28 @@ enum {
     SYS_CLOSE       = 0x0039,
     SYS_READ        = 0x003f,
     SYS_WRITE       = 0x0040,
+    SYS_WRITEV      = 0x0042,
     SYS_FSTAT       = 0x0050,
     SYS_EXIT        = 0x005d,
+    SYS_GETTIMEOFDAY= 0x00a9,
     SYS_SBRK        = 0x00d6,
     SYS_DUMP        = 0x0088,
-    SYS_DUMP_BIN    = 0x0099
+    SYS_DUMP_BIN    = 0x0099,
+    SYS_TIMES       = 0x0100,       // 0x0099 of Linux is taken by SYS_DUMP_BIN
+    SYS_BATCH       = 0x0101
 };
 
+// The arguments in the memory are 32-bit words:
+//   SYS_WRITEV       a1: {base, len} x a2
+//   SYS_FSTAT        a1: {st_mode, st_size}
+//   SYS_GETTIMEOFDAY a0: {tv_sec, tv_usec}
+//   SYS_TIMES        a0: {utime, stime, cutime, cstime}
+//   SYS_BATCH        a0: {func, a0, a1, a2, a3, a4, a5, result} x a1
+// The time is the simulated time of the cycle counter.
+#define SIM_CLOCK_HZ    100000000   // cycles per second
+#define TIMES_HZ        1000        // ticks per second of SYS_TIMES
+#define BATCH_WORDS     8
+
 // Exception code
 enum {
     TRAP_INST_ALIGN = 0,            // Instruction address misaligned
@@ -503,6 +532,23 @@ enum {
 //  WPRI    = 12 ... MXLEN-1 // Reserved
 };
 
+// mhpmevent selector, the same in RTL
+enum {
+    HPM_NONE            = 0,
+    HPM_CYCLE           = 1,    // cycles
+    HPM_INSTRET         = 2,    // instructions retired
+    HPM_BRANCH_TAKEN    = 3,    // taken conditional branches
+    HPM_LOAD            = 4,    // loads
+    HPM_STORE           = 5,    // stores
+    HPM_MULDIV          = 6,    // multiply and divide instructions
+    HPM_STALL           = 7,    // cycles without retiring an instruction
+    HPM_TRAP            = 8,    // exceptions and interrupts, mret excluded
+    HPM_EVENTS
+};
+
+// mhpmcounter3 ... mhpmcounter(HPM_NUM+2) are implemented, others are zero
+#define HPM_NUM 4
+
 // The privileged mode
 enum {
     UMODE   = 0,        // User mode
@@ -531,6 +577,9 @@ typedef struct _CSR {
     int32_t mip;
     int32_t mtval;
     int32_t msip;
+    COUNTER mhpmcounter[HPM_NUM];   // value minus the event count
+    int32_t mhpmevent[HPM_NUM];
+    int32_t mcountinhibit;
 #ifdef XV6_SUPPORT
     int32_t medeleg;
     int32_t mideleg;
@@ -553,12 +602,13 @@ typedef struct _CSR {
 #define MHARTID       0
 #define MISA          ((1<<30)|(RV32M<<12)|(1<<8)|(RV32E<<4)|(RV32B<<1))
 
-//#define MMIO_PUTC     0xa000001c /* 32-bits */
-#define MMIO_PUTC     0x9000001c /* 32-bits */
+#define MMIO_PUTC     0xa000001c /* 32-bits */
 #define MMIO_GETC     0xa0000020 /* 32-bits */
+#define MMIO_PUTS     0xa0000024 /* 1 to 4 bytes of the store */
 #define MMIO_EXIT     0xa000002c /* 32-bits */
 #define MMIO_TOHOST   0xa0000030 /* 32-bits */
 #define MMIO_FROMHOST 0xa0000034 /* 32-bits */
+#define MMIO_DUMP     0xa0000038 /* 32-bits, waveform dump of the RTL sim */
 #define MMIO_MTIME    0x90000000 /* 64-bits */
 #define MMIO_MTIMECMP 0x90000008 /* 64-bits */
 #define MMIO_MSIP     0x90000010 /* 32-bits */
@@ -595,6 +645,36 @@ int compressed_decoder (
 #define DVA2PA(addr) ((addr)-DMEM_BASE)
 #define DPA2VA(addr) ((addr)+DMEM_BASE)
 
+// breakpoint bitmap (one bit per halfword of IMEM) and watchpoint page table
+// (IMEM and DMEM) of the interactive debugger
+#define WATCH_PAGE_BITS 12
+#define BREAKPOINT(map,pc) \
+    ((uint32_t)IVA2PA(pc) < (uint32_t)IMEM_SIZE && \
+     ((map)[(uint32_t)IVA2PA(pc)>>6] & (1u << (((uint32_t)IVA2PA(pc)>>1)&31))))
+#define WATCHPOINT(map,addr) \
+    ((uint32_t)IVA2PA(addr) < (uint32_t)(IMEM_SIZE+DMEM_SIZE) && \
+     (map)[(uint32_t)IVA2PA(addr)>>WATCH_PAGE_BITS])
+
+enum {
+    POINT_BREAK,
+    POINT_TEMP,         // the breakpoint of until
+    POINT_WATCH,        // write
+    POINT_RWATCH,       // read
+    POINT_AWATCH        // read or write
+};
+
+// the last retired instruction, for the lockstep and the binary trace
+typedef struct _RETIRE {
+    int32_t     cycle;
+    int32_t     pc;
+    int32_t     inst;
+    int         rd;         // the last register written, -1 if none
+    int         load;       // 1 if it reads memory
+    int         store;      // 1 if it writes memory
+    int32_t     address;
+    int32_t     data;       // store data, masked by the size
+} RETIRE;
+
 #ifdef RV32E_ENABLED
 #define SYS T0
 #define REGNUM 16
@@ -2274,3 +2274,33 @@ void disasm_inst(char *buf, size_t buflen, rv_isa isa, uint64_t pc, rv_inst inst
     decode_inst_lift_pseudo(&dec);
     decode_inst_format(buf, buflen, 32, &dec);
 }
+
+/* decode instruction opcode and operands, without pseudo-instruction lifting */
+
+void inst_decode(rv_decode *dec, rv_isa isa, uint64_t pc, rv_inst inst)
+{
+    memset(dec, 0, sizeof(rv_decode));
+    dec->pc = pc;
+    dec->inst = inst;
+    decode_inst_opcode(dec, isa);
+    decode_inst_operands(dec);
+}
+
+/* expand compressed instruction to the base instruction */
+
+void inst_decompress(rv_decode *dec, rv_isa isa)
+{
+    decode_inst_decompress(dec, isa);
+}
+
+/* instruction name and operand format */
+
+const char *inst_name(const rv_decode *dec)
+{
+    return opcode_data[dec->op].name;
+}
+
+const char *inst_format(const rv_decode *dec)
+{
+    return opcode_data[dec->op].format;
+}
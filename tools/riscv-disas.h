@@ -516,5 +516,9 @@ typedef struct {
 size_t inst_length(rv_inst inst);
 void inst_fetch(const uint8_t *data, rv_inst *instp, size_t *length);
 void disasm_inst(char *buf, size_t buflen, rv_isa isa, uint64_t pc, rv_inst inst);
+void inst_decode(rv_decode *dec, rv_isa isa, uint64_t pc, rv_inst inst);
+void inst_decompress(rv_decode *dec, rv_isa isa);
+const char *inst_name(const rv_decode *dec);
+const char *inst_format(const rv_decode *dec);
 
 #endif
@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <getopt.h>
+#include <setjmp.h>
 #include <sys/time.h>
 
 #include <unistd.h>
@@ -32,6 +33,7 @@
 #include <fcntl.h>
 
 #include "opcode.h"
+#include "trace.h"
 
 int mem_size = 256*1024; // default memory size
 
@@ -49,7 +51,9 @@ int mem_size = 256*1024; // default memory size
     csr.mstatus = (csr.mstatus & ~(1<<MIE)); \
     csr.mepc = prev_pc; \
     csr.mtval = (val); \
+    hpm_count[HPM_TRAP]++; \
     pc = (csr.mtvec & 1) ? (csr.mtvec & 0xfffffffe) + cause * 4 : csr.mtvec; \
+    if (callgraph_en) callgraph_trap(csr.mepc, pc); \
 }
 
 #define INT(cause,src) { \
@@ -61,7 +65,9 @@ int mem_size = 256*1024; // default memory size
     csr.mstatus = (csr.mstatus & ~(1<<MIE)); \
     csr.mip = csr.mip | (1 << src); \
     csr.mepc = pc; \
+    hpm_count[HPM_TRAP]++; \
     pc = (csr.mtvec & 1) ? (csr.mtvec & 0xfffffffe) + (cause & (~(1<<31))) * 4 : csr.mtvec; \
+    if (callgraph_en) callgraph_trap(csr.mepc, pc); \
 }
 
 #define CYCLE_ADD(count) { \
@@ -79,11 +85,16 @@ int32_t prev_pc = 0;
 int32_t regs[REGNUM];
 
 int debug_en = 0;
+extern uint32_t *bp_map;
+extern uint8_t *watch_map;
+extern int debug_stop;
+extern long long debug_instret;
 int mode = MMODE;
 int mem_base = 0;
 int singleram = 0;
 int branch_penalty = BRANCH_PENALTY;
 int mtime_update = 0;
+long long hpm_count[HPM_EVENTS];
 struct timeval time_start;
 struct timeval time_end;
 
@@ -100,6 +111,20 @@ int overhead = 0;
 #endif // RV32C_ENABLED
 
 int quiet = 0;
+int callgraph_en = 0;
+int stats_en = 0;
+int heatmap_en = 0;
+int gdb_en = 0;
+long long wfi_cycles = 0;   // idle cycles skipped by WFI
+int idle_en = 0;
+long long idle_cycles = 0;  // cycles skipped in the idle loops
+static int idle_probe = 0;  // executing the idle loop on a copy of the state
+
+// lockstep co-simulation with the RTL, see lockstep.c
+RETIRE retire;
+int lockstep = 0;
+int32_t lockstep_rdata;     // the RTL value of the MMIO load
+static jmp_buf lockstep_env;
 
 char *regname[32] = {
     "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
@@ -109,11 +134,54 @@ char *regname[32] = {
 };
 
 int srv32_syscall(int func, int a0, int a1, int a2, int a3, int a4, int a5);
+int lockstep_host(int func, int a0, int a1, int a2);
+void lockstep_tohost(int32_t ptr);
+void lockstep_fromhost(void);
 void srv32_tohost(int32_t ptr);
 int srv32_fromhost(void);
 int elfloader(char *file, char *mem, int imem_base, int dmem_base, int imem_size, int dmem_size);
 int getch(void);
 void debug(void);
+void debug_init(char *elf);
+void debug_watch(int32_t address, int size, int write);
+void callgraph_init(char *elf, char *file, int32_t entry);
+void callgraph_jump(int rd, int rs1, int jalr, int32_t pc, int32_t target, int32_t ret);
+void callgraph_trap(int32_t mepc, int32_t handler);
+void callgraph_mret(int32_t target);
+void callgraph_exit(void);
+void stats_init(char *file);
+void stats_exec(int32_t pc);
+void stats_taken(int32_t pc);
+void stats_exit(void);
+void heatmap_init(char *elf, char *file, int interval);
+void heatmap_fetch(int32_t pc);
+void heatmap_access(int32_t address, int write);
+void heatmap_exit(void);
+void gdbstub_init(char *port);
+void gdbstub_exit(int code);
+int console_policy(char *policy);
+void console_init(void);
+void console_flush(void);
+void console_write(const char *buf, int len);
+void console_putc(char c);
+void console_idle(void);
+int checkpoint_write(char *file);
+
+extern int console_pending;
+
+// long options without the short form
+enum {
+    OPT_CALLGRAPH = 256,
+    OPT_STATS,
+    OPT_HEATMAP,
+    OPT_INTERVAL,
+    OPT_GDB,
+    OPT_BINARY,
+    OPT_FLUSH,
+    OPT_IDLE,
+    OPT_CHECKPOINT,
+    OPT_CHECKPOINTS
+};
 
 void usage(void) {
     printf(
@@ -128,6 +196,20 @@ void usage(void) {
 "       --single, -s            single RAM\n"
 "       --predict, -p           static branch prediction\n"
 "       --log file, -l file     generate log file\n"
+"       --binary                write the log file in the binary format of trace.h\n"
+"       --callgraph file        write call graph profile in folded stacks\n"
+"       --stats file            write instruction mix statistics in JSON\n"
+"       --heatmap file          write memory access heatmap\n"
+"       --interval n            working set interval (default 100000 instructions)\n"
+"       --gdb port|path         wait for gdb on the TCP port or unix socket\n"
+"       --flush policy          console flush policy, separated by comma:\n"
+"                               char, line, size=n, idle=n, exit\n"
+"                               (default line,size=4096,idle=1000000)\n"
+"       --idle                  fast-forward the idle loops\n"
+"       --checkpoint file@n     write the checkpoint of the RTL simulation at\n"
+"                               instruction n, and exit\n"
+"       --checkpoints file@n    write the checkpoints file.1, file.2, ... every\n"
+"                               n instructions\n"
 "\n"
 "       file                    the elf executable file\n"
 "\n"
@@ -219,8 +301,34 @@ static inline int to_imm_u(uint32_t n) {
     return (int)(n << 12);
 }
 
+static FILE *fb = NULL;     // binary trace log
+
+static void trace_record(void) {
+    TRACE_RECORD rec;
+
+    rec.cycle    = retire.cycle;
+    rec.pc       = retire.pc;
+    rec.inst     = retire.inst;
+    rec.flags    = (retire.rd >= 0 ? TRACE_REG : 0) |
+                   (retire.load ? TRACE_LOAD : 0) |
+                   (retire.store ? TRACE_STORE : 0);
+    rec.rd       = retire.rd >= 0 ? retire.rd : 0;
+    rec.reserved = 0;
+    rec.address  = retire.address;
+    rec.data     = retire.store ? retire.data :
+                   retire.rd >= 0 ? regs[retire.rd] : 0;
+    fwrite(&rec, sizeof(rec), 1, fb);
+}
+
 void prog_exit(int exitcode) {
     double diff;
+
+    // the RTL terminates the lockstep simulation
+    if (lockstep)
+        longjmp(lockstep_env, 1);
+
+    console_flush();
+
     gettimeofday(&time_end, NULL);
 
     diff = (double)(time_end.tv_sec-time_start.tv_sec) + (time_end.tv_usec-time_start.tv_usec)/1000000.0;
@@ -234,6 +342,12 @@ void prog_exit(int exitcode) {
                csr.cycle.c, ((float)csr.cycle.c)/csr.instret.c);
 #endif // RV32C_ENABLED
 
+        if (wfi_cycles)
+            printf("Idle %lld cycles in WFI\n", wfi_cycles);
+
+        if (idle_cycles)
+            printf("Idle %lld cycles in the idle loops\n", idle_cycles);
+
         printf("Program terminate\n");
 
         printf("\n");
@@ -244,6 +358,24 @@ void prog_exit(int exitcode) {
         printf("Simulation speed : %0.3f MHz\n", (float)(csr.cycle.c / diff / 1000000.0));
         printf("\n");
     }
+
+    if (callgraph_en)
+        callgraph_exit();
+
+    if (stats_en)
+        stats_exit();
+
+    if (heatmap_en)
+        heatmap_exit();
+
+    if (gdb_en)
+        gdbstub_exit(exitcode);
+
+    if (fb) {
+        trace_record();
+        fclose(fb);
+    }
+
     exit(exitcode);
 }
 
@@ -255,6 +387,94 @@ void prog_exit(int exitcode) {
     } \
 }
 
+// The event count includes the events of the current instruction.
+static long long hpm_event(int sel) {
+    switch(sel) {
+        case HPM_CYCLE  : return csr.cycle.c;
+        case HPM_INSTRET: return csr.instret.c;
+        case HPM_STALL  : return csr.cycle.c - csr.instret.c;
+        default         : return (sel > 0 && sel < HPM_EVENTS) ? hpm_count[sel] : 0;
+    }
+}
+
+// The counter keeps the value minus the event count, so that the events
+// are counted without touching the counters. The CSR read does not see
+// the cycle and the retirement of itself, and the CSR write overrides the
+// events of itself, the same as RTL.
+long long hpm_value(int n) {
+    if (csr.mcountinhibit & (1 << (n+3)))
+        return csr.mhpmcounter[n].c;
+    return csr.mhpmcounter[n].c + hpm_event(csr.mhpmevent[n]);
+}
+
+static int hpm_rw(int regs, int mode, int val, int update, int *legal) {
+    COUNTER counter;
+    int result = 0;
+    int n = (regs & 0x1f) - 3;
+    int i;
+
+    // mcountinhibit, cycle and instret can not be inhibited
+    if (regs == CSR_MCOUNTINHIBIT) {
+        int inhibit = csr.mcountinhibit;
+        result = csr.mcountinhibit;
+        UPDATE_CSR(update, mode, inhibit, val);
+        inhibit &= ((1 << HPM_NUM) - 1) << 3;
+        for(i = 0; i < HPM_NUM; i++) {
+            if ((inhibit ^ csr.mcountinhibit) & (1 << (i+3))) {
+                if (inhibit & (1 << (i+3)))
+                    csr.mhpmcounter[i].c += hpm_event(csr.mhpmevent[i]);
+                else
+                    csr.mhpmcounter[i].c -= hpm_event(csr.mhpmevent[i]);
+            }
+        }
+        csr.mcountinhibit = inhibit;
+        return result;
+    }
+
+    if (n < 0) {
+        printf("Unsupport CSR register 0x%03x at PC 0x%08x\n", regs, pc);
+        *legal = 0;
+        return 0;
+    }
+
+    // not implemented counters are hardwired to zero
+    if (n >= HPM_NUM)
+        return 0;
+
+    if (regs >= CSR_MHPMEVENT3 && regs <= CSR_MHPMEVENT31) {
+        long long value = hpm_value(n);
+        result = csr.mhpmevent[n];
+        UPDATE_CSR(update, mode, csr.mhpmevent[n], val);
+        if (!(csr.mcountinhibit & (1 << (n+3))))
+            csr.mhpmcounter[n].c = value - hpm_event(csr.mhpmevent[n]);
+        return result;
+    }
+
+    counter.c = hpm_value(n);
+    if (!(csr.mcountinhibit & (1 << (n+3))) &&
+        (csr.mhpmevent[n] == HPM_CYCLE || csr.mhpmevent[n] == HPM_INSTRET))
+        counter.c--;
+
+    if (regs >= CSR_MHPMCOUNTER3 && regs <= CSR_MHPMCOUNTER31) {
+        result = counter.d.lo;
+        UPDATE_CSR(update, mode, counter.d.lo, val);
+    } else if (regs >= CSR_MHPMCOUNTER3H && regs <= CSR_MHPMCOUNTER31H) {
+        result = counter.d.hi;
+        UPDATE_CSR(update, mode, counter.d.hi, val);
+    } else if (regs >= CSR_HPMCOUNTER3 && regs <= CSR_HPMCOUNTER31) {
+        return counter.d.lo; // read only
+    } else {
+        return counter.d.hi; // read only
+    }
+
+    if (update) {
+        csr.mhpmcounter[n].c = counter.c;
+        if (!(csr.mcountinhibit & (1 << (n+3))))
+            csr.mhpmcounter[n].c -= hpm_event(csr.mhpmevent[n]);
+    }
+    return result;
+}
+
 int csr_rw(int regs, int mode, int val, int update, int *legal) {
     COUNTER counter;
     int result = 0;
@@ -334,7 +554,16 @@ int csr_rw(int regs, int mode, int val, int update, int *legal) {
         case CSR_SATP       : result = csr.satp; UPDATE_CSR(update, mode, csr.satp, val);
                               break;
 #endif // XV6_SUPPORT
-        default: result = 0;
+        default: if (regs == CSR_MCOUNTINHIBIT ||
+                     (regs >= CSR_MHPMEVENT3 && regs <= CSR_MHPMEVENT31) ||
+                     (regs >= CSR_MHPMCOUNTER3 && regs <= CSR_MHPMCOUNTER31) ||
+                     (regs >= CSR_MHPMCOUNTER3H && regs <= CSR_MHPMCOUNTER31H) ||
+                     (regs >= CSR_HPMCOUNTER3 && regs <= CSR_HPMCOUNTER31) ||
+                     (regs >= CSR_HPMCOUNTER3H && regs <= CSR_HPMCOUNTER31H)) {
+                     result = hpm_rw(regs, mode, val, update, legal);
+                     break;
+                 }
+                 result = 0;
                  printf("Unsupport CSR register 0x%03x at PC 0x%08x\n", regs, pc);
                  *legal = 0;
     }
@@ -355,11 +584,12 @@ static inline void REGS_W(int n, int32_t v) {
         printf("RV32E: can not access registers %d\n", n);
     } else {
         regs[n] = v;
+        retire.rd = n;
     }
 }
 #else
 #  define REGS(n)      regs[n]
-#  define REGS_W(n, v) regs[n] = (v)
+#  define REGS_W(n, v) (retire.rd = (n), regs[n] = (v))
 #endif // RV32E_ENABLED
 
 static int memrw(FILE *ft, int type, int op, int32_t address, int32_t *val) {
@@ -383,16 +613,28 @@ static int memrw(FILE *ft, int type, int op, int32_t address, int32_t *val) {
         else if (address >= DMEM_BASE && address < DMEM_BASE+DMEM_SIZE) {
             data = dmem[DVA2PA(address)/4];
         }
-        // Others
+        // Others, the RTL gives the value in lockstep
+        else if (lockstep) {
+            data = lockstep_rdata;
+            if (address == MMIO_FROMHOST)
+                lockstep_fromhost();
+        }
+        // The probe of the idle loop reads the timer only, without side effects
+        else if (idle_probe && (address < MMIO_MTIME || address > MMIO_MSIP)) {
+            return TRAP_LD_FAIL;
+        }
         else {
             switch(address) {
                 case MMIO_PUTC:
+                case MMIO_PUTS:
                     data = 0;
                     break;
                 case MMIO_GETC:
+                    console_flush();
                     data = getch();
                     break;
                 case MMIO_EXIT:
+                case MMIO_DUMP:
                     data = 0;
                     break;
                 case MMIO_FROMHOST:
@@ -460,6 +702,15 @@ static int memrw(FILE *ft, int type, int op, int32_t address, int32_t *val) {
                 // Illegal instruction. This has been checked in the beginning.
                 break;
         }
+        if (heatmap_en)
+            heatmap_access(address, 0);
+
+        retire.load    = 1;
+        retire.address = address;
+
+        if (debug_en && WATCHPOINT(watch_map, address))
+            debug_watch(address, 1 << (op & 3), 0);
+
         *val = data;
         return 0;
     }
@@ -478,6 +729,10 @@ static int memrw(FILE *ft, int type, int op, int32_t address, int32_t *val) {
             return TRAP_INST_ILL;
         }
 
+        retire.store   = 1;
+        retire.address = address;
+        retire.data    = data & mask;
+
         // Instruction memory
         if (address >= IMEM_BASE && address < IMEM_BASE+IMEM_SIZE) {
             addr = IVA2PA(address);
@@ -492,10 +747,19 @@ static int memrw(FILE *ft, int type, int op, int32_t address, int32_t *val) {
         else {
             switch(address) {
                 case MMIO_PUTC:
-                    putchar((char)data);
-                    fflush(stdout);
+                    // the RTL prints the console in lockstep
+                    if (!lockstep)
+                        console_putc((char)data);
+                    break;
+                case MMIO_PUTS:
+                    if (!lockstep) {
+                        char s[4] = {(char)data, (char)(data >> 8),
+                                     (char)(data >> 16), (char)(data >> 24)};
+                        console_write(s, (op == OP_SB) ? 1 : (op == OP_SH) ? 2 : 4);
+                    }
                     break;
                 case MMIO_GETC:
+                case MMIO_DUMP:
                     break;
                 case MMIO_EXIT:
                     TRACE_LOG " write 0x%08x <= 0x%08x\n",
@@ -510,6 +774,8 @@ static int memrw(FILE *ft, int type, int op, int32_t address, int32_t *val) {
                                       address, (data & mask) TRACE_END;
                         }
                     }
+                    if (lockstep)
+                        lockstep_tohost((int32_t)data);
                     srv32_tohost((int32_t)data);
                     break;
                 case MMIO_MTIME:
@@ -567,6 +833,13 @@ static int memrw(FILE *ft, int type, int op, int32_t address, int32_t *val) {
                 // Illegal instruction. This has been checked in the beginning.
                 break;
         }
+
+        if (heatmap_en)
+            heatmap_access(address, 1);
+
+        if (debug_en && WATCHPOINT(watch_map, address))
+            debug_watch(address, 1 << (op & 3), 1);
+
         return 0;
     }
 
@@ -574,107 +847,22 @@ static int memrw(FILE *ft, int type, int op, int32_t address, int32_t *val) {
     return 0;
 }
 
-int main(int argc, char **argv) {
-    FILE *ft = NULL;
-
-    int i;
-    int result;
-    char *file = NULL;
-    char *tfile = NULL;
-    int branch_predict = 0;
-    int timer_irq;
-    int sw_irq;
-    int sw_irq_next;
-    int ext_irq;
-    int ext_irq_next;
-    int compressed = 0;
+// state of the execution loop
+static FILE *ft = NULL;
+static int branch_predict = 0;
+static int timer_irq;
+static int sw_irq;
+static int sw_irq_next;
+static int ext_irq;
+static int ext_irq_next;
+static int compressed = 0;
 #ifdef RV32C_ENABLED
-    int compressed_prev = 0;
+static int compressed_prev = 0;
 #endif // RV32C_ENABLED
 
-    const char *optstring = "hdb:pl:qm:n:s";
-    int c;
-    struct option opts[] = {
-        {"help", 0, NULL, 'h'},
-        {"debug", 0, NULL, 'd'},
-        {"branch", 1, NULL, 'b'},
-        {"predict", 0, NULL, 'p'},
-        {"log", 1, NULL, 'l'},
-        {"quiet", 0, NULL, 'q'},
-        {"membase", 1, NULL, 'm'},
-        {"memsize", 1, NULL, 'n'},
-        {"single", 0, NULL, 's'}
-    };
-
-    while((c = getopt_long(argc, argv, optstring, opts, NULL)) != -1) {
-        switch(c) {
-            case 'h':
-                usage();
-                return 1;
-            case 'd':
-                debug_en = 1;
-                break;
-            case 'b':
-                branch_penalty = atoi(optarg);
-                break;
-            case 'p':
-                branch_predict = 1;
-                break;
-            case 'l':
-                if ((tfile = malloc(MAXLEN)) == NULL) {
-                    // LCOV_EXCL_START
-                    printf("malloc fail\n");
-                    exit(1);
-                    // LCOV_EXCL_STOP
-                }
-                strncpy_s(tfile, MAXLEN-1, optarg, MAXLEN-1);
-                break;
-            case 'q':
-                quiet = 1;
-                break;
-            case 'm':
-                sscanf(optarg, "%i", (int32_t*)&mem_base);
-                break;
-            case 'n':
-                sscanf(optarg, "%i", (int32_t*)&mem_size);
-                mem_size *= 1024;
-                break;
-            case 's':
-                singleram = 1;
-                break;
-            default:
-                usage();
-                return 1;
-        }
-    }
-
-    if (optind < argc) {
-        if ((file = malloc(MAXLEN)) == NULL) {
-            // LCOV_EXCL_START
-            printf("malloc fail\n");
-            exit(1);
-            // LCOV_EXCL_STOP
-        }
-        strncpy_s(file, MAXLEN-1, argv[optind], MAXLEN-1);
-    } else {
-        usage();
-        printf("Error: missing input file.\n\n");
-        return 1;
-    }
-
-    if (!file) {
-        usage();
-        return 1;
-    }
-
-    if (tfile) {
-        if ((ft=fopen(tfile, "w")) == NULL) {
-            // LCOV_EXCL_START
-            printf("can not open file %s\n", tfile);
-            exit(1);
-            // LCOV_EXCL_STOP
-        }
-    }
+// Allocate the memory, load the program and reset the processor
+void rvsim_init(char *file) {
+    int i;
 
     if ((mem = (int*)aligned_malloc(sizeof(int), IMEM_SIZE+DMEM_SIZE)) == NULL) {
         // LCOV_EXCL_START
@@ -690,7 +878,7 @@ int main(int argc, char **argv) {
     memset(dmem, 0, DMEM_SIZE);
 
     // load elf file
-    if ((result = elfloader(file, (char*)mem, IMEM_BASE, DMEM_BASE, IMEM_SIZE, DMEM_SIZE)) == 0) {
+    if (elfloader(file, (char*)mem, IMEM_BASE, DMEM_BASE, IMEM_SIZE, DMEM_SIZE) == 0) {
         // LCOV_EXCL_START
         printf("Can not read elf file %s\n", file);
         exit(1);
@@ -720,1024 +908,1693 @@ int main(int argc, char **argv) {
     ext_irq        = 0;
     ext_irq_next   = 0;
     mode           = MMODE;
+}
 
-    gettimeofday(&time_start, NULL);
-
-    // Execution loop
-    while(1) {
-        INST inst;
+// Execute one instruction
+static void step(void) {
+    INST inst;
 
 #ifdef RV32C_ENABLED
-        INSTC instc;
-        int illegal;
+    INSTC instc;
+    int illegal;
 
-        illegal = 0;
+    illegal = 0;
 #endif // RV32C_ENABLED
 
-        mtime_update = 0;
+    mtime_update = 0;
 
-        // keep x0 always zero
-        REGS_W(0, 0);
+    if (console_pending)
+        console_idle();
 
-        if (timer_irq && (csr.mstatus & (1 << MIE))) {
-            INT(INT_MTIME, MTIP);
-        }
+    // keep x0 always zero
+    REGS_W(0, 0);
 
-        // software interrupt
-        if (sw_irq_next && (csr.mstatus & (1 << MIE))) {
-            INT(INT_MSI, MSIP);
-        }
+    retire.rd = -1;
+    retire.load = 0;
+    retire.store = 0;
 
-        // external interrupt
-        if (ext_irq_next && (csr.mstatus & (1 << MIE))) {
-            INT(INT_MEI, MEIP);
-        }
+    if (timer_irq && (csr.mstatus & (1 << MIE))) {
+        INT(INT_MTIME, MTIP);
+    }
 
-        if (IVA2PA(pc) >= IMEM_SIZE || IVA2PA(pc) < 0) {
-            printf("PC 0x%08x out of range 0x%08x\n", pc, IPA2VA(IMEM_SIZE));
-            TRAP(TRAP_INST_FAIL, pc);
-        }
+    // software interrupt
+    if (sw_irq_next && (csr.mstatus & (1 << MIE))) {
+        INT(INT_MSI, MSIP);
+    }
+
+    // external interrupt
+    if (ext_irq_next && (csr.mstatus & (1 << MIE))) {
+        INT(INT_MEI, MEIP);
+    }
+
+    if (IVA2PA(pc) >= IMEM_SIZE || IVA2PA(pc) < 0) {
+        printf("PC 0x%08x out of range 0x%08x\n", pc, IPA2VA(IMEM_SIZE));
+        TRAP(TRAP_INST_FAIL, pc);
+    }
 
 #ifdef RV32C_ENABLED
-        if ((pc&1) != 0) {
-            printf("PC 0x%08x alignment error\n", pc);
-            TRAP(TRAP_INST_ALIGN, pc);
-        }
+    if ((pc&1) != 0) {
+        printf("PC 0x%08x alignment error\n", pc);
+        TRAP(TRAP_INST_ALIGN, pc);
+    }
 #else
-        if ((pc&3) != 0) {
-            printf("PC 0x%08x alignment error\n", pc);
-            TRAP(TRAP_INST_ALIGN, pc);
-        }
+    if ((pc&3) != 0) {
+        printf("PC 0x%08x alignment error\n", pc);
+        TRAP(TRAP_INST_ALIGN, pc);
+    }
 #endif // RV32C_ENABLED
 
-        inst.inst = (IVA2PA(pc) & 2) ?
-                     (imem[IVA2PA(pc)/4+1] << 16) | ((imem[IVA2PA(pc)/4] >> 16) & 0xffff) :
-                     imem[IVA2PA(pc)/4];
+    inst.inst = (IVA2PA(pc) & 2) ?
+                 (imem[IVA2PA(pc)/4+1] << 16) | ((imem[IVA2PA(pc)/4] >> 16) & 0xffff) :
+                 imem[IVA2PA(pc)/4];
 
 #ifdef RV32C_ENABLED
-        instc.inst = (IVA2PA(pc) & 2) ?
-                     (short)(imem[IVA2PA(pc)/4] >> 16) :
-                     (short)imem[IVA2PA(pc)/4];
+    instc.inst = (IVA2PA(pc) & 2) ?
+                 (short)(imem[IVA2PA(pc)/4] >> 16) :
+                 (short)imem[IVA2PA(pc)/4];
 #endif // RV32C_ENABLED
 
-        if ((csr.mtime.c >= csr.mtimecmp.c) &&
-            (csr.mstatus & (1 << MIE)) && (csr.mie & (1 << MTIE)) &&
-            (inst.r.op != OP_SYSTEM)) { // do not interrupt when system call and CSR R/W
-            timer_irq = 1;
-        } else {
-            timer_irq = 0;
-        }
+    if ((csr.mtime.c >= csr.mtimecmp.c) &&
+        (csr.mstatus & (1 << MIE)) && (csr.mie & (1 << MTIE)) &&
+        (inst.r.op != OP_SYSTEM)) { // do not interrupt when system call and CSR R/W
+        timer_irq = 1;
+    } else {
+        timer_irq = 0;
+    }
 
-        if (sw_irq &&
-            (csr.mstatus & (1 << MIE)) && (csr.mie & (1 << MSIE)) &&
-            (inst.r.op != OP_SYSTEM)) { // do not interrupt when system call and CSR R/W
-            sw_irq_next = 1;
-        } else {
-            sw_irq_next = 0;
-        }
-        sw_irq = (csr.msip & (1<<0)) ? 1 : 0;
+    if (sw_irq &&
+        (csr.mstatus & (1 << MIE)) && (csr.mie & (1 << MSIE)) &&
+        (inst.r.op != OP_SYSTEM)) { // do not interrupt when system call and CSR R/W
+        sw_irq_next = 1;
+    } else {
+        sw_irq_next = 0;
+    }
+    sw_irq = (csr.msip & (1<<0)) ? 1 : 0;
 
-        if (ext_irq &&
-            (csr.mstatus & (1 << MIE)) && (csr.mie & (1 << MEIE)) &&
-            (inst.r.op != OP_SYSTEM)) { // do not interrupt when system call and CSR R/W
-            ext_irq_next = 1;
-        } else {
-            ext_irq_next = 0;
-        }
-        ext_irq = (csr.msip & (1<<16)) ? 1 : 0;
+    if (ext_irq &&
+        (csr.mstatus & (1 << MIE)) && (csr.mie & (1 << MEIE)) &&
+        (inst.r.op != OP_SYSTEM)) { // do not interrupt when system call and CSR R/W
+        ext_irq_next = 1;
+    } else {
+        ext_irq_next = 0;
+    }
+    ext_irq = (csr.msip & (1<<16)) ? 1 : 0;
 
-        csr.time.c++;
-        csr.instret.c++;
-        CYCLE_ADD(1);
+    csr.time.c++;
+    csr.instret.c++;
+    CYCLE_ADD(1);
+
+    if (debug_en && (debug_stop || BREAKPOINT(bp_map, pc) ||
+                     csr.instret.c == debug_instret))
+        debug();
+
+    prev_pc = pc;
 
-        if (debug_en)
-            debug();
+    if (stats_en)
+        stats_exec(pc);
 
-        prev_pc = pc;
+    if (heatmap_en)
+        heatmap_fetch(pc);
+
+    retire.cycle = csr.cycle.d.lo;
+    retire.pc = pc;
+    retire.inst = inst.inst;
 
 #ifdef RV32C_ENABLED
-        compressed = compressed_decoder(instc, &inst, &illegal);
+    compressed = compressed_decoder(instc, &inst, &illegal);
 
-        // one more cycle when the instruction type changes
-        if (compressed_prev != compressed) {
-            CYCLE_ADD(1);
-            overhead++;
-        }
+    // one more cycle when the instruction type changes
+    if (compressed_prev != compressed) {
+        CYCLE_ADD(1);
+        overhead++;
+    }
 
-        compressed_prev = compressed;
+    compressed_prev = compressed;
 
-        if (compressed && 0)
-            TRACE_LOG "           Translate 0x%04x => 0x%08x\n", (uint16_t)instc.inst, inst.inst TRACE_END;
+    retire.cycle = csr.cycle.d.lo;
+    retire.inst = inst.inst;
 
-        if (illegal) {
-            TRAP(TRAP_INST_ILL, (int)instc.inst);
-            continue;
-        }
+    if (compressed && 0)
+        TRACE_LOG "           Translate 0x%04x => 0x%08x\n", (uint16_t)instc.inst, inst.inst TRACE_END;
+
+    if (illegal) {
+        TRAP(TRAP_INST_ILL, (int)instc.inst);
+        return;
+    }
 #endif // RV32C_ENABLED
 
-        switch(inst.r.op) {
-        case OP_AUIPC: { // U-Type
-            REGS_W(inst.u.rd, pc + to_imm_u(inst.u.imm));
-            TIME_LOG; TRACE_LOG "%08x %08x x%02u (%s) <= 0x%08x\n", pc, inst.inst,
-                       inst.u.rd, regname[inst.u.rd], REGS(inst.u.rd) TRACE_END;
-            break;
-        }
-        case OP_LUI: { // U-Type
-            REGS_W(inst.u.rd, to_imm_u(inst.u.imm));
-            TIME_LOG; TRACE_LOG "%08x %08x x%02u (%s) <= 0x%08x\n", pc, inst.inst,
-                      inst.u.rd, regname[inst.u.rd], REGS(inst.u.rd) TRACE_END;
-            break;
+    switch(inst.r.op) {
+    case OP_AUIPC: { // U-Type
+        REGS_W(inst.u.rd, pc + to_imm_u(inst.u.imm));
+        TIME_LOG; TRACE_LOG "%08x %08x x%02u (%s) <= 0x%08x\n", pc, inst.inst,
+                   inst.u.rd, regname[inst.u.rd], REGS(inst.u.rd) TRACE_END;
+        break;
+    }
+    case OP_LUI: { // U-Type
+        REGS_W(inst.u.rd, to_imm_u(inst.u.imm));
+        TIME_LOG; TRACE_LOG "%08x %08x x%02u (%s) <= 0x%08x\n", pc, inst.inst,
+                  inst.u.rd, regname[inst.u.rd], REGS(inst.u.rd) TRACE_END;
+        break;
+    }
+    case OP_JAL: { // J-Type
+        int pc_old = pc;
+        int pc_off = to_imm_j(inst.j.imm);
+
+        TIME_LOG; TRACE_LOG "%08x %08x", pc, inst.inst TRACE_END;
+
+        pc += pc_off;
+        if (pc_off == 0) {
+            printf("Warning: forever loop detected at PC 0x%08x\n", pc);
+            prog_exit(1);
         }
-        case OP_JAL: { // J-Type
-            int pc_old = pc;
-            int pc_off = to_imm_j(inst.j.imm);
 
-            TIME_LOG; TRACE_LOG "%08x %08x", pc, inst.inst TRACE_END;
+        pc = pc & ~1; // setting the least-signicant bit of the result to zero
 
-            pc += pc_off;
-            if (pc_off == 0) {
-                printf("Warning: forever loop detected at PC 0x%08x\n", pc);
-                prog_exit(1);
-            }
+        #ifndef RV32C_ENABLED
+        if ((pc&3) != 0) {
+            // Instruction address misaligned
+            TRACE_LOG "\n" TRACE_END;
+            return;
+        }
+        #endif // RV32C_ENABLED
 
-            pc = pc & ~1; // setting the least-signicant bit of the result to zero
+        REGS_W(inst.j.rd, compressed ? pc_old + 2 : pc_old + 4);
+        TRACE_LOG " x%02u (%s) <= 0x%08x\n",
+                  inst.j.rd, regname[inst.j.rd], REGS(inst.j.rd) TRACE_END;
 
-            #ifndef RV32C_ENABLED
-            if ((pc&3) != 0) {
-                // Instruction address misaligned
-                TRACE_LOG "\n" TRACE_END;
-                continue;
-            }
-            #endif // RV32C_ENABLED
+        CYCLE_ADD(branch_penalty);
 
-            REGS_W(inst.j.rd, compressed ? pc_old + 2 : pc_old + 4);
-            TRACE_LOG " x%02u (%s) <= 0x%08x\n",
-                      inst.j.rd, regname[inst.j.rd], REGS(inst.j.rd) TRACE_END;
+        if (callgraph_en)
+            callgraph_jump(inst.j.rd, 0, 0, pc_old, pc,
+                           compressed ? pc_old + 2 : pc_old + 4);
+        return;
+    }
+    case OP_JALR: { // I-Type
+        int pc_old = pc;
+        int pc_new = REGS(inst.i.rs1) + to_imm_i(inst.i.imm);
 
-            CYCLE_ADD(branch_penalty);
-            continue;
-        }
-        case OP_JALR: { // I-Type
-            int pc_old = pc;
-            int pc_new = REGS(inst.i.rs1) + to_imm_i(inst.i.imm);
+        TIME_LOG; TRACE_LOG "%08x %08x", pc, inst.inst TRACE_END;
 
-            TIME_LOG; TRACE_LOG "%08x %08x", pc, inst.inst TRACE_END;
+        pc = pc_new;
+        if (pc_new == pc_old) {
+            TRACE_LOG "\n" TRACE_END;
+            printf("Warning: forever loop detected at PC 0x%08x\n", pc);
+            prog_exit(1);
+        }
 
-            pc = pc_new;
-            if (pc_new == pc_old) {
-                TRACE_LOG "\n" TRACE_END;
-                printf("Warning: forever loop detected at PC 0x%08x\n", pc);
-                prog_exit(1);
-            }
+        pc = pc & ~1; // setting the least-signicant bit of the result to zero
 
-            pc = pc & ~1; // setting the least-signicant bit of the result to zero
+        #ifndef RV32C_ENABLED
+        if ((pc&3) != 0) {
+            // Instruction address misaligned
+            TRACE_LOG "\n" TRACE_END;
+            return;
+        }
+        #endif // RV32C_ENABLED
 
-            #ifndef RV32C_ENABLED
-            if ((pc&3) != 0) {
-                // Instruction address misaligned
-                TRACE_LOG "\n" TRACE_END;
-                continue;
-            }
-            #endif // RV32C_ENABLED
+        REGS_W(inst.i.rd, compressed ? pc_old + 2 : pc_old + 4);
+        TRACE_LOG " x%02u (%s) <= 0x%08x\n",
+                  inst.i.rd, regname[inst.i.rd], REGS(inst.i.rd) TRACE_END;
 
-            REGS_W(inst.i.rd, compressed ? pc_old + 2 : pc_old + 4);
-            TRACE_LOG " x%02u (%s) <= 0x%08x\n",
-                      inst.i.rd, regname[inst.i.rd], REGS(inst.i.rd) TRACE_END;
+        CYCLE_ADD(branch_penalty);
 
-            CYCLE_ADD(branch_penalty);
-            continue;
+        if (callgraph_en)
+            callgraph_jump(inst.i.rd, inst.i.rs1, 1, pc_old, pc,
+                           compressed ? pc_old + 2 : pc_old + 4);
+        return;
+    }
+    case OP_BRANCH: { // B-Type
+        TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
+        int offset = to_imm_b(inst.b.imm2, inst.b.imm1);
+        switch(inst.b.func3) {
+            case OP_BEQ:
+                if (REGS(inst.b.rs1) == REGS(inst.b.rs2)) {
+                    pc += offset;
+                    hpm_count[HPM_BRANCH_TAKEN]++;
+                    if (stats_en) stats_taken(prev_pc);
+                    if ((!branch_predict || offset > 0) && (pc&3) == 0)
+                        CYCLE_ADD(branch_penalty);
+                    return;
+                }
+                break;
+            case OP_BNE:
+                if (REGS(inst.b.rs1) != REGS(inst.b.rs2)) {
+                    pc += offset;
+                    hpm_count[HPM_BRANCH_TAKEN]++;
+                    if (stats_en) stats_taken(prev_pc);
+                    if ((!branch_predict || offset > 0) && (pc&3) == 0)
+                        CYCLE_ADD(branch_penalty);
+                    return;
+                }
+                break;
+            case OP_BLT:
+                if (REGS(inst.b.rs1) < REGS(inst.b.rs2)) {
+                    pc += offset;
+                    hpm_count[HPM_BRANCH_TAKEN]++;
+                    if (stats_en) stats_taken(prev_pc);
+                    if ((!branch_predict || offset > 0) && (pc&3) == 0)
+                        CYCLE_ADD(branch_penalty);
+                    return;
+                }
+                break;
+            case OP_BGE:
+                if (REGS(inst.b.rs1) >= REGS(inst.b.rs2)) {
+                    pc += offset;
+                    hpm_count[HPM_BRANCH_TAKEN]++;
+                    if (stats_en) stats_taken(prev_pc);
+                    if ((!branch_predict || offset > 0) && (pc&3) == 0)
+                        CYCLE_ADD(branch_penalty);
+                    return;
+                }
+                break;
+            case OP_BLTU:
+                if (((uint32_t)REGS(inst.b.rs1)) < ((uint32_t)REGS(inst.b.rs2))) {
+                    pc += offset;
+                    hpm_count[HPM_BRANCH_TAKEN]++;
+                    if (stats_en) stats_taken(prev_pc);
+                    if ((!branch_predict || offset > 0) && (pc&3) == 0)
+                        CYCLE_ADD(branch_penalty);
+                    return;
+                }
+                break;
+            case OP_BGEU:
+                if (((uint32_t)REGS(inst.b.rs1)) >= ((uint32_t)REGS(inst.b.rs2))) {
+                    pc += offset;
+                    hpm_count[HPM_BRANCH_TAKEN]++;
+                    if (stats_en) stats_taken(prev_pc);
+                    if ((!branch_predict || offset > 0) && (pc&3) == 0)
+                        CYCLE_ADD(branch_penalty);
+                    return;
+                }
+                break;
+            default:
+                printf("Illegal branch instruction at PC 0x%08x\n", pc);
+                TRAP(TRAP_INST_ILL, inst.inst);
+                return;
         }
-        case OP_BRANCH: { // B-Type
-            TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
-            int offset = to_imm_b(inst.b.imm2, inst.b.imm1);
-            switch(inst.b.func3) {
-                case OP_BEQ:
-                    if (REGS(inst.b.rs1) == REGS(inst.b.rs2)) {
-                        pc += offset;
-                        if ((!branch_predict || offset > 0) && (pc&3) == 0)
-                            CYCLE_ADD(branch_penalty);
-                        continue;
-                    }
-                    break;
-                case OP_BNE:
-                    if (REGS(inst.b.rs1) != REGS(inst.b.rs2)) {
-                        pc += offset;
-                        if ((!branch_predict || offset > 0) && (pc&3) == 0)
-                            CYCLE_ADD(branch_penalty);
-                        continue;
-                    }
-                    break;
-                case OP_BLT:
-                    if (REGS(inst.b.rs1) < REGS(inst.b.rs2)) {
-                        pc += offset;
-                        if ((!branch_predict || offset > 0) && (pc&3) == 0)
-                            CYCLE_ADD(branch_penalty);
-                        continue;
-                    }
-                    break;
-                case OP_BGE:
-                    if (REGS(inst.b.rs1) >= REGS(inst.b.rs2)) {
-                        pc += offset;
-                        if ((!branch_predict || offset > 0) && (pc&3) == 0)
-                            CYCLE_ADD(branch_penalty);
-                        continue;
-                    }
-                    break;
-                case OP_BLTU:
-                    if (((uint32_t)REGS(inst.b.rs1)) < ((uint32_t)REGS(inst.b.rs2))) {
-                        pc += offset;
-                        if ((!branch_predict || offset > 0) && (pc&3) == 0)
-                            CYCLE_ADD(branch_penalty);
-                        continue;
-                    }
-                    break;
-                case OP_BGEU:
-                    if (((uint32_t)REGS(inst.b.rs1)) >= ((uint32_t)REGS(inst.b.rs2))) {
-                        pc += offset;
-                        if ((!branch_predict || offset > 0) && (pc&3) == 0)
-                            CYCLE_ADD(branch_penalty);
-                        continue;
-                    }
-                    break;
-                default:
-                    printf("Illegal branch instruction at PC 0x%08x\n", pc);
-                    TRAP(TRAP_INST_ILL, inst.inst);
-                    continue;
-            }
-            break;
+        break;
+    }
+    case OP_LOAD: { // I-Type
+        int32_t data;
+        int32_t address = REGS(inst.i.rs1) + to_imm_i(inst.i.imm);
+
+        TIME_LOG; TRACE_LOG "%08x %08x", pc, inst.inst TRACE_END;
+
+        int result = memrw(ft, OP_LOAD, inst.i.func3, address, &data);
+
+        if (singleram) CYCLE_ADD(1);
+
+        switch(result) {
+            case TRAP_LD_FAIL:
+                 TRACE_LOG "\n" TRACE_END;
+                 TRAP(TRAP_LD_FAIL, address);
+                 return;
+            case TRAP_LD_ALIGN:
+                 TRACE_LOG "\n" TRACE_END;
+                 TRAP(TRAP_LD_ALIGN, address);
+                 return;
+            case TRAP_INST_ILL:
+                 TRACE_LOG " read 0x%08x, x%02u (%s) <= 0x%08x\n",
+                             address, inst.i.rd,
+                             regname[inst.i.rd], 0 TRACE_END;
+                 TRAP(TRAP_INST_ILL, inst.inst);
+                 return;
         }
-        case OP_LOAD: { // I-Type
-            int32_t data;
-            int32_t address = REGS(inst.i.rs1) + to_imm_i(inst.i.imm);
-
-            TIME_LOG; TRACE_LOG "%08x %08x", pc, inst.inst TRACE_END;
-
-            int result = memrw(ft, OP_LOAD, inst.i.func3, address, &data);
-
-            if (singleram) CYCLE_ADD(1);
-
-            switch(result) {
-                case TRAP_LD_FAIL:
-                     TRACE_LOG "\n" TRACE_END;
-                     TRAP(TRAP_LD_FAIL, address);
-                     continue;
-                case TRAP_LD_ALIGN:
-                     TRACE_LOG "\n" TRACE_END;
-                     TRAP(TRAP_LD_ALIGN, address);
-                     continue;
-                case TRAP_INST_ILL:
-                     TRACE_LOG " read 0x%08x, x%02u (%s) <= 0x%08x\n",
-                                 address, inst.i.rd,
-                                 regname[inst.i.rd], 0 TRACE_END;
-                     TRAP(TRAP_INST_ILL, inst.inst);
-                     continue;
-            }
 
-            REGS_W(inst.i.rd, data);
-            TRACE_LOG " read 0x%08x, x%02u (%s) <= 0x%08x\n",
-                      address, inst.i.rd,
-                      regname[inst.i.rd], REGS(inst.i.rd) TRACE_END;
-            break;
+        hpm_count[HPM_LOAD]++;
+        REGS_W(inst.i.rd, data);
+        TRACE_LOG " read 0x%08x, x%02u (%s) <= 0x%08x\n",
+                  address, inst.i.rd,
+                  regname[inst.i.rd], REGS(inst.i.rd) TRACE_END;
+        break;
+    }
+    case OP_STORE: { // S-Type
+        int address = REGS(inst.s.rs1) +
+                      to_imm_s(inst.s.imm2, inst.s.imm1);
+        int data = REGS(inst.s.rs2);
+
+        int mask = (inst.i.func3 == OP_SB) ? 0xff :
+                   (inst.i.func3 == OP_SH) ? 0xffff :
+                   (inst.i.func3 == OP_SW) ? 0xffffffff :
+                   0xffffffff;
+
+        TIME_LOG; TRACE_LOG "%08x %08x", pc, inst.inst TRACE_END;
+
+        int result = memrw(ft, OP_STORE, inst.i.func3, address, &data);
+
+        if (singleram) CYCLE_ADD(1);
+
+        switch(result) {
+            case TRAP_ST_FAIL:
+                 TRACE_LOG "\n" TRACE_END;
+                 TRAP(TRAP_ST_FAIL, address);
+                 return;
+            case TRAP_ST_ALIGN:
+                 TRACE_LOG "\n" TRACE_END;
+                 TRAP(TRAP_ST_ALIGN, address);
+                 return;
+            case TRAP_INST_ILL:
+                 TRACE_LOG "\n" TRACE_END;
+                 TRAP(TRAP_INST_ILL, inst.inst);
+                 return;
         }
-        case OP_STORE: { // S-Type
-            int address = REGS(inst.s.rs1) +
-                          to_imm_s(inst.s.imm2, inst.s.imm1);
-            int data = REGS(inst.s.rs2);
-
-            int mask = (inst.i.func3 == OP_SB) ? 0xff :
-                       (inst.i.func3 == OP_SH) ? 0xffff :
-                       (inst.i.func3 == OP_SW) ? 0xffffffff :
-                       0xffffffff;
-
-            TIME_LOG; TRACE_LOG "%08x %08x", pc, inst.inst TRACE_END;
-
-            int result = memrw(ft, OP_STORE, inst.i.func3, address, &data);
-
-            if (singleram) CYCLE_ADD(1);
-
-            switch(result) {
-                case TRAP_ST_FAIL:
-                     TRACE_LOG "\n" TRACE_END;
-                     TRAP(TRAP_ST_FAIL, address);
-                     continue;
-                case TRAP_ST_ALIGN:
-                     TRACE_LOG "\n" TRACE_END;
-                     TRAP(TRAP_ST_ALIGN, address);
-                     continue;
-                case TRAP_INST_ILL:
-                     TRACE_LOG "\n" TRACE_END;
-                     TRAP(TRAP_INST_ILL, inst.inst);
-                     continue;
-            }
 
-            TRACE_LOG " write 0x%08x <= 0x%08x\n", address, (data & mask) TRACE_END;
+        hpm_count[HPM_STORE]++;
+        TRACE_LOG " write 0x%08x <= 0x%08x\n", address, (data & mask) TRACE_END;
 
-            break;
-        }
-        case OP_ARITHI: { // I-Type
-            switch(inst.i.func3) {
-                case OP_ADD:
-                    REGS_W(inst.i.rd, REGS(inst.i.rs1) + to_imm_i(inst.i.imm));
-                    break;
-                case OP_SLT:
-                    REGS_W(inst.i.rd, REGS(inst.i.rs1) < to_imm_i(inst.i.imm) ? 1 : 0);
-                    break;
-                case OP_SLTU:
-                    //FIXME: to pass compliance test, the IMM should be singed
-                    //extension, and compare with unsigned.
-                    //REGS_W(inst.i.rd, ((uint32_t)REGS(inst.i.rs1)) <
-                    //                ((uint32_t)to_imm_iu(inst.i.imm)) ? 1 : 0);
-                    REGS_W(inst.i.rd, ((uint32_t)REGS(inst.i.rs1)) <
-                                      ((uint32_t)to_imm_i(inst.i.imm)) ? 1 : 0);
-                    break;
-                case OP_XOR:
-                    REGS_W(inst.i.rd, REGS(inst.i.rs1) ^ to_imm_i(inst.i.imm));
-                    break;
-                case OP_OR:
-                    REGS_W(inst.i.rd, REGS(inst.i.rs1) | to_imm_i(inst.i.imm));
-                    break;
-                case OP_AND:
-                    REGS_W(inst.i.rd, REGS(inst.i.rs1) & to_imm_i(inst.i.imm));
-                    break;
-                case OP_SLL:
-                    switch (inst.r.func7) {
-                        case FN_RV32I:
-                            REGS_W(inst.i.rd, REGS(inst.i.rs1) << (inst.i.imm&0x1f));
-                            break;
-                        #ifdef RV32B_ENABLED
-                        case FN_BSET:
-                            REGS_W(inst.i.rd, REGS(inst.i.rs1) | (1 << (inst.i.imm&0x1f)));
-                            break;
-                        case FN_BCLR:
-                            REGS_W(inst.i.rd, REGS(inst.i.rs1) & ~(1 << (inst.i.imm&0x1f)));
-                            break;
-                        case FN_CLZ:
-                            switch (inst.r.rs2) {
-                                case 0: // CLZ
-                                    {
-                                        int32_t r = 0;
-                                        int32_t x = REGS(inst.i.rs1);
-                                        if (!x) {
-                                            r = 32;
-                                        } else {
-                                            if (!(x & 0xffff0000)) { x <<= 16; r += 16; }
-                                            if (!(x & 0xff000000)) { x <<=  8; r +=  8; }
-                                            if (!(x & 0xf0000000)) { x <<=  4; r +=  4; }
-                                            if (!(x & 0xc0000000)) { x <<=  2; r +=  2; }
-                                            if (!(x & 0x80000000)) {           r +=  1; }
-                                        }
-                                        REGS_W(inst.i.rd, r);
-                                    }
-                                    break;
-                                case 2: // CPOP
-                                    {
-                                        uint32_t c = 0;
-                                        int32_t n = REGS(inst.i.rs1);
-                                        while (n) {
-                                            n &= (n - 1);
-                                            c++;
-                                        }
-                                        REGS_W(inst.i.rd, c);
-                                    }
-                                    break;
-                                case 1: // CTZ
-                                    {
-                                        int32_t x = REGS(inst.i.rs1);
-	                                    static const uint8_t table[32] = {
-		                                    0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
-		                                    31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
-	                                    };
-                                        int32_t n = (!x) ? 32 : (int32_t)table[((uint32_t)((x & -x) * 0x077CB531U)) >> 27];
-	                                    REGS_W(inst.i.rd, n);
-                                    }
-                                    break;
-                                case 4: // SEXT.B
-                                    {
-                                        uint32_t n = REGS(inst.i.rs1) & 0xff;
-                                        if (n&0x80)
-                                            n |= 0xffffff00;
-                                        REGS_W(inst.i.rd, n);
+        break;
+    }
+    case OP_ARITHI: { // I-Type
+        switch(inst.i.func3) {
+            case OP_ADD:
+                REGS_W(inst.i.rd, REGS(inst.i.rs1) + to_imm_i(inst.i.imm));
+                break;
+            case OP_SLT:
+                REGS_W(inst.i.rd, REGS(inst.i.rs1) < to_imm_i(inst.i.imm) ? 1 : 0);
+                break;
+            case OP_SLTU:
+                //FIXME: to pass compliance test, the IMM should be singed
+                //extension, and compare with unsigned.
+                //REGS_W(inst.i.rd, ((uint32_t)REGS(inst.i.rs1)) <
+                //                ((uint32_t)to_imm_iu(inst.i.imm)) ? 1 : 0);
+                REGS_W(inst.i.rd, ((uint32_t)REGS(inst.i.rs1)) <
+                                  ((uint32_t)to_imm_i(inst.i.imm)) ? 1 : 0);
+                break;
+            case OP_XOR:
+                REGS_W(inst.i.rd, REGS(inst.i.rs1) ^ to_imm_i(inst.i.imm));
+                break;
+            case OP_OR:
+                REGS_W(inst.i.rd, REGS(inst.i.rs1) | to_imm_i(inst.i.imm));
+                break;
+            case OP_AND:
+                REGS_W(inst.i.rd, REGS(inst.i.rs1) & to_imm_i(inst.i.imm));
+                break;
+            case OP_SLL:
+                switch (inst.r.func7) {
+                    case FN_RV32I:
+                        REGS_W(inst.i.rd, REGS(inst.i.rs1) << (inst.i.imm&0x1f));
+                        break;
+                    #ifdef RV32B_ENABLED
+                    case FN_BSET:
+                        REGS_W(inst.i.rd, REGS(inst.i.rs1) | (1 << (inst.i.imm&0x1f)));
+                        break;
+                    case FN_BCLR:
+                        REGS_W(inst.i.rd, REGS(inst.i.rs1) & ~(1 << (inst.i.imm&0x1f)));
+                        break;
+                    case FN_CLZ:
+                        switch (inst.r.rs2) {
+                            case 0: // CLZ
+                                {
+                                    int32_t r = 0;
+                                    int32_t x = REGS(inst.i.rs1);
+                                    if (!x) {
+                                        r = 32;
+                                    } else {
+                                        if (!(x & 0xffff0000)) { x <<= 16; r += 16; }
+                                        if (!(x & 0xff000000)) { x <<=  8; r +=  8; }
+                                        if (!(x & 0xf0000000)) { x <<=  4; r +=  4; }
+                                        if (!(x & 0xc0000000)) { x <<=  2; r +=  2; }
+                                        if (!(x & 0x80000000)) {           r +=  1; }
                                     }
-                                    break;
-                                case 5: // SEXT.H
-                                    {
-                                        uint32_t n = REGS(inst.i.rs1) & 0xffff;
-                                        if (n&0x8000)
-                                            n |= 0xffff0000;
-                                        REGS_W(inst.i.rd, n);
+                                    REGS_W(inst.i.rd, r);
+                                }
+                                break;
+                            case 2: // CPOP
+                                {
+                                    uint32_t c = 0;
+                                    int32_t n = REGS(inst.i.rs1);
+                                    while (n) {
+                                        n &= (n - 1);
+                                        c++;
                                     }
-                                    break;
-                                default:
-                                    printf("Unknown instruction at PC 0x%08x\n", pc);
-                                    TRAP(TRAP_INST_ILL, inst.inst);
-                                    continue;
-                            }
-                            break;
-                        case FN_BINV:
-                            REGS_W(inst.i.rd, REGS(inst.i.rs1) ^ (1 << (inst.i.imm&0x1f)));
-                            break;
-                        #endif // RV32B_ENABLED
-                        default:
-                            printf("Unknown instruction at PC 0x%08x\n", pc);
-                            TRAP(TRAP_INST_ILL, inst.inst);
-                            continue;
-                    }
-                    break;
-                case OP_SR:
-                    switch (inst.r.func7) {
-                        case FN_SRL: // SRLI
-                            REGS_W(inst.i.rd, ((uint32_t)REGS(inst.i.rs1)) >>
-                                               (inst.i.imm&0x1f));
-                            break;
-                        case FN_SRA: // SRAI
-                            REGS_W(inst.i.rd, REGS(inst.i.rs1) >> (inst.i.imm&0x1f));
-                            break;
-                        #ifdef RV32B_ENABLED
-                        case FN_BSET:
-                            if (inst.r.rs2 == 7) { // ORC.B
-                                int32_t n = 0;
-                                int32_t v = REGS(inst.i.rs1);
-                                if (v & 0x000000ff) n |= 0x000000ff;
-                                if (v & 0x0000ff00) n |= 0x0000ff00;
-                                if (v & 0x00ff0000) n |= 0x00ff0000;
-                                if (v & 0xff000000) n |= 0xff000000;
-                                REGS_W(inst.i.rd, n);
-                            } else {
+                                    REGS_W(inst.i.rd, c);
+                                }
+                                break;
+                            case 1: // CTZ
+                                {
+                                    int32_t x = REGS(inst.i.rs1);
+	                                    static const uint8_t table[32] = {
+		                                    0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+		                                    31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+	                                    };
+                                    int32_t n = (!x) ? 32 : (int32_t)table[((uint32_t)((x & -x) * 0x077CB531U)) >> 27];
+	                                    REGS_W(inst.i.rd, n);
+                                }
+                                break;
+                            case 4: // SEXT.B
+                                {
+                                    uint32_t n = REGS(inst.i.rs1) & 0xff;
+                                    if (n&0x80)
+                                        n |= 0xffffff00;
+                                    REGS_W(inst.i.rd, n);
+                                }
+                                break;
+                            case 5: // SEXT.H
+                                {
+                                    uint32_t n = REGS(inst.i.rs1) & 0xffff;
+                                    if (n&0x8000)
+                                        n |= 0xffff0000;
+                                    REGS_W(inst.i.rd, n);
+                                }
+                                break;
+                            default:
                                 printf("Unknown instruction at PC 0x%08x\n", pc);
                                 TRAP(TRAP_INST_ILL, inst.inst);
-                                continue;
-                            }
-                            break;
-                        case FN_BCLR: // BCLRI
-                            REGS_W(inst.i.rd, (REGS(inst.i.rs1) >> (inst.i.imm&0x1f)) & 1);
-                            break;
-                        case FN_CLZ: // RORI
-                            {
-                                uint32_t n = REGS(inst.i.rs1);
-                                REGS_W(inst.i.rd, (n >> (inst.i.imm&0x1f)) |
-                                                  (n << (32 - (inst.i.imm&0x1f))));
-                            }
-                            break;
-                        case FN_REV:
-                            switch(inst.i.imm&0x1f) {
-                                case 0x18: // REV.8
-                                    {
-                                        uint32_t n = REGS(inst.i.rs1);
-                                        REGS_W(inst.i.rd,
-                                               ((n >> 24) & 0x000000ff) |
-                                               ((n >>  8) & 0x0000ff00) |
-                                               ((n <<  8) & 0x00ff0000) |
-                                               ((n << 24) & 0xff000000));
-                                    }
-                                    break;
-                                default:
-                                    printf("Unknown instruction at PC 0x%08x\n", pc);
-                                    TRAP(TRAP_INST_ILL, inst.inst);
-                                    continue;
-                            }
-                            break;
-                        #endif // RV32B_ENABLED
-                        default:
+                                return;
+                        }
+                        break;
+                    case FN_BINV:
+                        REGS_W(inst.i.rd, REGS(inst.i.rs1) ^ (1 << (inst.i.imm&0x1f)));
+                        break;
+                    #endif // RV32B_ENABLED
+                    default:
+                        printf("Unknown instruction at PC 0x%08x\n", pc);
+                        TRAP(TRAP_INST_ILL, inst.inst);
+                        return;
+                }
+                break;
+            case OP_SR:
+                switch (inst.r.func7) {
+                    case FN_SRL: // SRLI
+                        REGS_W(inst.i.rd, ((uint32_t)REGS(inst.i.rs1)) >>
+                                           (inst.i.imm&0x1f));
+                        break;
+                    case FN_SRA: // SRAI
+                        REGS_W(inst.i.rd, REGS(inst.i.rs1) >> (inst.i.imm&0x1f));
+                        break;
+                    #ifdef RV32B_ENABLED
+                    case FN_BSET:
+                        if (inst.r.rs2 == 7) { // ORC.B
+                            int32_t n = 0;
+                            int32_t v = REGS(inst.i.rs1);
+                            if (v & 0x000000ff) n |= 0x000000ff;
+                            if (v & 0x0000ff00) n |= 0x0000ff00;
+                            if (v & 0x00ff0000) n |= 0x00ff0000;
+                            if (v & 0xff000000) n |= 0xff000000;
+                            REGS_W(inst.i.rd, n);
+                        } else {
                             printf("Unknown instruction at PC 0x%08x\n", pc);
                             TRAP(TRAP_INST_ILL, inst.inst);
-                            continue;
-                    }
-                    break;
-                default:
-                    printf("Unknown instruction at PC 0x%08x\n", pc);
-                    TRAP(TRAP_INST_ILL, inst.inst);
-                    continue;
-            }
-            TIME_LOG; TRACE_LOG "%08x %08x x%02u (%s) <= 0x%08x\n",
-                      pc, inst.inst, inst.i.rd, regname[inst.i.rd],
-                      REGS(inst.i.rd) TRACE_END;
-            break;
+                            return;
+                        }
+                        break;
+                    case FN_BCLR: // BCLRI
+                        REGS_W(inst.i.rd, (REGS(inst.i.rs1) >> (inst.i.imm&0x1f)) & 1);
+                        break;
+                    case FN_CLZ: // RORI
+                        {
+                            uint32_t n = REGS(inst.i.rs1);
+                            REGS_W(inst.i.rd, (n >> (inst.i.imm&0x1f)) |
+                                              (n << (32 - (inst.i.imm&0x1f))));
+                        }
+                        break;
+                    case FN_REV:
+                        switch(inst.i.imm&0x1f) {
+                            case 0x18: // REV.8
+                                {
+                                    uint32_t n = REGS(inst.i.rs1);
+                                    REGS_W(inst.i.rd,
+                                           ((n >> 24) & 0x000000ff) |
+                                           ((n >>  8) & 0x0000ff00) |
+                                           ((n <<  8) & 0x00ff0000) |
+                                           ((n << 24) & 0xff000000));
+                                }
+                                break;
+                            default:
+                                printf("Unknown instruction at PC 0x%08x\n", pc);
+                                TRAP(TRAP_INST_ILL, inst.inst);
+                                return;
+                        }
+                        break;
+                    #endif // RV32B_ENABLED
+                    default:
+                        printf("Unknown instruction at PC 0x%08x\n", pc);
+                        TRAP(TRAP_INST_ILL, inst.inst);
+                        return;
+                }
+                break;
+            default:
+                printf("Unknown instruction at PC 0x%08x\n", pc);
+                TRAP(TRAP_INST_ILL, inst.inst);
+                return;
         }
-        case OP_ARITHR: { // R-Type
-            switch (inst.r.func7) {
-                #ifdef RV32M_ENABLED
-                case FN_RV32M: // RV32M Multiply Extension
-                    switch(inst.r.func3) {
-                        case OP_MUL:
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) *
-                                              REGS(inst.r.rs2));
-                            break;
-                        case OP_MULH:
-                            {
-                            union {
-                                int64_t l;
-                                struct { int32_t l, h; } n;
-                            } a, b, r;
-                            a.l = (int64_t)REGS(inst.r.rs1);
-                            b.l = (int64_t)REGS(inst.r.rs2);
-                            r.l = a.l * b.l;
-                            REGS_W(inst.r.rd, r.n.h);
-                            }
-                            break;
-                        case OP_MULSU:
-                            {
-                            union {
-                                int64_t l;
-                                struct { int32_t l, h; } n;
-                            } a, b, r;
-                            a.l = (int64_t)REGS(inst.r.rs1);
-                            b.n.l = REGS(inst.r.rs2);
-                            b.n.h = 0;
-                            r.l = a.l * b.l;
-                            REGS_W(inst.r.rd, r.n.h);
-                            }
-                            break;
-                        case OP_MULU:
-                            {
-                            union {
-                                int64_t l;
-                                struct { int32_t l, h; } n;
-                            } a, b, r;
-                            a.n.l = REGS(inst.r.rs1); a.n.h = 0;
-                            b.n.l = REGS(inst.r.rs2); b.n.h = 0;
-                            r.l = ((uint64_t)a.l) *
-                                  ((uint64_t)b.l);
-                            REGS_W(inst.r.rd, r.n.h);
-                            }
-                            break;
-                        case OP_DIV:
-                            if (REGS(inst.r.rs2))
-                                REGS_W(inst.r.rd, (int32_t)(((int64_t)REGS(inst.r.rs1)) /
-                                                            REGS(inst.r.rs2)));
-                            else
-                                REGS_W(inst.r.rd, 0xffffffff);
-                            break;
-                        case OP_DIVU:
-                            if (REGS(inst.r.rs2))
-                                REGS_W(inst.r.rd, (int32_t)(((uint32_t)REGS(inst.r.rs1)) /
-                                                            ((uint32_t)REGS(inst.r.rs2))));
-                            else
-                                REGS_W(inst.r.rd, 0xffffffff);
-                            break;
-                        case OP_REM:
-                            if (REGS(inst.r.rs2))
-                                REGS_W(inst.r.rd, (int32_t)(((int64_t)REGS(inst.r.rs1)) %
-                                                            REGS(inst.r.rs2)));
-                            else
-                                REGS_W(inst.r.rd, REGS(inst.r.rs1));
-                            break;
-                        case OP_REMU:
-                            if (REGS(inst.r.rs2))
-                                REGS_W(inst.r.rd, (int32_t)(((uint32_t)REGS(inst.r.rs1)) %
-                                                            ((uint32_t)REGS(inst.r.rs2))));
-                            else
-                                REGS_W(inst.r.rd, REGS(inst.r.rs1));
-                            break;
-                        default:
-                            printf("Unknown instruction at PC 0x%08x\n", pc);
-                            TRAP(TRAP_INST_ILL, inst.inst);
-                            continue;
-                    }
+        TIME_LOG; TRACE_LOG "%08x %08x x%02u (%s) <= 0x%08x\n",
+                  pc, inst.inst, inst.i.rd, regname[inst.i.rd],
+                  REGS(inst.i.rd) TRACE_END;
+        break;
+    }
+    case OP_ARITHR: { // R-Type
+        switch (inst.r.func7) {
+            #ifdef RV32M_ENABLED
+            case FN_RV32M: // RV32M Multiply Extension
+                hpm_count[HPM_MULDIV]++;
+                switch(inst.r.func3) {
+                    case OP_MUL:
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) *
+                                          REGS(inst.r.rs2));
+                        break;
+                    case OP_MULH:
+                        {
+                        union {
+                            int64_t l;
+                            struct { int32_t l, h; } n;
+                        } a, b, r;
+                        a.l = (int64_t)REGS(inst.r.rs1);
+                        b.l = (int64_t)REGS(inst.r.rs2);
+                        r.l = a.l * b.l;
+                        REGS_W(inst.r.rd, r.n.h);
+                        }
+                        break;
+                    case OP_MULSU:
+                        {
+                        union {
+                            int64_t l;
+                            struct { int32_t l, h; } n;
+                        } a, b, r;
+                        a.l = (int64_t)REGS(inst.r.rs1);
+                        b.n.l = REGS(inst.r.rs2);
+                        b.n.h = 0;
+                        r.l = a.l * b.l;
+                        REGS_W(inst.r.rd, r.n.h);
+                        }
+                        break;
+                    case OP_MULU:
+                        {
+                        union {
+                            int64_t l;
+                            struct { int32_t l, h; } n;
+                        } a, b, r;
+                        a.n.l = REGS(inst.r.rs1); a.n.h = 0;
+                        b.n.l = REGS(inst.r.rs2); b.n.h = 0;
+                        r.l = ((uint64_t)a.l) *
+                              ((uint64_t)b.l);
+                        REGS_W(inst.r.rd, r.n.h);
+                        }
+                        break;
+                    case OP_DIV:
+                        if (REGS(inst.r.rs2))
+                            REGS_W(inst.r.rd, (int32_t)(((int64_t)REGS(inst.r.rs1)) /
+                                                        REGS(inst.r.rs2)));
+                        else
+                            REGS_W(inst.r.rd, 0xffffffff);
+                        break;
+                    case OP_DIVU:
+                        if (REGS(inst.r.rs2))
+                            REGS_W(inst.r.rd, (int32_t)(((uint32_t)REGS(inst.r.rs1)) /
+                                                        ((uint32_t)REGS(inst.r.rs2))));
+                        else
+                            REGS_W(inst.r.rd, 0xffffffff);
+                        break;
+                    case OP_REM:
+                        if (REGS(inst.r.rs2))
+                            REGS_W(inst.r.rd, (int32_t)(((int64_t)REGS(inst.r.rs1)) %
+                                                        REGS(inst.r.rs2)));
+                        else
+                            REGS_W(inst.r.rd, REGS(inst.r.rs1));
+                        break;
+                    case OP_REMU:
+                        if (REGS(inst.r.rs2))
+                            REGS_W(inst.r.rd, (int32_t)(((uint32_t)REGS(inst.r.rs1)) %
+                                                        ((uint32_t)REGS(inst.r.rs2))));
+                        else
+                            REGS_W(inst.r.rd, REGS(inst.r.rs1));
+                        break;
+                    default:
+                        printf("Unknown instruction at PC 0x%08x\n", pc);
+                        TRAP(TRAP_INST_ILL, inst.inst);
+                        return;
+                }
+            break;
+            #endif // RV32M_ENABLED
+
+            case FN_RV32I:
+                switch(inst.r.func3) {
+                    case OP_ADD:
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) + REGS(inst.r.rs2));
+                        break;
+                    case OP_SLL:
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) << REGS(inst.r.rs2));
+                        break;
+                    case OP_SLT:
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) < REGS(inst.r.rs2) ?
+                                          1 : 0);
+                        break;
+                    case OP_SLTU:
+                        REGS_W(inst.r.rd, ((uint32_t)REGS(inst.r.rs1)) <
+                             ((uint32_t)REGS(inst.r.rs2)) ? 1 : 0);
+                        break;
+                    case OP_XOR:
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) ^ REGS(inst.r.rs2));
+                        break;
+                    case OP_SR:
+                        REGS_W(inst.r.rd, ((uint32_t)REGS(inst.r.rs1)) >>
+                                          REGS(inst.r.rs2));
+                        break;
+                    case OP_OR:
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) | REGS(inst.r.rs2));
+                        break;
+                    case OP_AND:
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) & REGS(inst.r.rs2));
+                        break;
+                    default:
+                        printf("Unknown instruction at PC 0x%08x\n", pc);
+                        TRAP(TRAP_INST_ILL, inst.inst);
+                        return;
+                }
+            break;
+
+            case FN_ANDN:
+                switch(inst.r.func3) {
+                    case OP_ADD: // SUB
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) - REGS(inst.r.rs2));
+                        break;
+                    case OP_SR: // SRA
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) >> REGS(inst.r.rs2));
+                        break;
+                    #ifdef RV32B_ENABLED
+                    case OP_AND: // ANDN
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) & ~(REGS(inst.r.rs2)));
+                        break;
+                    case OP_OR: // ORN
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) | ~(REGS(inst.r.rs2)));
+                        break;
+                    case OP_XOR: // XNOR
+                        REGS_W(inst.r.rd, ~(REGS(inst.r.rs1) ^ REGS(inst.r.rs2)));
+                        break;
+                    #endif // RV32B_ENABLED
+                    default:
+                        printf("Unknown instruction at PC 0x%08x\n", pc);
+                        TRAP(TRAP_INST_ILL, inst.inst);
+                        return;
+                }
                 break;
-                #endif // RV32M_ENABLED
-
-                case FN_RV32I:
-                    switch(inst.r.func3) {
-                        case OP_ADD:
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) + REGS(inst.r.rs2));
-                            break;
-                        case OP_SLL:
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) << REGS(inst.r.rs2));
-                            break;
-                        case OP_SLT:
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) < REGS(inst.r.rs2) ?
-                                              1 : 0);
-                            break;
-                        case OP_SLTU:
-                            REGS_W(inst.r.rd, ((uint32_t)REGS(inst.r.rs1)) <
-                                 ((uint32_t)REGS(inst.r.rs2)) ? 1 : 0);
-                            break;
-                        case OP_XOR:
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) ^ REGS(inst.r.rs2));
-                            break;
-                        case OP_SR:
-                            REGS_W(inst.r.rd, ((uint32_t)REGS(inst.r.rs1)) >>
-                                              REGS(inst.r.rs2));
-                            break;
-                        case OP_OR:
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) | REGS(inst.r.rs2));
-                            break;
-                        case OP_AND:
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) & REGS(inst.r.rs2));
-                            break;
-                        default:
-                            printf("Unknown instruction at PC 0x%08x\n", pc);
-                            TRAP(TRAP_INST_ILL, inst.inst);
-                            continue;
-                    }
+
+            #ifdef RV32B_ENABLED
+            case FN_ZEXT:
+                REGS_W(inst.r.rd, REGS(inst.r.rs1) & 0xffff);
                 break;
 
-                case FN_ANDN:
-                    switch(inst.r.func3) {
-                        case OP_ADD: // SUB
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) - REGS(inst.r.rs2));
-                            break;
-                        case OP_SR: // SRA
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) >> REGS(inst.r.rs2));
-                            break;
-                        #ifdef RV32B_ENABLED
-                        case OP_AND: // ANDN
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) & ~(REGS(inst.r.rs2)));
-                            break;
-                        case OP_OR: // ORN
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) | ~(REGS(inst.r.rs2)));
-                            break;
-                        case OP_XOR: // XNOR
-                            REGS_W(inst.r.rd, ~(REGS(inst.r.rs1) ^ REGS(inst.r.rs2)));
-                            break;
-                        #endif // RV32B_ENABLED
-                        default:
-                            printf("Unknown instruction at PC 0x%08x\n", pc);
-                            TRAP(TRAP_INST_ILL, inst.inst);
-                            continue;
-                    }
-                    break;
+            case FN_MINMAX:
+                switch(inst.r.func3) {
+                    case OP_CLMUL:
+                        {
+                            int32_t a = REGS(inst.r.rs1);
+                            int32_t b = REGS(inst.r.rs2);
+                            int32_t n = 0;
 
-                #ifdef RV32B_ENABLED
-                case FN_ZEXT:
-                    REGS_W(inst.r.rd, REGS(inst.r.rs1) & 0xffff);
-                    break;
+                            for(int i = 0; i <= 31; i++)
+                                if ((b >> i) & 1) n ^= (a << i);
 
-                case FN_MINMAX:
-                    switch(inst.r.func3) {
-                        case OP_CLMUL:
-                            {
-                                int32_t a = REGS(inst.r.rs1);
-                                int32_t b = REGS(inst.r.rs2);
-                                int32_t n = 0;
-
-                                for(int i = 0; i <= 31; i++)
-                                    if ((b >> i) & 1) n ^= (a << i);
-
-                                REGS_W(inst.r.rd, n);
-                            }
-                            break;
-                        case OP_CLMULH:
-                            {
-                                uint32_t a = REGS(inst.r.rs1);
-                                uint32_t b = REGS(inst.r.rs2);
-                                int32_t n = 0;
-
-                                for(int i = 1; i < 32; i++)
-                                    if ((b >> i) & 1) n ^= (a >> (32 - i));
-
-                                REGS_W(inst.r.rd, n);
-                            }
-                            break;
-                        case OP_CLMULR:
-                            {
-                                uint32_t a = REGS(inst.r.rs1);
-                                uint32_t b = REGS(inst.r.rs2);
-                                int32_t n = 0;
-
-                                for(int i = 0; i < 32; i++)
-                                    if ((b >> i) & 1) n ^= (a >> (32 - i - 1));
-
-                                REGS_W(inst.r.rd, n);
-                            }
-                            break;
-                        case OP_MAX:
-                            {
-                                int32_t a = REGS(inst.r.rs1);
-                                int32_t b = REGS(inst.r.rs2);
-                                REGS_W(inst.r.rd, a > b ? a : b);
-                            }
-                            break;
-                        case OP_MAXU:
-                            {
-                                uint32_t a = REGS(inst.r.rs1);
-                                uint32_t b = REGS(inst.r.rs2);
-                                REGS_W(inst.r.rd, a > b ? a : b);
-                            }
-                            break;
-                        case OP_MIN:
-                            {
-                                int32_t a = REGS(inst.r.rs1);
-                                int32_t b = REGS(inst.r.rs2);
-                                REGS_W(inst.r.rd, a < b ? a : b);
-                            }
-                            break;
-                        case OP_MINU:
-                            {
-                                uint32_t a = REGS(inst.r.rs1);
-                                uint32_t b = REGS(inst.r.rs2);
-                                REGS_W(inst.r.rd, a < b ? a : b);
-                            }
-                            break;
-                        default:
-                            printf("Unknown instruction at PC 0x%08x\n", pc);
-                            TRAP(TRAP_INST_ILL, inst.inst);
-                            continue;
-                    }
-                    break;
+                            REGS_W(inst.r.rd, n);
+                        }
+                        break;
+                    case OP_CLMULH:
+                        {
+                            uint32_t a = REGS(inst.r.rs1);
+                            uint32_t b = REGS(inst.r.rs2);
+                            int32_t n = 0;
 
-                case FN_SHADD:
-                    switch(inst.r.func3) {
-                        case OP_SH1ADD:
-                            REGS_W(inst.r.rd, REGS(inst.r.rs2) + (REGS(inst.r.rs1) << 1));
-                            break;
-                        case OP_SH2ADD:
-                            REGS_W(inst.r.rd, REGS(inst.r.rs2) + (REGS(inst.r.rs1) << 2));
-                            break;
-                        case OP_SH3ADD:
-                            REGS_W(inst.r.rd, REGS(inst.r.rs2) + (REGS(inst.r.rs1) << 3));
-                            break;
-                        default:
-                            printf("Unknown instruction at PC 0x%08x\n", pc);
-                            TRAP(TRAP_INST_ILL, inst.inst);
-                            continue;
-                    }
-                    break;
+                            for(int i = 1; i < 32; i++)
+                                if ((b >> i) & 1) n ^= (a >> (32 - i));
 
-                case FN_BSET:
-                    REGS_W(inst.r.rd, REGS(inst.r.rs1) | (1 << (REGS(inst.r.rs2) & 0x1f)));
-                    break;
+                            REGS_W(inst.r.rd, n);
+                        }
+                        break;
+                    case OP_CLMULR:
+                        {
+                            uint32_t a = REGS(inst.r.rs1);
+                            uint32_t b = REGS(inst.r.rs2);
+                            int32_t n = 0;
 
-                case FN_BCLR:
-                    switch(inst.r.func3) {
-                        case OP_BCLR:
-                            REGS_W(inst.r.rd, REGS(inst.r.rs1) & ~(1 << (REGS(inst.r.rs2) & 0x1f)));
-                            break;
-                        case OP_BEXT:
-                            REGS_W(inst.r.rd, (REGS(inst.r.rs1) >> (REGS(inst.r.rs2) & 0x1f)) & 1);
-                            break;
-                        default:
-                            printf("Unknown instruction at PC 0x%08x\n", pc);
-                            TRAP(TRAP_INST_ILL, inst.inst);
-                            continue;
-                    }
-                    break;
+                            for(int i = 0; i < 32; i++)
+                                if ((b >> i) & 1) n ^= (a >> (32 - i - 1));
 
-                case FN_CLZ:
-                    switch(inst.r.func3) {
-                        case OP_ROL:
-                            {
-                                uint32_t n = REGS(inst.r.rs2) & 0x1f;
-                                REGS_W(inst.r.rd, (REGS(inst.r.rs1) << n) |
-                                                  ((uint32_t)REGS(inst.r.rs1) >> (32 - n)));
-                            }
-                            break;
-                        case OP_ROR:
-                            {
-                                uint32_t n = REGS(inst.r.rs2) & 0x1f;
-                                REGS_W(inst.r.rd, ((uint32_t)REGS(inst.r.rs1) >> n) |
-                                                  (REGS(inst.r.rs1) << (32 - n)));
-                            }
-                            break;
-                        default:
-                            printf("Unknown instruction at PC 0x%08x\n", pc);
-                            TRAP(TRAP_INST_ILL, inst.inst);
-                            continue;
-                    }
-                    break;
+                            REGS_W(inst.r.rd, n);
+                        }
+                        break;
+                    case OP_MAX:
+                        {
+                            int32_t a = REGS(inst.r.rs1);
+                            int32_t b = REGS(inst.r.rs2);
+                            REGS_W(inst.r.rd, a > b ? a : b);
+                        }
+                        break;
+                    case OP_MAXU:
+                        {
+                            uint32_t a = REGS(inst.r.rs1);
+                            uint32_t b = REGS(inst.r.rs2);
+                            REGS_W(inst.r.rd, a > b ? a : b);
+                        }
+                        break;
+                    case OP_MIN:
+                        {
+                            int32_t a = REGS(inst.r.rs1);
+                            int32_t b = REGS(inst.r.rs2);
+                            REGS_W(inst.r.rd, a < b ? a : b);
+                        }
+                        break;
+                    case OP_MINU:
+                        {
+                            uint32_t a = REGS(inst.r.rs1);
+                            uint32_t b = REGS(inst.r.rs2);
+                            REGS_W(inst.r.rd, a < b ? a : b);
+                        }
+                        break;
+                    default:
+                        printf("Unknown instruction at PC 0x%08x\n", pc);
+                        TRAP(TRAP_INST_ILL, inst.inst);
+                        return;
+                }
+                break;
 
-                case FN_BINV:
-                    REGS_W(inst.r.rd, REGS(inst.r.rs1) ^ (1 << (REGS(inst.r.rs2) & 0x1f)));
-                    break;
-                #endif // RV32B_ENABLED
+            case FN_SHADD:
+                switch(inst.r.func3) {
+                    case OP_SH1ADD:
+                        REGS_W(inst.r.rd, REGS(inst.r.rs2) + (REGS(inst.r.rs1) << 1));
+                        break;
+                    case OP_SH2ADD:
+                        REGS_W(inst.r.rd, REGS(inst.r.rs2) + (REGS(inst.r.rs1) << 2));
+                        break;
+                    case OP_SH3ADD:
+                        REGS_W(inst.r.rd, REGS(inst.r.rs2) + (REGS(inst.r.rs1) << 3));
+                        break;
+                    default:
+                        printf("Unknown instruction at PC 0x%08x\n", pc);
+                        TRAP(TRAP_INST_ILL, inst.inst);
+                        return;
+                }
+                break;
 
-                default:
-                    printf("Unknown instruction at PC 0x%08x\n", pc);
-                    TRAP(TRAP_INST_ILL, inst.inst);
-                    continue;
-            }
-            TIME_LOG; TRACE_LOG "%08x %08x x%02u (%s) <= 0x%08x\n",
-                      pc, inst.inst, inst.r.rd, regname[inst.r.rd],
-                      REGS(inst.r.rd) TRACE_END;
-            break;
-        }
-        case OP_FENCE: {
-            TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
-            break;
+            case FN_BSET:
+                REGS_W(inst.r.rd, REGS(inst.r.rs1) | (1 << (REGS(inst.r.rs2) & 0x1f)));
+                break;
+
+            case FN_BCLR:
+                switch(inst.r.func3) {
+                    case OP_BCLR:
+                        REGS_W(inst.r.rd, REGS(inst.r.rs1) & ~(1 << (REGS(inst.r.rs2) & 0x1f)));
+                        break;
+                    case OP_BEXT:
+                        REGS_W(inst.r.rd, (REGS(inst.r.rs1) >> (REGS(inst.r.rs2) & 0x1f)) & 1);
+                        break;
+                    default:
+                        printf("Unknown instruction at PC 0x%08x\n", pc);
+                        TRAP(TRAP_INST_ILL, inst.inst);
+                        return;
+                }
+                break;
+
+            case FN_CLZ:
+                switch(inst.r.func3) {
+                    case OP_ROL:
+                        {
+                            uint32_t n = REGS(inst.r.rs2) & 0x1f;
+                            REGS_W(inst.r.rd, (REGS(inst.r.rs1) << n) |
+                                              ((uint32_t)REGS(inst.r.rs1) >> (32 - n)));
+                        }
+                        break;
+                    case OP_ROR:
+                        {
+                            uint32_t n = REGS(inst.r.rs2) & 0x1f;
+                            REGS_W(inst.r.rd, ((uint32_t)REGS(inst.r.rs1) >> n) |
+                                              (REGS(inst.r.rs1) << (32 - n)));
+                        }
+                        break;
+                    default:
+                        printf("Unknown instruction at PC 0x%08x\n", pc);
+                        TRAP(TRAP_INST_ILL, inst.inst);
+                        return;
+                }
+                break;
+
+            case FN_BINV:
+                REGS_W(inst.r.rd, REGS(inst.r.rs1) ^ (1 << (REGS(inst.r.rs2) & 0x1f)));
+                break;
+            #endif // RV32B_ENABLED
+
+            default:
+                printf("Unknown instruction at PC 0x%08x\n", pc);
+                TRAP(TRAP_INST_ILL, inst.inst);
+                return;
         }
-        case OP_SYSTEM: { // I-Type
-            int val;
-            int update;
-            int csr_op = 0;
-            int csr_type;
-            // RDCYCLE, RDTIME and RDINSTRET are read only
-            switch(inst.i.func3) {
-                case OP_ECALL:
-                    TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
-                    switch (inst.i.imm & 3) {
-                       case 0: // ecall
-                           if (1) { // syscall, to compatible FreeRTOS usage, don't use it.
-                               int res;
+        TIME_LOG; TRACE_LOG "%08x %08x x%02u (%s) <= 0x%08x\n",
+                  pc, inst.inst, inst.r.rd, regname[inst.r.rd],
+                  REGS(inst.r.rd) TRACE_END;
+        break;
+    }
+    case OP_FENCE: {
+        TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
+        break;
+    }
+    case OP_SYSTEM: { // I-Type
+        int val;
+        int update;
+        int csr_op = 0;
+        int csr_type;
+        // RDCYCLE, RDTIME and RDINSTRET are read only
+        switch(inst.i.func3) {
+            case OP_ECALL:
+                TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
+                // Wait for interrupt. Nothing else runs while waiting, so
+                // jump to the timer deadline. Only the timer interrupt can
+                // arrive, so it is a NOP if the timer interrupt is disabled.
+                if (inst.inst == INST_WFI) {
+                    if ((csr.mie & (1 << MTIE)) &&
+                        !(sw_irq && (csr.mie & (1 << MSIE))) &&
+                        !(ext_irq && (csr.mie & (1 << MEIE))) &&
+                        csr.mtimecmp.c > csr.mtime.c) {
+                        long long idle = csr.mtimecmp.c - csr.mtime.c;
+                        wfi_cycles += idle;
+                        CYCLE_ADD(idle);
+                    }
+                    break;
+                }
+                switch (inst.i.imm & 3) {
+                   case 0: // ecall
+                       if (1) { // syscall, to compatible FreeRTOS usage, don't use it.
+                           int res;
+                           // the RTL does the host call in lockstep
+                           if (lockstep && REGS(SYS) != SYS_EXIT)
+                               res = lockstep_host(REGS(SYS), REGS(A0),
+                                                   REGS(A1), REGS(A2));
+                           else
                                res = srv32_syscall(REGS(SYS), REGS(A0),
                                                    REGS(A1), REGS(A2),
                                                    REGS(A3), REGS(A4),
                                                    REGS(A5));
-                               // Notes: FreeRTOS will use ecall to perform context switching.
-                               // The syscall of newlib will confict with the syscall of
-                               // FreeRTOS.
-                               #if 0
-                               // FIXME: if it is prefined syscall, excute it.
-                               // otherwise raising a trap
-                               if (res != -1) {
-                                    REGS_W(A0, res);
-                               } else {
-                                    TRAP(TRAP_ECALL, 0);
-                                    continue;
-                               }
-                               break;
-                               #else
-                               if (res != -1)
-                                    REGS_W(A0, res);
-                               TRAP(TRAP_ECALL, 0);
-                               continue;
-                               #endif
+                           // Notes: FreeRTOS will use ecall to perform context switching.
+                           // The syscall of newlib will confict with the syscall of
+                           // FreeRTOS.
+                           #if 0
+                           // FIXME: if it is prefined syscall, excute it.
+                           // otherwise raising a trap
+                           if (res != -1) {
+                                REGS_W(A0, res);
                            } else {
-                               TRAP(TRAP_ECALL, 0);
-                               continue;
+                                TRAP(TRAP_ECALL, 0);
+                                return;
                            }
-                       case 1: // ebreak
-                           TRAP(TRAP_BREAK, pc);
-                           continue;
-                       case 2: // mret
-                           pc = csr.mepc;
-                           // mstatus.mie = mstatus.mpie
-                           csr.mstatus = (csr.mstatus & (1 << MPIE)) ?
-                                         (csr.mstatus | (1 << MIE)) :
-                                         (csr.mstatus & ~(1 << MIE));
-                           // mstatus.mpie = 1
-
-                           #ifndef RV32C_ENABLED
-                           if ((pc&3) != 0) {
-                               // Instruction address misaligned
-                               continue;
-                           }
-                           #endif // RV32C_ENABLED
-                           CYCLE_ADD(branch_penalty);
-                           continue;
-                       default:
-                           printf("Illegal system call at PC 0x%08x\n", pc);
-                           TRAP(TRAP_INST_ILL, 0);
-                           continue;
-                    }
-                    break;
-                case OP_CSRRWI:
-                    csr_op   = 1;
-                    val      = inst.i.rs1;
-                    update   = 1;
-                    csr_type = OP_CSRRW;
-                    break;
-                // If the zimm[4:0] field is zero, then these instructions will not write
-                // to the CSR
-                case OP_CSRRW:
-                    csr_op   = 1;
-                    val      = REGS(inst.i.rs1);
-                    update   = 1;
-                    csr_type = OP_CSRRW;
-                    break;
-                // For both CSRRS and CSRRC, if rs1=x0, then the instruction will not
-                // write to the CSR at all
-                case OP_CSRRSI:
-                    csr_op   = 1;
-                    val      = inst.i.rs1;
-                    update   = (inst.i.rs1 == 0) ? 0 : 1;
-                    csr_type = OP_CSRRS;
-                    break;
-                case OP_CSRRS:
-                    csr_op   = 1;
-                    val      = REGS(inst.i.rs1);
-                    update   = (inst.i.rs1 == 0) ? 0 : 1;
-                    csr_type = OP_CSRRS;
-                    break;
-                case OP_CSRRCI:
-                    csr_op   = 1;
-                    val      = inst.i.rs1;
-                    update   = (inst.i.rs1 == 0) ? 0 : 1;
-                    csr_type = OP_CSRRC;
-                    break;
-                case OP_CSRRC:
-                    csr_op   = 1;
-                    val      = REGS(inst.i.rs1);
-                    update   = (inst.i.rs1 == 0) ? 0 : 1;
-                    csr_type = OP_CSRRC;
-                    break;
-                default:
-                    printf("Unknown system instruction at PC 0x%08x\n", pc);
-                    TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
-                    TRAP(TRAP_INST_ILL, inst.inst);
-                    continue;
-            }
-            if (csr_op) {
-                int legal = 0;
-                int result = csr_rw(inst.i.imm, csr_type, val, update, &legal);
-                if (legal) {
-                    REGS_W(inst.i.rd, result);
+                           break;
+                           #else
+                           if (res != -1)
+                                REGS_W(A0, res);
+                           TRAP(TRAP_ECALL, 0);
+                           return;
+                           #endif
+                       } else {
+                           TRAP(TRAP_ECALL, 0);
+                           return;
+                       }
+                   case 1: // ebreak
+                       TRAP(TRAP_BREAK, pc);
+                       return;
+                   case 2: // mret
+                       pc = csr.mepc;
+                       // mstatus.mie = mstatus.mpie
+                       csr.mstatus = (csr.mstatus & (1 << MPIE)) ?
+                                     (csr.mstatus | (1 << MIE)) :
+                                     (csr.mstatus & ~(1 << MIE));
+                       // mstatus.mpie = 1
+
+                       if (callgraph_en)
+                           callgraph_mret(pc);
+
+                       #ifndef RV32C_ENABLED
+                       if ((pc&3) != 0) {
+                           // Instruction address misaligned
+                           return;
+                       }
+                       #endif // RV32C_ENABLED
+                       CYCLE_ADD(branch_penalty);
+                       return;
+                   default:
+                       printf("Illegal system call at PC 0x%08x\n", pc);
+                       TRAP(TRAP_INST_ILL, 0);
+                       return;
                 }
-                TIME_LOG; TRACE_LOG "%08x %08x",
-                          pc, inst.inst TRACE_END;
-                if (!legal) {
-                   TRACE_LOG "\n" TRACE_END;
-                   TRAP(TRAP_INST_ILL, 0);
-                   continue;
-                }
-                TRACE_LOG " x%02u (%s) <= 0x%08x\n",
-                          inst.i.rd,
-                          regname[inst.i.rd], REGS(inst.i.rd) TRACE_END;
+                break;
+            case OP_CSRRWI:
+                csr_op   = 1;
+                val      = inst.i.rs1;
+                update   = 1;
+                csr_type = OP_CSRRW;
+                break;
+            // If the zimm[4:0] field is zero, then these instructions will not write
+            // to the CSR
+            case OP_CSRRW:
+                csr_op   = 1;
+                val      = REGS(inst.i.rs1);
+                update   = 1;
+                csr_type = OP_CSRRW;
+                break;
+            // For both CSRRS and CSRRC, if rs1=x0, then the instruction will not
+            // write to the CSR at all
+            case OP_CSRRSI:
+                csr_op   = 1;
+                val      = inst.i.rs1;
+                update   = (inst.i.rs1 == 0) ? 0 : 1;
+                csr_type = OP_CSRRS;
+                break;
+            case OP_CSRRS:
+                csr_op   = 1;
+                val      = REGS(inst.i.rs1);
+                update   = (inst.i.rs1 == 0) ? 0 : 1;
+                csr_type = OP_CSRRS;
+                break;
+            case OP_CSRRCI:
+                csr_op   = 1;
+                val      = inst.i.rs1;
+                update   = (inst.i.rs1 == 0) ? 0 : 1;
+                csr_type = OP_CSRRC;
+                break;
+            case OP_CSRRC:
+                csr_op   = 1;
+                val      = REGS(inst.i.rs1);
+                update   = (inst.i.rs1 == 0) ? 0 : 1;
+                csr_type = OP_CSRRC;
+                break;
+            default:
+                printf("Unknown system instruction at PC 0x%08x\n", pc);
+                TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
+                TRAP(TRAP_INST_ILL, inst.inst);
+                return;
+        }
+        if (csr_op) {
+            int legal = 0;
+            int result = csr_rw(inst.i.imm, csr_type, val, update, &legal);
+            if (legal) {
+                REGS_W(inst.i.rd, result);
             }
-            break;
+            TIME_LOG; TRACE_LOG "%08x %08x",
+                      pc, inst.inst TRACE_END;
+            if (!legal) {
+               TRACE_LOG "\n" TRACE_END;
+               TRAP(TRAP_INST_ILL, 0);
+               return;
+            }
+            TRACE_LOG " x%02u (%s) <= 0x%08x\n",
+                      inst.i.rd,
+                      regname[inst.i.rd], REGS(inst.i.rd) TRACE_END;
         }
-        case OP_AMO: {
-            switch (inst.r.func3){
-                case FN_RV32A:
-                    TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
-                    int32_t data;
-                    int32_t address = REGS(inst.r.rs1);
-                    // Data memory
-                    if (address >= DMEM_BASE && address < DMEM_BASE+DMEM_SIZE) {
-                        data = dmem[DVA2PA(address)/4];
-                    }
-                    else{
-                        printf("Unknown address 0x%08x to read at PC 0x%08x\n",
-                           address, pc);
-                        TRACE_LOG "\n" TRACE_END;
-                        TRAP(TRAP_LD_FAIL, address);
-                        continue;
-                    }
-                    if (singleram) CYCLE_ADD(1);
-                    switch(inst.r.func7 >> 2){
-                        case OP_LR:
-                            REGS_W(inst.r.rd, data);
-                            reserve_set = address;
-                            reserve_valid = 1;
-                            break;
-                        case OP_SC:
-                            if(reserve_valid && reserve_set == address){
-                                dmem[DVA2PA(address)/4] = REGS(inst.r.rs2);
-                                REGS(inst.r.rd) = 0;
-                            }
-                            else{
-                                REGS(inst.r.rd) = 1;
-                            }
-                            reserve_set = 0;
-                            break;
-                        case OP_AMOSWAP:
-                            REGS_W(inst.r.rd, data);
+        break;
+    }
+    case OP_AMO: {
+        switch (inst.r.func3){
+            case FN_RV32A:
+                TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
+                int32_t data;
+                int32_t address = REGS(inst.r.rs1);
+                // Data memory
+                if (address >= DMEM_BASE && address < DMEM_BASE+DMEM_SIZE) {
+                    data = dmem[DVA2PA(address)/4];
+                }
+                else{
+                    printf("Unknown address 0x%08x to read at PC 0x%08x\n",
+                       address, pc);
+                    TRACE_LOG "\n" TRACE_END;
+                    TRAP(TRAP_LD_FAIL, address);
+                    return;
+                }
+                if (singleram) CYCLE_ADD(1);
+                if (heatmap_en) {
+                    heatmap_access(address, 0);
+                    if ((inst.r.func7 >> 2) != OP_LR)
+                        heatmap_access(address, 1);
+                }
+                // a failed SC does not write
+                int write = (inst.r.func7 >> 2) != OP_LR &&
+                            ((inst.r.func7 >> 2) != OP_SC ||
+                             (reserve_valid && reserve_set == address));
+                if (debug_en && WATCHPOINT(watch_map, address))
+                    debug_watch(address, 4, 0);
+                switch(inst.r.func7 >> 2){
+                    case OP_LR:
+                        REGS_W(inst.r.rd, data);
+                        reserve_set = address;
+                        reserve_valid = 1;
+                        break;
+                    case OP_SC:
+                        if(reserve_valid && reserve_set == address){
                             dmem[DVA2PA(address)/4] = REGS(inst.r.rs2);
-                            break;
-                        case OP_AMOADD:
-                            REGS_W(inst.r.rd, data + REGS(inst.r.rs2));
-                            dmem[DVA2PA(address)/4] += REGS(inst.r.rs2);
-                            break;
-                        case OP_AMOAND:
-                            REGS_W(inst.r.rd, data & REGS(inst.r.rs2));
-                            dmem[DVA2PA(address)/4] &= REGS(inst.r.rs2);
-                            break;
-                        case OP_AMOOR:
-                            REGS_W(inst.r.rd, data | REGS(inst.r.rs2));
-                            dmem[DVA2PA(address)/4] |= REGS(inst.r.rs2);
-                            break;
-                        case OP_AMOXOR:
-                            REGS_W(inst.r.rd, data ^ REGS(inst.r.rs2));
-                            dmem[DVA2PA(address)/4] ^= REGS(inst.r.rs2);
-                            break;
-                        case OP_AMOMAX:
-                            REGS_W(inst.r.rd, MAX(data, REGS(inst.r.rs2)));
-                            dmem[DVA2PA(address/4)] = MAX(data, REGS(inst.r.rs2));
-                            break;
-                        case OP_AMOMIN:
-                            REGS_W(inst.r.rd, MIN(data, REGS(inst.r.rs2)));
-                            dmem[DVA2PA(address/4)] = MIN(data, REGS(inst.r.rs2));
-                            break;
-                        case OP_AMOMAXU:
-                            REGS_W(inst.r.rd, MIN((unsigned int)data, (unsigned int)REGS(inst.r.rs2)));
-                            dmem[DVA2PA(address/4)] = MIN((unsigned int)data, (unsigned int)REGS(inst.r.rs2));
-                            break;
-                        case OP_AMOMINU:
-                            REGS_W(inst.r.rd, MIN((unsigned int)data, (unsigned int)REGS(inst.r.rs2)));
-                            dmem[DVA2PA(address/4)] = MIN((unsigned int)data, (unsigned int)REGS(inst.r.rs2));
-                            break;
-                        default:
-                            printf("Unknown instruction at PC 0x%08x\n", pc);
-                            TRAP(TRAP_INST_ILL, inst.inst);
-                            continue;
-                    }
-                default:
-                    printf("Unknown instruction at PC 0x%08x\n", pc);
-                    TRAP(TRAP_INST_ILL, inst.inst);
-                    continue;
-            }
-            break;
+                            REGS(inst.r.rd) = 0;
+                        }
+                        else{
+                            REGS(inst.r.rd) = 1;
+                        }
+                        reserve_set = 0;
+                        break;
+                    case OP_AMOSWAP:
+                        REGS_W(inst.r.rd, data);
+                        dmem[DVA2PA(address)/4] = REGS(inst.r.rs2);
+                        break;
+                    case OP_AMOADD:
+                        REGS_W(inst.r.rd, data + REGS(inst.r.rs2));
+                        dmem[DVA2PA(address)/4] += REGS(inst.r.rs2);
+                        break;
+                    case OP_AMOAND:
+                        REGS_W(inst.r.rd, data & REGS(inst.r.rs2));
+                        dmem[DVA2PA(address)/4] &= REGS(inst.r.rs2);
+                        break;
+                    case OP_AMOOR:
+                        REGS_W(inst.r.rd, data | REGS(inst.r.rs2));
+                        dmem[DVA2PA(address)/4] |= REGS(inst.r.rs2);
+                        break;
+                    case OP_AMOXOR:
+                        REGS_W(inst.r.rd, data ^ REGS(inst.r.rs2));
+                        dmem[DVA2PA(address)/4] ^= REGS(inst.r.rs2);
+                        break;
+                    case OP_AMOMAX:
+                        REGS_W(inst.r.rd, MAX(data, REGS(inst.r.rs2)));
+                        dmem[DVA2PA(address/4)] = MAX(data, REGS(inst.r.rs2));
+                        break;
+                    case OP_AMOMIN:
+                        REGS_W(inst.r.rd, MIN(data, REGS(inst.r.rs2)));
+                        dmem[DVA2PA(address/4)] = MIN(data, REGS(inst.r.rs2));
+                        break;
+                    case OP_AMOMAXU:
+                        REGS_W(inst.r.rd, MIN((unsigned int)data, (unsigned int)REGS(inst.r.rs2)));
+                        dmem[DVA2PA(address/4)] = MIN((unsigned int)data, (unsigned int)REGS(inst.r.rs2));
+                        break;
+                    case OP_AMOMINU:
+                        REGS_W(inst.r.rd, MIN((unsigned int)data, (unsigned int)REGS(inst.r.rs2)));
+                        dmem[DVA2PA(address/4)] = MIN((unsigned int)data, (unsigned int)REGS(inst.r.rs2));
+                        break;
+                    default:
+                        printf("Unknown instruction at PC 0x%08x\n", pc);
+                        TRAP(TRAP_INST_ILL, inst.inst);
+                        return;
+                }
+                if (debug_en && write && WATCHPOINT(watch_map, address))
+                    debug_watch(address, 4, 1);
+            default:
+                printf("Unknown instruction at PC 0x%08x\n", pc);
+                TRAP(TRAP_INST_ILL, inst.inst);
+                return;
         }
-        default: {
-            printf("Illegal instruction at PC 0x%08x\n", pc);
-            TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
-            TRAP(TRAP_INST_ILL, inst.inst);
+        break;
+    }
+    default: {
+        printf("Illegal instruction at PC 0x%08x\n", pc);
+        TIME_LOG; TRACE_LOG "%08x %08x\n", pc, inst.inst TRACE_END;
+        TRAP(TRAP_INST_ILL, inst.inst);
+        return;
+    }
+    } // end of switch(inst.r.op)
+    pc = compressed ? pc + 2 : pc + 4;
+}
+
+// Execute one instruction in lockstep, return 0 if the program terminates
+int rvsim_step(void) {
+    if (setjmp(lockstep_env))
+        return 0;
+
+    step();
+    return 1;
+}
+
+#ifndef RVSIM_LIB
+// Idle loop fast-forward
+//
+// A short loop without stores, system instructions and I/O reads only polls
+// the memory or the timer. When the registers it reads before writing keep
+// their values over an iteration, the iterations differ by MTIME only. The
+// loop is observed for one iteration, then the first iteration that leaves
+// the loop, by the exit condition or an interrupt, is searched by running it
+// on a copy of the state with the counters advanced. The iterations before
+// it are skipped by adding their counts, so the cycles, MTIME and the hpm
+// counters are the same as running them. The search assumes that the loop
+// keeps leaving once it leaves, e.g. while(mtime < deadline).
+//
+// A register read before written may also be an induction register, only
+// changed by addi with itself and compared by the branches with the
+// unchanged registers, e.g. the delay loop of addi t0,t0,-1; bnez t0. It
+// is advanced by the same step each iteration, and the search stops
+// before it reaches the compared value, 0 or 0x80000000, where the branch
+// may change its direction.
+
+#define IDLE_BODY   32          // instructions of the loop body at most
+#define IDLE_REJECT 256         // loops known to be not idle
+#define IDLE_MAX    (1LL<<40)   // iterations skipped at once at most
+
+typedef struct {
+    int32_t     pc;
+    int32_t     prev_pc;
+    int32_t     regs[REGNUM];
+    CSR         csr;
+    long long   hpm_count[HPM_EVENTS];
+    RETIRE      retire;
+    int         timer_irq;
+    int         sw_irq;
+    int         sw_irq_next;
+    int         ext_irq;
+    int         ext_irq_next;
+    int         compressed;
+#ifdef RV32C_ENABLED
+    int         compressed_prev;
+    int         overhead;
+#endif // RV32C_ENABLED
+} IDLE_STATE;
+
+static int32_t idle_reject[IDLE_REJECT];
+static int idle_n = -1;         // instructions observed, -1 if not observing
+static int32_t idle_head;
+static int32_t idle_tail;
+static int32_t idle_path[IDLE_BODY];
+static int32_t idle_inst[IDLE_BODY];
+static int     idle_rd[IDLE_BODY];
+static uint32_t idle_src[IDLE_BODY];
+static int32_t idle_rs1[IDLE_BODY]; // the operands of the branches
+static int32_t idle_rs2[IDLE_BODY];
+static uint32_t idle_livein;    // registers read before written
+static uint32_t idle_written;
+static uint32_t idle_induct;    // induction registers
+static long long idle_limit;    // iterations skipped at most
+static IDLE_STATE idle_start;   // the state at the loop head
+static IDLE_STATE idle_delta;   // the counts of one iteration
+
+static void idle_save(IDLE_STATE *s) {
+    s->pc = pc;
+    s->prev_pc = prev_pc;
+    memcpy(s->regs, regs, sizeof(regs));
+    s->csr = csr;
+    memcpy(s->hpm_count, hpm_count, sizeof(hpm_count));
+    s->retire = retire;
+    s->timer_irq = timer_irq;
+    s->sw_irq = sw_irq;
+    s->sw_irq_next = sw_irq_next;
+    s->ext_irq = ext_irq;
+    s->ext_irq_next = ext_irq_next;
+    s->compressed = compressed;
+#ifdef RV32C_ENABLED
+    s->compressed_prev = compressed_prev;
+    s->overhead = overhead;
+#endif // RV32C_ENABLED
+}
+
+static void idle_restore(IDLE_STATE *s) {
+    pc = s->pc;
+    prev_pc = s->prev_pc;
+    memcpy(regs, s->regs, sizeof(regs));
+    csr = s->csr;
+    memcpy(hpm_count, s->hpm_count, sizeof(hpm_count));
+    retire = s->retire;
+    timer_irq = s->timer_irq;
+    sw_irq = s->sw_irq;
+    sw_irq_next = s->sw_irq_next;
+    ext_irq = s->ext_irq;
+    ext_irq_next = s->ext_irq_next;
+    compressed = s->compressed;
+#ifdef RV32C_ENABLED
+    compressed_prev = s->compressed_prev;
+    overhead = s->overhead;
+#endif // RV32C_ENABLED
+}
+
+// Add the counts of n iterations
+static void idle_advance(long long n) {
+    int i;
+
+    csr.cycle.c   += n * idle_delta.csr.cycle.c;
+    csr.mtime.c   += n * idle_delta.csr.mtime.c;
+    csr.time.c    += n * idle_delta.csr.time.c;
+    csr.instret.c += n * idle_delta.csr.instret.c;
+    for(i = 0; i < HPM_EVENTS; i++)
+        hpm_count[i] += n * idle_delta.hpm_count[i];
+    for(i = 1; i < REGNUM; i++)
+        regs[i] = (int32_t)((uint32_t)regs[i] + (uint32_t)(n * idle_delta.regs[i]));
+#ifdef RV32C_ENABLED
+    overhead += (int)(n * idle_delta.overhead);
+#endif // RV32C_ENABLED
+}
+
+// Return 1 if the iteration after n iterations leaves the loop
+static int idle_leave(long long n) {
+    IDLE_STATE s;
+    int i, leave = 0;
+
+    idle_save(&s);
+    idle_advance(n);
+    idle_probe = 1;
+    for(i = 0; i < idle_n && !leave; i++) {
+        if (pc != idle_path[i])
+            leave = 1;
+        else
+            step();
+    }
+    if (pc != idle_head)
+        leave = 1;
+    idle_probe = 0;
+    idle_restore(&s);
+
+    return leave;
+}
+
+static void idle_skip(void) {
+    long long lo, hi, mid;
+    int i;
+
+    idle_delta.csr.cycle.c   = csr.cycle.c   - idle_start.csr.cycle.c;
+    idle_delta.csr.mtime.c   = csr.mtime.c   - idle_start.csr.mtime.c;
+    idle_delta.csr.time.c    = csr.time.c    - idle_start.csr.time.c;
+    idle_delta.csr.instret.c = csr.instret.c - idle_start.csr.instret.c;
+    for(i = 0; i < HPM_EVENTS; i++)
+        idle_delta.hpm_count[i] = hpm_count[i] - idle_start.hpm_count[i];
+    for(i = 1; i < REGNUM; i++)
+        idle_delta.regs[i] = (idle_induct & (1 << i)) ?
+                             (int32_t)((uint32_t)regs[i] - (uint32_t)idle_start.regs[i]) : 0;
+#ifdef RV32C_ENABLED
+    idle_delta.overhead = overhead - idle_start.overhead;
+#endif // RV32C_ENABLED
+
+    if (idle_limit < 1 || idle_leave(0))
+        return;
+
+    // the iterations before hi stay in the loop, the iteration idle_limit
+    // is not searched
+    lo = 0;
+    for(hi = 1; hi < idle_limit && !idle_leave(hi); hi <<= 1)
+        lo = hi;
+    if (hi > idle_limit)
+        hi = idle_limit;
+    while(hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (idle_leave(mid))
+            hi = mid;
+        else
+            lo = mid;
+    }
+
+    idle_advance(hi);
+    idle_cycles += hi * idle_delta.csr.cycle.c;
+}
+
+// The iterations after the current one before the induction register, v at
+// the branch and changed by d each iteration, reaches c
+static long long idle_reach(int32_t v, int32_t d, int32_t c) {
+    uint64_t dist, step;
+
+    if (d > 0) {
+        dist = (uint32_t)c - (uint32_t)v;
+        step = d;
+    } else {
+        dist = (uint32_t)v - (uint32_t)c;
+        step = -(int64_t)d;
+    }
+    if (dist == 0)
+        dist = 1ULL << 32;
+    return (long long)((dist + step - 1) / step) - 1;
+}
+
+// Return the iterations skipped at most, or -1 if the induction registers
+// are used other than by addi with itself and the branches.
+static long long idle_bound(void) {
+    uint32_t taint = idle_induct;
+    long long limit = IDLE_MAX, n;
+    int i, k;
+
+    for(i = 0; i < idle_n; i++) {
+        int32_t inst = idle_inst[i];
+        int rs1 = (inst >> 15) & 0x1f;
+        int rs2 = (inst >> 20) & 0x1f;
+        int rd = idle_rd[i];
+        int addi = (inst & 0x7f) == OP_ARITHI && ((inst >> 12) & 7) == OP_ADD &&
+                   rd == rs1;
+        int32_t v, c, d;
+
+        if (rd > 0 && (idle_induct & (1 << rd)) && !addi)
+            return -1;
+        if (!(idle_src[i] & taint)) {
+            if (rd > 0)
+                taint &= ~(1 << rd);
             continue;
         }
-        } // end of switch(inst.r.op)
-        pc = compressed ? pc + 2 : pc + 4;
+        if (addi && (idle_induct & (1 << rd)))
+            continue;
+        if ((inst & 0x7f) != OP_BRANCH) {
+            if ((inst & 0x7f) == OP_LOAD || (inst & 0x7f) == OP_JALR)
+                return -1;
+            if (rd > 0)
+                taint |= 1 << rd;
+            continue;
+        }
+
+        // an induction register compared with an unchanged register
+        if ((taint & (1 << rs1)) && (taint & (1 << rs2)))
+            return -1;
+        if (taint & (1 << rs1)) {
+            v = idle_rs1[i];
+            c = idle_rs2[i];
+            k = rs1;
+        } else {
+            v = idle_rs2[i];
+            c = idle_rs1[i];
+            k = rs2;
+        }
+        if (!(idle_induct & (1 << k)))
+            return -1;
+        d = (int32_t)((uint32_t)regs[k] - (uint32_t)idle_start.regs[k]);
+        if ((n = idle_reach(v, d, c)) < limit)
+            limit = n;
+        if ((n = idle_reach(v, d, 0)) < limit)
+            limit = n;
+        if ((n = idle_reach(v, d, (int32_t)0x80000000)) < limit)
+            limit = n;
     }
 
-    aligned_free(mem);
-    if (ft) fclose(ft);
+    return limit;
+}
+
+static void idle_stop(int reject) {
+    if (reject)
+        idle_reject[(idle_head >> 1) % IDLE_REJECT] = idle_head;
+    idle_n = -1;
 }
 
+// Called after each instruction
+static void idle_loop(void) {
+    int32_t inst = retire.inst;
+    int32_t address = retire.address;
+    int rs1 = (inst >> 15) & 0x1f;
+    int rs2 = (inst >> 20) & 0x1f;
+    uint32_t src;
+    int i;
+
+    if (idle_n < 0) {
+        // a taken branch or jump backward to a short loop
+        if (pc > retire.pc || retire.pc - pc >= IDLE_BODY * 2 ||
+            idle_reject[(pc >> 1) % IDLE_REJECT] == pc)
+            return;
+
+        idle_head = pc;
+        idle_tail = retire.pc;
+        idle_n = 0;
+        idle_livein = 0;
+        idle_written = 0;
+        idle_save(&idle_start);
+        return;
+    }
+
+    // the loop exits, or an interrupt is taken
+    if (retire.pc < idle_head || retire.pc > idle_tail ||
+        idle_n >= IDLE_BODY) {
+        idle_stop(0);
+        return;
+    }
+
+    switch(inst & 0x7f) {
+        case OP_LUI:
+        case OP_AUIPC:
+        case OP_JAL:
+        case OP_FENCE:
+            src = 0;
+            break;
+        case OP_LOAD:
+            if (!(address >= IMEM_BASE && address < IMEM_BASE+IMEM_SIZE) &&
+                !(address >= DMEM_BASE && address < DMEM_BASE+DMEM_SIZE) &&
+                ((uint32_t)address < MMIO_MTIME || (uint32_t)address > MMIO_MSIP)) {
+                idle_stop(1);
+                return;
+            }
+            src = 1 << rs1;
+            break;
+        case OP_JALR:
+        case OP_ARITHI:
+            src = 1 << rs1;
+            break;
+        case OP_BRANCH:
+        case OP_ARITHR:
+            src = (1 << rs1) | (1 << rs2);
+            break;
+        default: // stores, CSR, system and atomic instructions
+            idle_stop(1);
+            return;
+    }
+
+    idle_livein |= src & ~idle_written;
+    if (retire.rd > 0)
+        idle_written |= 1 << retire.rd;
+    idle_inst[idle_n] = inst;
+    idle_rd[idle_n] = retire.rd;
+    idle_src[idle_n] = src;
+    if ((inst & 0x7f) == OP_BRANCH) {
+        idle_rs1[idle_n] = regs[rs1];
+        idle_rs2[idle_n] = regs[rs2];
+    }
+    idle_path[idle_n++] = retire.pc;
+
+    if (pc != idle_head)
+        return;
+
+    // one iteration, the registers read before written must be unchanged
+    // or be induction registers
+    idle_induct = 0;
+    for(i = 1; i < REGNUM; i++) {
+        if ((idle_livein & (1 << i)) && regs[i] != idle_start.regs[i])
+            idle_induct |= 1 << i;
+    }
+    if ((idle_limit = idle_bound()) < 0) {
+        idle_stop(1);
+        return;
+    }
+
+    idle_skip();
+    idle_stop(0);
+}
+
+int main(int argc, char **argv) {
+    char *file = NULL;
+    char *tfile = NULL;
+    char *cfile = NULL;
+    char *sfile = NULL;
+    char *hfile = NULL;
+    char *gfile = NULL;
+    int interval = 0;
+    int binary = 0;
+    char *kfile = NULL;
+    long long kinstret = 0;
+    char *pfile = NULL;
+    long long pinterval = 0;
+    int pindex = 1;
+
+    const char *optstring = "hdb:pl:qm:n:s";
+    int c;
+    struct option opts[] = {
+        {"help", 0, NULL, 'h'},
+        {"debug", 0, NULL, 'd'},
+        {"branch", 1, NULL, 'b'},
+        {"predict", 0, NULL, 'p'},
+        {"log", 1, NULL, 'l'},
+        {"quiet", 0, NULL, 'q'},
+        {"membase", 1, NULL, 'm'},
+        {"memsize", 1, NULL, 'n'},
+        {"single", 0, NULL, 's'},
+        {"callgraph", 1, NULL, OPT_CALLGRAPH},
+        {"stats", 1, NULL, OPT_STATS},
+        {"heatmap", 1, NULL, OPT_HEATMAP},
+        {"interval", 1, NULL, OPT_INTERVAL},
+        {"gdb", 1, NULL, OPT_GDB},
+        {"binary", 0, NULL, OPT_BINARY},
+        {"flush", 1, NULL, OPT_FLUSH},
+        {"idle", 0, NULL, OPT_IDLE},
+        {"checkpoint", 1, NULL, OPT_CHECKPOINT},
+        {"checkpoints", 1, NULL, OPT_CHECKPOINTS},
+        {NULL, 0, NULL, 0}
+    };
+
+    while((c = getopt_long(argc, argv, optstring, opts, NULL)) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                return 1;
+            case 'd':
+                debug_en = 1;
+                break;
+            case 'b':
+                branch_penalty = atoi(optarg);
+                break;
+            case 'p':
+                branch_predict = 1;
+                break;
+            case 'l':
+                if ((tfile = malloc(MAXLEN)) == NULL) {
+                    // LCOV_EXCL_START
+                    printf("malloc fail\n");
+                    exit(1);
+                    // LCOV_EXCL_STOP
+                }
+                strncpy_s(tfile, MAXLEN-1, optarg, MAXLEN-1);
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            case 'm':
+                sscanf(optarg, "%i", (int32_t*)&mem_base);
+                break;
+            case 'n':
+                sscanf(optarg, "%i", (int32_t*)&mem_size);
+                mem_size *= 1024;
+                break;
+            case 's':
+                singleram = 1;
+                break;
+            case OPT_CALLGRAPH:
+                cfile = optarg;
+                break;
+            case OPT_STATS:
+                sfile = optarg;
+                break;
+            case OPT_HEATMAP:
+                hfile = optarg;
+                break;
+            case OPT_INTERVAL:
+                interval = atoi(optarg);
+                break;
+            case OPT_GDB:
+                gfile = optarg;
+                break;
+            case OPT_BINARY:
+                binary = 1;
+                break;
+            case OPT_FLUSH:
+                if (console_policy(optarg))
+                    return 1;
+                break;
+            case OPT_IDLE:
+                idle_en = 1;
+                break;
+            case OPT_CHECKPOINT:
+                kfile = optarg;
+                if (!strrchr(kfile, '@') ||
+                    sscanf(strrchr(kfile, '@') + 1, "%lli", &kinstret) != 1) {
+                    usage();
+                    return 1;
+                }
+                *strrchr(kfile, '@') = 0;
+                break;
+            case OPT_CHECKPOINTS:
+                pfile = optarg;
+                if (!strrchr(pfile, '@') ||
+                    sscanf(strrchr(pfile, '@') + 1, "%lli", &pinterval) != 1 ||
+                    pinterval <= 0) {
+                    usage();
+                    return 1;
+                }
+                *strrchr(pfile, '@') = 0;
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    if (optind < argc) {
+        if ((file = malloc(MAXLEN)) == NULL) {
+            // LCOV_EXCL_START
+            printf("malloc fail\n");
+            exit(1);
+            // LCOV_EXCL_STOP
+        }
+        strncpy_s(file, MAXLEN-1, argv[optind], MAXLEN-1);
+    } else {
+        usage();
+        printf("Error: missing input file.\n\n");
+        return 1;
+    }
+
+    if (!file) {
+        usage();
+        return 1;
+    }
+
+    // the RTL boots at the address 0
+    if ((kfile || pfile) && mem_base != 0) {
+        printf("The checkpoint needs the memory base 0\n");
+        return 1;
+    }
+
+    console_init();
+
+    if (tfile && binary) {
+        TRACE_HEADER header;
+
+        if ((fb=fopen(tfile, "wb")) == NULL) {
+            // LCOV_EXCL_START
+            printf("can not open file %s\n", tfile);
+            exit(1);
+            // LCOV_EXCL_STOP
+        }
+        memcpy(header.magic, TRACE_MAGIC, 4);
+        header.version = TRACE_VERSION;
+        fwrite(&header, sizeof(header), 1, fb);
+    } else if (tfile) {
+        if ((ft=fopen(tfile, "w")) == NULL) {
+            // LCOV_EXCL_START
+            printf("can not open file %s\n", tfile);
+            exit(1);
+            // LCOV_EXCL_STOP
+        }
+    }
+
+    rvsim_init(file);
+
+    if (gfile)
+        debug_en = 1;
+
+    if (debug_en)
+        debug_init(file);
+
+    if (gfile) {
+        gdb_en = 1;
+        gdbstub_init(gfile);
+    }
+
+    if (cfile) {
+        callgraph_en = 1;
+        callgraph_init(file, cfile, pc);
+    }
+
+    if (sfile) {
+        stats_en = 1;
+        stats_init(sfile);
+    }
+
+    if (hfile) {
+        heatmap_en = 1;
+        heatmap_init(file, hfile, interval);
+    }
+
+    // the skipped iterations are not in the log, not seen by the tools, and
+    // would move the checkpoints off their instructions
+    if (tfile || debug_en || cfile || sfile || hfile || kfile || pfile)
+        idle_en = 0;
+
+    if (idle_en)
+        memset(idle_reject, 0xff, sizeof(idle_reject));
+
+    gettimeofday(&time_start, NULL);
+
+    // Execution loop
+    while(1) {
+        step();
+        if (fb)
+            trace_record();
+        if (idle_en)
+            idle_loop();
+        if (kfile && csr.instret.c >= kinstret) {
+            console_flush();
+            if (!checkpoint_write(kfile))
+                exit(1);
+            if (!quiet)
+                printf("\nCheckpoint at instruction %lld, PC 0x%08x, written to %s\n",
+                       csr.instret.c, pc, kfile);
+            exit(0);
+        }
+        if (pfile && csr.instret.c >= pinterval * pindex) {
+            char name[FILENAME_MAX];
+            snprintf(name, sizeof(name), "%s.%d", pfile, pindex++);
+            if (!checkpoint_write(name))
+                exit(1);
+        }
+    }
+}
+#endif // RVSIM_LIB
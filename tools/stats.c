@@ -0,0 +1,476 @@
+// Copyright © 2020 Kuoping Hsu
+// stats.c: instruction mix and operand statistics
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Only the execution and taken counts of each instruction address are kept
+// while running. The instructions are decoded once per address when the
+// program exits, so that the cost of the simulation loop is a counter update.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "opcode.h"
+#include "riscv-disas.h"
+
+#define PAGE_BITS       12
+#define PAGE_SLOTS      (1 << (PAGE_BITS - 1))  // one slot per halfword
+#define MAX_MNEMONIC    256
+
+extern CSR csr;
+extern int *imem;
+extern int mem_base;
+extern int mem_size;
+extern int quiet;
+extern char *regname[32];
+
+typedef struct {
+    long long   exec;
+    long long   taken;
+} COUNT;
+
+typedef struct {
+    const char *name;
+    const char *ext;
+    const char *fmt;
+    long long   count;
+    long long   taken;
+    int         branch;
+} MNEMONIC;
+
+typedef struct {
+    const char *name;
+    long long   count;
+} ITEM;
+
+static COUNT **pages = NULL;
+static int npages = 0;
+static char *outfile = NULL;
+
+static MNEMONIC mnemonics[MAX_MNEMONIC];
+static int nmnemonics = 0;
+
+static ITEM formats[] = {
+    { "R", 0 }, { "I", 0 }, { "S", 0 }, { "B", 0 }, { "U", 0 }, { "J", 0 },
+    { "CR", 0 }, { "CI", 0 }, { "CSS", 0 }, { "CIW", 0 }, { "CL", 0 },
+    { "CS", 0 }, { "CA", 0 }, { "CB", 0 }, { "CJ", 0 }, { "-", 0 }
+};
+
+static ITEM exts[] = {
+    { "I", 0 }, { "M", 0 }, { "A", 0 }, { "C", 0 }, { "B", 0 }, { "-", 0 }
+};
+
+static ITEM loads[]  = { { "byte", 0 }, { "half", 0 }, { "word", 0 } };
+static ITEM stores[] = { { "byte", 0 }, { "half", 0 }, { "word", 0 } };
+
+static long long reg_reads[32];
+static long long reg_writes[32];
+static long long total = 0;
+static long long insts16 = 0;
+
+#define ITEMS(a) ((int)(sizeof(a)/sizeof(a[0])))
+
+void stats_init(char *file) {
+    outfile = file;
+    npages = (mem_size >> PAGE_BITS) + 1;
+    if ((pages = (COUNT**)calloc(npages, sizeof(COUNT*))) == NULL) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(1);
+        // LCOV_EXCL_STOP
+    }
+}
+
+static COUNT *slot(int32_t pc) {
+    uint32_t addr = (uint32_t)IVA2PA(pc);
+    int page = addr >> PAGE_BITS;
+
+    if (page >= npages)
+        return NULL;
+
+    if (!pages[page] &&
+        (pages[page] = (COUNT*)calloc(PAGE_SLOTS, sizeof(COUNT))) == NULL) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(1);
+        // LCOV_EXCL_STOP
+    }
+
+    return &pages[page][(addr >> 1) & (PAGE_SLOTS - 1)];
+}
+
+void stats_exec(int32_t pc) {
+    COUNT *c = slot(pc);
+    if (c) c->exec++;
+}
+
+void stats_taken(int32_t pc) {
+    COUNT *c = slot(pc);
+    if (c) c->taken++;
+}
+
+// The disassembler does not know the B extension, so the instructions
+// implemented by rvsim are named here.
+static const char *bext_name(uint32_t inst, const char **fmt) {
+    int op     = inst & 0x7f;
+    int func3  = (inst >> 12) & 7;
+    int func7  = (inst >> 25) & 0x7f;
+    int rs2    = (inst >> 20) & 0x1f;
+
+    *fmt = (op == OP_ARITHR) ? "R" : "I";
+
+    if (op == OP_ARITHI && func3 == OP_SLL) {
+        switch(func7) {
+            case FN_BSET: return "bseti";
+            case FN_BCLR: return "bclri";
+            case FN_BINV: return "binvi";
+            case FN_CLZ:
+                switch(rs2) {
+                    case 0: return "clz";
+                    case 1: return "ctz";
+                    case 2: return "cpop";
+                    case 4: return "sext.b";
+                    case 5: return "sext.h";
+                }
+                break;
+        }
+    } else if (op == OP_ARITHI && func3 == OP_SR) {
+        switch(func7) {
+            case FN_BSET: return (rs2 == 7) ? "orc.b" : NULL;
+            case FN_BCLR: return "bexti";
+            case FN_CLZ:  return "rori";
+            case FN_REV:  return (rs2 == 0x18) ? "rev8" : NULL;
+        }
+    } else if (op == OP_ARITHR) {
+        switch(func7) {
+            case FN_ANDN:
+                switch(func3) {
+                    case OP_AND: return "andn";
+                    case OP_OR:  return "orn";
+                    case OP_XOR: return "xnor";
+                }
+                break;
+            case FN_ZEXT:
+                return (func3 == OP_XOR && rs2 == 0) ? "zext.h" : NULL;
+            case FN_MINMAX:
+                switch(func3) {
+                    case OP_CLMUL:  return "clmul";
+                    case OP_CLMULH: return "clmulh";
+                    case OP_CLMULR: return "clmulr";
+                    case OP_MAX:    return "max";
+                    case OP_MAXU:   return "maxu";
+                    case OP_MIN:    return "min";
+                    case OP_MINU:   return "minu";
+                }
+                break;
+            case FN_SHADD:
+                switch(func3) {
+                    case OP_SH1ADD: return "sh1add";
+                    case OP_SH2ADD: return "sh2add";
+                    case OP_SH3ADD: return "sh3add";
+                }
+                break;
+            case FN_BSET:
+                return (func3 == OP_SLL) ? "bset" : NULL;
+            case FN_BCLR:
+                return (func3 == OP_BCLR) ? "bclr" :
+                       (func3 == OP_BEXT) ? "bext" : NULL;
+            case FN_CLZ:
+                return (func3 == OP_ROL) ? "rol" :
+                       (func3 == OP_ROR) ? "ror" : NULL;
+            case FN_BINV:
+                return (func3 == OP_SLL) ? "binv" : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+static const char *codec_format(int codec) {
+    switch(codec) {
+        case rv_codec_u:        return "U";
+        case rv_codec_uj:       return "J";
+        case rv_codec_none:
+        case rv_codec_i:
+        case rv_codec_i_sh5:
+        case rv_codec_i_sh6:
+        case rv_codec_i_sh7:
+        case rv_codec_i_csr:    return "I";
+        case rv_codec_s:        return "S";
+        case rv_codec_sb:       return "B";
+        case rv_codec_r:
+        case rv_codec_r_m:
+        case rv_codec_r_a:
+        case rv_codec_r_l:
+        case rv_codec_r_f:      return "R";
+        case rv_codec_cr:
+        case rv_codec_cr_mv:
+        case rv_codec_cr_jalr:
+        case rv_codec_cr_jr:    return "CR";
+        case rv_codec_ci:
+        case rv_codec_ci_sh5:
+        case rv_codec_ci_sh6:
+        case rv_codec_ci_16sp:
+        case rv_codec_ci_lwsp:
+        case rv_codec_ci_li:
+        case rv_codec_ci_lui:
+        case rv_codec_ci_none:  return "CI";
+        case rv_codec_css_swsp: return "CSS";
+        case rv_codec_ciw_4spn: return "CIW";
+        case rv_codec_cl_lw:    return "CL";
+        case rv_codec_cs_sw:    return "CS";
+        case rv_codec_cs:       return "CA";
+        case rv_codec_cb:
+        case rv_codec_cb_imm:
+        case rv_codec_cb_sh5:
+        case rv_codec_cb_sh6:   return "CB";
+        case rv_codec_cj:
+        case rv_codec_cj_jal:   return "CJ";
+    }
+    return "-";
+}
+
+static void item_add(ITEM *items, int n, const char *name, long long count) {
+    int i;
+    for(i = 0; i < n; i++) {
+        if (!strcmp(items[i].name, name)) {
+            items[i].count += count;
+            return;
+        }
+    }
+}
+
+static int memory_size(const char *name) {
+    if (!strcmp(name, "lb") || !strcmp(name, "lbu") || !strcmp(name, "sb"))
+        return 0;
+    if (!strcmp(name, "lh") || !strcmp(name, "lhu") || !strcmp(name, "sh"))
+        return 1;
+    if (!strcmp(name, "lw") || !strcmp(name, "sw"))
+        return 2;
+    return -1;
+}
+
+static void account(int32_t pc, COUNT *c) {
+    rv_decode dec;
+    rv_inst inst;
+    uint16_t *half = (uint16_t*)imem;
+    uint32_t addr = (uint32_t)IVA2PA(pc) >> 1;
+    const char *name, *fmt, *ext, *opnd;
+    int len, size, i;
+
+    inst = half[addr];
+    len = inst_length(inst);
+    if (len == 4 && addr + 1 < (uint32_t)mem_size / 2)
+        inst |= (rv_inst)half[addr+1] << 16;
+
+    inst_decode(&dec, rv32, pc, inst);
+    name = inst_name(&dec);
+    fmt  = codec_format(dec.codec);
+    ext  = (len == 2) ? "C" :
+           ((inst & 0x7f) == OP_ARITHR && ((inst >> 25) & 0x7f) == FN_RV32M) ? "M" :
+           ((inst & 0x7f) == OP_AMO) ? "A" : "I";
+
+    if (dec.op == rv_op_illegal) {
+        ext = "-";
+        if (len == 4 && (name = bext_name((uint32_t)inst, &fmt)) != NULL) {
+            // the B extension instructions are R-type or shift immediate
+            ext = "B";
+            dec.rd  = (inst >> 7) & 0x1f;
+            dec.rs1 = (inst >> 15) & 0x1f;
+            dec.rs2 = (inst >> 20) & 0x1f;
+            opnd    = (*fmt == 'R' && strcmp(name, "zext.h")) ? "012" : "01";
+        } else {
+            name = "illegal";
+            opnd = "";
+        }
+    } else {
+        // count the implicit operands (e.g. ra of c.jal) of the base form
+        inst_decompress(&dec, rv32);
+        opnd = inst_format(&dec);
+    }
+
+    for(i = 0; i < nmnemonics; i++) {
+        if (!strcmp(mnemonics[i].name, name))
+            break;
+    }
+    if (i == nmnemonics && nmnemonics < MAX_MNEMONIC) {
+        mnemonics[i].name   = name;
+        mnemonics[i].ext    = ext;
+        mnemonics[i].fmt    = fmt;
+        mnemonics[i].branch = (dec.codec == rv_codec_sb);
+        nmnemonics++;
+    }
+    if (i < nmnemonics) {
+        mnemonics[i].count += c->exec;
+        mnemonics[i].taken += c->taken;
+    }
+
+    item_add(formats, ITEMS(formats), fmt, c->exec);
+    item_add(exts, ITEMS(exts), ext, c->exec);
+
+    if (strchr(opnd, '0')) reg_writes[dec.rd] += c->exec;
+    if (strchr(opnd, '1')) reg_reads[dec.rs1] += c->exec;
+    if (strchr(opnd, '2')) reg_reads[dec.rs2] += c->exec;
+
+    if ((size = memory_size(inst_name(&dec))) >= 0) {
+        if (dec.codec == rv_codec_s)
+            stores[size].count += c->exec;
+        else
+            loads[size].count += c->exec;
+    }
+
+    total += c->exec;
+    if (len == 2)
+        insts16 += c->exec;
+}
+
+static double percent(long long n, long long d) {
+    return d ? n * 100.0 / d : 0.0;
+}
+
+static void print_items(const char *title, ITEM *items, int n, long long sum) {
+    int i;
+    printf("\n%-10s %14s %7s\n", title, "count", "%");
+    for(i = 0; i < n; i++) {
+        if (items[i].count)
+            printf("%-10s %14lld %6.2f%%\n", items[i].name, items[i].count,
+                   percent(items[i].count, sum));
+    }
+}
+
+static void json_items(FILE *fp, const char *key, ITEM *items, int n, int last) {
+    int i;
+    fprintf(fp, "  \"%s\": {", key);
+    for(i = 0; i < n; i++)
+        fprintf(fp, "%s\"%s\": %lld", i ? ", " : "", items[i].name, items[i].count);
+    fprintf(fp, "}%s\n", last ? "" : ",");
+}
+
+void stats_exit(void) {
+    FILE *fp;
+    long long lds, sts, branches = 0, taken = 0;
+    int order[MAX_MNEMONIC];
+    int page, i, j;
+
+    for(page = 0; page < npages; page++) {
+        if (!pages[page])
+            continue;
+        for(i = 0; i < PAGE_SLOTS; i++) {
+            if (pages[page][i].exec)
+                account(IPA2VA((page << PAGE_BITS) + (i << 1)), &pages[page][i]);
+        }
+    }
+
+    // sort by the dynamic count
+    for(i = 0; i < nmnemonics; i++) {
+        for(j = i; j > 0 && mnemonics[order[j-1]].count < mnemonics[i].count; j--)
+            order[j] = order[j-1];
+        order[j] = i;
+    }
+
+    for(i = 0; i < nmnemonics; i++) {
+        if (mnemonics[i].branch) {
+            branches += mnemonics[i].count;
+            taken += mnemonics[i].taken;
+        }
+    }
+
+    lds = loads[0].count + loads[1].count + loads[2].count;
+    sts = stores[0].count + stores[1].count + stores[2].count;
+
+    if ((fp = fopen(outfile, "w")) == NULL) {
+        printf("can not open file %s\n", outfile);
+    } else {
+        fprintf(fp, "{\n");
+        fprintf(fp, "  \"instructions\": %lld,\n", total);
+        fprintf(fp, "  \"cycles\": %lld,\n", csr.cycle.c);
+        fprintf(fp, "  \"mnemonics\": [\n");
+        for(i = 0; i < nmnemonics; i++) {
+            MNEMONIC *m = &mnemonics[order[i]];
+            fprintf(fp, "    {\"name\": \"%s\", \"ext\": \"%s\", \"format\": \"%s\", "
+                    "\"count\": %lld}%s\n", m->name, m->ext, m->fmt, m->count,
+                    i == nmnemonics - 1 ? "" : ",");
+        }
+        fprintf(fp, "  ],\n");
+        json_items(fp, "formats", formats, ITEMS(formats), 0);
+        json_items(fp, "extensions", exts, ITEMS(exts), 0);
+        fprintf(fp, "  \"compressed\": {\"16bit\": %lld, \"32bit\": %lld, \"ratio\": %.4f},\n",
+                insts16, total - insts16, total ? (double)insts16 / total : 0.0);
+        fprintf(fp, "  \"registers\": [\n");
+        for(i = 0; i < 32; i++)
+            fprintf(fp, "    {\"reg\": \"x%d\", \"reads\": %lld, \"writes\": %lld}%s\n",
+                    i, reg_reads[i], reg_writes[i], i == 31 ? "" : ",");
+        fprintf(fp, "  ],\n");
+        json_items(fp, "loads", loads, ITEMS(loads), 0);
+        json_items(fp, "stores", stores, ITEMS(stores), 0);
+        fprintf(fp, "  \"branches\": {\n");
+        for(i = 0; i < nmnemonics; i++) {
+            MNEMONIC *m = &mnemonics[order[i]];
+            if (m->branch)
+                fprintf(fp, "    \"%s\": {\"count\": %lld, \"taken\": %lld},\n",
+                        m->name, m->count, m->taken);
+        }
+        fprintf(fp, "    \"total\": {\"count\": %lld, \"taken\": %lld}\n", branches, taken);
+        fprintf(fp, "  }\n");
+        fprintf(fp, "}\n");
+        fclose(fp);
+    }
+
+    if (quiet)
+        return;
+
+    printf("\nInstruction mix (%lld instructions)\n", total);
+    printf("%-10s %-4s %-4s %14s %7s\n", "mnemonic", "ext", "fmt", "count", "%");
+    for(i = 0; i < nmnemonics; i++) {
+        MNEMONIC *m = &mnemonics[order[i]];
+        printf("%-10s %-4s %-4s %14lld %6.2f%%\n", m->name, m->ext, m->fmt,
+               m->count, percent(m->count, total));
+    }
+
+    print_items("format", formats, ITEMS(formats), total);
+    print_items("extension", exts, ITEMS(exts), total);
+
+    printf("\nCompressed %lld (%.2f%%), full-width %lld (%.2f%%)\n",
+           insts16, percent(insts16, total),
+           total - insts16, percent(total - insts16, total));
+
+    printf("\n%-10s %14s %14s\n", "register", "reads", "writes");
+    for(i = 0; i < 32; i++) {
+        if (reg_reads[i] || reg_writes[i])
+            printf("x%-2d %-6s %14lld %14lld\n", i, regname[i],
+                   reg_reads[i], reg_writes[i]);
+    }
+
+    print_items("load", loads, ITEMS(loads), lds);
+    print_items("store", stores, ITEMS(stores), sts);
+
+    printf("\n%-10s %14s %14s %7s\n", "branch", "count", "taken", "%");
+    for(i = 0; i < nmnemonics; i++) {
+        MNEMONIC *m = &mnemonics[order[i]];
+        if (m->branch) {
+            printf("%-10s %14lld %14lld %6.2f%%\n", m->name, m->count,
+                   m->taken, percent(m->taken, m->count));
+        }
+    }
+    printf("%-10s %14lld %14lld %6.2f%%\n", "total", branches, taken,
+           percent(taken, branches));
+    printf("Statistics are written to %s\n", outfile);
+}
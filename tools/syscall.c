@@ -32,10 +32,112 @@
 
 #include "opcode.h"
 
+extern CSR csr;
 extern int *dmem;
 extern int mem_base;
 extern int mem_size;
 void prog_exit(int exitcode);
+void console_flush(void);
+void console_write(const char *buf, int len);
+
+#define HOST_PTR(addr) (&((char*)dmem)[DVA2PA(addr)])
+
+// The host calls shared by srv32_syscall() and srv32_tohost()
+
+int host_writev(int fd, int32_t iov, int count) {
+    int32_t *v = (int32_t*)HOST_PTR(iov);
+    int total = 0;
+    int i, n;
+
+    for(i = 0; i < count; i++) {
+        if (fd == STDOUT) {
+            console_write(HOST_PTR(v[i*2]), v[i*2+1]);
+            n = v[i*2+1];
+        } else if ((n = (int)write(fd, HOST_PTR(v[i*2]), v[i*2+1])) < 0) {
+            return total ? total : -1;
+        }
+        total += n;
+    }
+    return total;
+}
+
+// the console has no size, and does not depend on the host
+int host_fstat(int fd, int32_t buf) {
+    int32_t *st = (int32_t*)HOST_PTR(buf);
+    struct stat s;
+
+    if (fd == STDIN || fd == STDOUT || fd == STDERR) {
+        st[0] = S_IFCHR;
+        st[1] = 0;
+        return 0;
+    }
+    if (fstat(fd, &s) < 0)
+        return -1;
+    st[0] = (int32_t)s.st_mode;
+    st[1] = (int32_t)s.st_size;
+    return 0;
+}
+
+int host_gettimeofday(int32_t buf) {
+    int32_t *tv = (int32_t*)HOST_PTR(buf);
+
+    tv[0] = (int32_t)(csr.cycle.c / SIM_CLOCK_HZ);
+    tv[1] = (int32_t)((csr.cycle.c % SIM_CLOCK_HZ) / (SIM_CLOCK_HZ / 1000000));
+    return 0;
+}
+
+int host_times(int32_t buf) {
+    int32_t *tms = (int32_t*)HOST_PTR(buf);
+    int32_t ticks = (int32_t)(csr.cycle.c / (SIM_CLOCK_HZ / TIMES_HZ));
+
+    tms[0] = ticks;
+    tms[1] = 0;
+    tms[2] = 0;
+    tms[3] = 0;
+    return ticks;
+}
+
+// one fwrite for the whole range
+void host_dump(int32_t start, int32_t end) {
+    FILE *fp;
+    char *buf;
+    int i, n;
+
+    if ((fp = fopen("dump.txt", "w")) == NULL) {
+        printf("Create dump.txt fail\n");
+        exit(1);
+    }
+    if ((start & 3) != 0 || (end & 3) != 0) {
+        printf("Alignment error on memory dumping.\n");
+        exit(1);
+    }
+    n = (end - start) / 4;
+    if (n > 0) {
+        if ((buf = (char*)malloc(n * 9 + 1)) == NULL) {
+            // LCOV_EXCL_START
+            printf("malloc fail\n");
+            exit(1);
+            // LCOV_EXCL_STOP
+        }
+        for(i = 0; i < n; i++)
+            sprintf(&buf[i*9], "%08x\n", dmem[DVA2PA(start)/4 + i]);
+        fwrite(buf, 9, n, fp);
+        free(buf);
+    }
+    fclose(fp);
+}
+
+void host_dump_bin(int32_t start, int32_t end) {
+    FILE *fp;
+
+    if ((fp = fopen("dump.bin", "wb")) == NULL) {
+        printf("Create dump.bin fail\n");
+        exit(1);
+    }
+    if (end > start)
+        fwrite(HOST_PTR(start), 1, end - start, fp);
+    fclose(fp);
+}
 
 int srv32_syscall(
     int func, int a0, int a1, int a2,
@@ -74,6 +176,8 @@ int srv32_syscall(
                } while(++i<a2 && c != '\n');
            }
            #else
+           if (a0 == STDIN)
+               console_flush();
            res = (int)read(a0, (void *)(&ptr[DVA2PA(a1)]), a2);
            #endif
            break;
@@ -88,41 +192,42 @@ int srv32_syscall(
                fflush(stdout);
            }
            #else
-           res = (int)write(a0, (const char*)(&ptr[DVA2PA(a1)]), a2);
+           if (a0 == STDOUT) {
+               console_write((const char*)(&ptr[DVA2PA(a1)]), a2);
+               res = a2;
+           } else {
+               res = (int)write(a0, (const char*)(&ptr[DVA2PA(a1)]), a2);
+           }
            #endif
            break;
-       case SYS_DUMP: {
-               FILE *fp;
-               int i;
-               if ((fp = fopen("dump.txt", "w")) == NULL) {
-                   printf("Create dump.txt fail\n");
-                   exit(1);
-               }
-               if ((a0 & 3) != 0 || (a1 & 3) != 0) {
-                   printf("Alignment error on memory dumping.\n");
-                   exit(1);
-               }
-               for(i = DVA2PA(a0)/4;
-                   i < DVA2PA(a1)/4; i++) {
-                   fprintf(fp, "%08x\n", dmem[i]);
+       case SYS_WRITEV:
+           res = host_writev(a0, a1, a2);
+           break;
+       case SYS_FSTAT:
+           res = host_fstat(a0, a1);
+           break;
+       case SYS_GETTIMEOFDAY:
+           res = host_gettimeofday(a0);
+           break;
+       case SYS_TIMES:
+           res = host_times(a0);
+           break;
+       case SYS_BATCH: {
+               int32_t *call = (int32_t*)&ptr[DVA2PA(a0)];
+               for(res = 0; res < a1; res++, call += BATCH_WORDS) {
+                   if (call[0] == SYS_BATCH)
+                       break;
+                   call[7] = srv32_syscall(call[0], call[1], call[2], call[3],
+                                           call[4], call[5], call[6]);
                }
-               fclose(fp);
            }
+           break;
+       case SYS_DUMP:
+           host_dump(a0, a1);
            res = a1;
            break;
-       case SYS_DUMP_BIN: {
-               FILE *fp;
-               int i;
-               if ((fp = fopen("dump.bin", "wb")) == NULL) {
-                   printf("Create dump.bin fail\n");
-                   exit(1);
-               }
-               for(i = DVA2PA(a0);
-                   i < DVA2PA(a1); i++) {
-                   fprintf(fp, "%c", (dmem[i/4]>>((i%4)*8))&0xff);
-               }
-               fclose(fp);
-           }
+       case SYS_DUMP_BIN:
+           host_dump_bin(a0, a1);
            res = a1;
            break;
        default:
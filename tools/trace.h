@@ -0,0 +1,55 @@
+// Copyright © 2020 Kuoping Hsu
+// trace.h: binary trace log format
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The binary trace holds the same information as the text trace.log, one
+// fixed size record per retired instruction after the header. All fields are
+// little endian.
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+
+#define TRACE_MAGIC     "RVTR"
+#define TRACE_VERSION   1
+
+// flags of TRACE_RECORD
+#define TRACE_REG       (1<<0)  // writes the register rd
+#define TRACE_LOAD      (1<<1)  // reads the memory at address
+#define TRACE_STORE     (1<<2)  // writes data to the memory at address
+
+typedef struct {
+    char        magic[4];       // TRACE_MAGIC
+    uint32_t    version;
+} TRACE_HEADER;
+
+typedef struct {
+    uint32_t    cycle;
+    uint32_t    pc;
+    uint32_t    inst;
+    uint8_t     flags;
+    uint8_t     rd;
+    uint16_t    reserved;
+    uint32_t    address;        // load or store address
+    uint32_t    data;           // the value of rd, or the store data
+} TRACE_RECORD;
+
+#endif // __TRACE_H__
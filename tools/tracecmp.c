@@ -0,0 +1,435 @@
+// Copyright © 2020 Kuoping Hsu
+// tracecmp.c: find the first difference of two trace logs
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Both files are memory mapped and read in one pass, so the memory usage does
+// not depend on the size of the traces. Each file may be the text trace.log
+// of the RTL or the ISS, or the binary trace of trace.h, and the records are
+// compared field by field.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+#include "riscv-disas.h"
+
+#define RELEASE_SIZE    (64*1024*1024)  // drop the pages already compared
+
+// fields to compare
+#define FIELD_CYCLE     (1<<0)
+#define FIELD_PC        (1<<1)
+#define FIELD_INST      (1<<2)
+#define FIELD_REG       (1<<3)
+#define FIELD_LOAD      (1<<4)
+#define FIELD_STORE     (1<<5)
+
+static const char *fields[] = {
+    "cycle", "pc", "inst", "reg", "load", "store", NULL
+};
+
+static const char *regname[32] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "s0(fp)", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+    "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+};
+
+typedef struct {
+    char        *name;
+    char        *base;
+    size_t      size;
+    size_t      pos;
+    size_t      released;
+    int         binary;
+    long long   line;       // line number of the text trace
+    long long   count;      // records read
+} TRACE_FILE;
+
+// a record, the text line is parsed only when it differs
+typedef struct {
+    const char  *line;      // NULL for the binary trace
+    int         len;
+    int         parsed;
+    TRACE_RECORD rec;
+} ENTRY;
+
+void usage(void) {
+    printf(
+"Find the first difference of two trace logs\n"
+"Usage: tracecmp [-h] [-q] [-c n] [-i fields] file1 file2\n\n"
+"       --help, -h              help\n"
+"       --quiet, -q             report only whether the traces differ\n"
+"       --context n, -c n       records of context (default 10)\n"
+"       --ignore list, -i list  fields to ignore, separated by comma:\n"
+"                               cycle, pc, inst, reg, load, store\n"
+"\n"
+"       file1, file2            the text trace.log or the binary trace\n"
+"\n"
+    );
+}
+
+static int trace_open(TRACE_FILE *t, char *name) {
+    struct stat st;
+    int fd;
+
+    memset(t, 0, sizeof(TRACE_FILE));
+    t->name = name;
+
+    if ((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        printf("can not open file %s\n", name);
+        return 0;
+    }
+
+    t->size = st.st_size;
+    if (t->size) {
+        t->base = mmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (t->base == MAP_FAILED) {
+            printf("can not map file %s\n", name);
+            close(fd);
+            return 0;
+        }
+        madvise(t->base, t->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    if (t->size >= sizeof(TRACE_HEADER) &&
+        !memcmp(t->base, TRACE_MAGIC, 4)) {
+        TRACE_HEADER *header = (TRACE_HEADER*)t->base;
+        if (header->version != TRACE_VERSION) {
+            printf("%s: unknown trace version %d\n", name, header->version);
+            return 0;
+        }
+        t->binary = 1;
+        t->pos = sizeof(TRACE_HEADER);
+    }
+
+    return 1;
+}
+
+static int is_hex8(const char *p, const char *end) {
+    int i;
+
+    if (end - p < 8)
+        return 0;
+    for(i = 0; i < 8; i++) {
+        char c = p[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+              (c >= 'A' && c <= 'F')))
+            return 0;
+    }
+    return (end - p == 8 || p[8] == ' ' || p[8] == '\n');
+}
+
+static const char *skip_space(const char *p, const char *end) {
+    while(p < end && *p == ' ')
+        p++;
+    return p;
+}
+
+// parse one line of trace.log, "[cycle] pc inst [effect]"
+static void parse_line(const char *p, const char *end, TRACE_RECORD *rec) {
+    const char *q;
+    char buf[128];
+    unsigned int address, data;
+    int rd;
+    int len;
+
+    memset(rec, 0, sizeof(TRACE_RECORD));
+
+    p = skip_space(p, end);
+    q = p;
+    while(q < end && *q != ' ')
+        q++;
+    q = skip_space(q, end);
+
+    // the cycle is optional
+    if (!is_hex8(p, end) || (is_hex8(q, end) && is_hex8(skip_space(q + 8, end), end))) {
+        rec->cycle = (uint32_t)strtoul(p, NULL, 10);
+        p = q;
+    }
+
+    if (!is_hex8(p, end))
+        return;
+    rec->pc = (uint32_t)strtoul(p, NULL, 16);
+    p = skip_space(p + 8, end);
+    if (!is_hex8(p, end))
+        return;
+    rec->inst = (uint32_t)strtoul(p, NULL, 16);
+    p += 8;
+
+    len = (int)(end - p) < (int)sizeof(buf) - 1 ? (int)(end - p) : (int)sizeof(buf) - 1;
+    memcpy(buf, p, len);
+    buf[len] = 0;
+
+    if (sscanf(buf, " read 0x%x, x%d", &address, &rd) == 2 &&
+        (q = strstr(buf, "<= 0x")) != NULL) {
+        rec->flags = TRACE_LOAD | TRACE_REG;
+        rec->address = address;
+        rec->rd = rd;
+        rec->data = (uint32_t)strtoul(q + 5, NULL, 16);
+    } else if (sscanf(buf, " write 0x%x <= 0x%x", &address, &data) == 2) {
+        rec->flags = TRACE_STORE;
+        rec->address = address;
+        rec->data = data;
+    } else if (sscanf(buf, " x%d", &rd) == 1 &&
+               (q = strstr(buf, "<= 0x")) != NULL) {
+        rec->flags = TRACE_REG;
+        rec->rd = rd;
+        rec->data = (uint32_t)strtoul(q + 5, NULL, 16);
+    }
+}
+
+static size_t page_size = 4096;
+
+static void release(TRACE_FILE *t) {
+    size_t done = t->pos & ~(page_size - 1);
+
+    if (done - t->released >= RELEASE_SIZE) {
+        madvise(t->base + t->released, done - t->released, MADV_DONTNEED);
+        t->released = done;
+    }
+}
+
+// return 0 at the end of file
+static int trace_next(TRACE_FILE *t, ENTRY *e) {
+    if (t->binary) {
+        if (t->pos + sizeof(TRACE_RECORD) > t->size)
+            return 0;
+        memcpy(&e->rec, t->base + t->pos, sizeof(TRACE_RECORD));
+        e->line = NULL;
+        e->parsed = 1;
+        t->pos += sizeof(TRACE_RECORD);
+        t->count++;
+        release(t);
+        return 1;
+    }
+
+    // skip the empty lines
+    while(t->pos < t->size) {
+        const char *p = t->base + t->pos;
+        const char *end = memchr(p, '\n', t->size - t->pos);
+
+        if (end == NULL)
+            end = t->base + t->size;
+        t->pos = end - t->base + 1;
+        t->line++;
+        release(t);
+
+        if (end != p) {
+            e->line = p;
+            e->len = (int)(end - p);
+            e->parsed = 0;
+            t->count++;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static TRACE_RECORD *record(ENTRY *e) {
+    if (!e->parsed) {
+        parse_line(e->line, e->line + e->len, &e->rec);
+        e->parsed = 1;
+    }
+    return &e->rec;
+}
+
+static int compare(TRACE_RECORD *a, TRACE_RECORD *b) {
+    int diff = 0;
+
+    if (a->cycle != b->cycle)
+        diff |= FIELD_CYCLE;
+    if (a->pc != b->pc)
+        diff |= FIELD_PC;
+    if (a->inst != b->inst)
+        diff |= FIELD_INST;
+    if ((a->flags & TRACE_REG) != (b->flags & TRACE_REG) ||
+        ((a->flags & TRACE_REG) && (a->rd != b->rd || a->data != b->data)))
+        diff |= FIELD_REG;
+    if ((a->flags & TRACE_LOAD) != (b->flags & TRACE_LOAD) ||
+        ((a->flags & TRACE_LOAD) && a->address != b->address))
+        diff |= FIELD_LOAD;
+    if ((a->flags & TRACE_STORE) != (b->flags & TRACE_STORE) ||
+        ((a->flags & TRACE_STORE) &&
+         (a->address != b->address || a->data != b->data)))
+        diff |= FIELD_STORE;
+
+    return diff;
+}
+
+static void print_record(const char *mark, long long n, ENTRY *e) {
+    TRACE_RECORD *rec = record(e);
+    char buf[80] = {0};
+
+    disasm_inst(buf, sizeof(buf), rv32, rec->pc, rec->inst);
+    printf("%s %10lld %10u %08x %-56s", mark, n, rec->cycle, rec->pc, buf);
+    if (rec->flags & TRACE_LOAD)
+        printf(" read 0x%08x,", rec->address);
+    if (rec->flags & TRACE_REG)
+        printf(" x%02d (%s) <= 0x%08x", rec->rd, regname[rec->rd & 31], rec->data);
+    if (rec->flags & TRACE_STORE)
+        printf(" write 0x%08x <= 0x%08x", rec->address, rec->data);
+    printf("\n");
+}
+
+static void print_where(TRACE_FILE *t) {
+    if (t->binary)
+        printf("%s record %lld", t->name, t->count);
+    else
+        printf("%s line %lld", t->name, t->line);
+}
+
+int main(int argc, char **argv) {
+    TRACE_FILE t1, t2;
+    ENTRY e1, e2;
+    ENTRY *history;
+    int context = 10;
+    int ignore = 0;
+    int quiet = 0;
+    long long n = 0, j;
+    int c, i, diff = 0;
+    int more1, more2;
+
+    const char *optstring = "hqc:i:";
+    struct option opts[] = {
+        {"help", 0, NULL, 'h'},
+        {"quiet", 0, NULL, 'q'},
+        {"context", 1, NULL, 'c'},
+        {"ignore", 1, NULL, 'i'},
+        {NULL, 0, NULL, 0}
+    };
+
+    while((c = getopt_long(argc, argv, optstring, opts, NULL)) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                return 0;
+            case 'q':
+                quiet = 1;
+                break;
+            case 'c':
+                context = atoi(optarg);
+                if (context < 0)
+                    context = 0;
+                break;
+            case 'i': {
+                char *tok = strtok(optarg, ",");
+                while(tok) {
+                    for(i = 0; fields[i]; i++) {
+                        if (!strcmp(tok, fields[i]))
+                            break;
+                    }
+                    if (!fields[i]) {
+                        printf("Unknown field %s\n", tok);
+                        return 2;
+                    }
+                    ignore |= 1 << i;
+                    tok = strtok(NULL, ",");
+                }
+                break;
+            }
+            default:
+                usage();
+                return 2;
+        }
+    }
+
+    if (optind + 2 != argc) {
+        usage();
+        return 2;
+    }
+
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    if (!trace_open(&t1, argv[optind]) || !trace_open(&t2, argv[optind+1]))
+        return 2;
+
+    if ((history = (ENTRY*)malloc((context + 1) * sizeof(ENTRY))) == NULL) {
+        // LCOV_EXCL_START
+        printf("malloc fail\n");
+        exit(2);
+        // LCOV_EXCL_STOP
+    }
+
+    while(1) {
+        more1 = trace_next(&t1, &e1);
+        more2 = trace_next(&t2, &e2);
+
+        if (!more1 || !more2)
+            break;
+
+        // the same text lines are always the same records
+        if (!e1.line || !e2.line || e1.len != e2.len ||
+            memcmp(e1.line, e2.line, e1.len)) {
+            if ((diff = compare(record(&e1), record(&e2)) & ~ignore) != 0)
+                break;
+        }
+
+        if (context)
+            history[n % context] = e1;
+        n++;
+    }
+
+    if (!diff && !more1 && !more2) {
+        if (!quiet)
+            printf("The traces are identical, %lld records\n", n);
+        return 0;
+    }
+
+    if (quiet) {
+        printf("Traces %s and %s differ at record %lld\n", t1.name, t2.name, n + 1);
+        return 1;
+    }
+
+    // the records are numbered from 1, as the records and lines of print_where
+    if (diff) {
+        printf("First difference at record %lld (", n + 1);
+        print_where(&t1);
+        printf(", ");
+        print_where(&t2);
+        printf("):");
+        for(i = 0; fields[i]; i++) {
+            if (diff & (1 << i))
+                printf(" %s", fields[i]);
+        }
+        printf("\n\n");
+    } else {
+        printf("%s ends at record %lld\n\n", more1 ? t2.name : t1.name, n);
+    }
+
+    for(j = n > context ? n - context : 0; j < n; j++)
+        print_record(" ", j + 1, &history[j % context]);
+    if (more1)
+        print_record("<", n + 1, &e1);
+    if (more2)
+        print_record(">", n + 1, &e2);
+
+    printf("\n< %s\n> %s\n", t1.name, t2.name);
+
+    return 1;
+}